@@ -4,6 +4,7 @@
 
 layout (location = 0) in vec2 vUV;
 layout (location = 1) in vec3 vColor;
+layout (location = 2) in vec3 vBary;
 
 layout (location = 0) out vec4 outColor;
 
@@ -16,6 +17,15 @@ layout(push_constant) uniform PerFrameData{
 } pc;
 
 layout (constant_id = 0) const bool isWireframe = false;
+layout (constant_id = 1) const bool isWireframeOverlay = false;
+
+// 0 on the edges of the triangle, 1 further than `thickness` pixels away from them
+float edgeFactor(float thickness)
+{
+	vec3 d = fwidth(vBary);
+	vec3 a = smoothstep(vec3(0.0), d * thickness, vBary);
+	return min(min(a.x, a.y), a.z);
+}
 
 void main()
 {
@@ -25,5 +35,8 @@ void main()
 	} else
 	{
 		outColor = texture(sampler2D(kTextures2D[pc.textureId], kSamplers[0]), vUV);
+
+		if (isWireframeOverlay)
+			outColor.rgb = mix(vec3(0.0), outColor.rgb, edgeFactor(1.0));
 	}
 }
\ No newline at end of file
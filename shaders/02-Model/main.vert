@@ -13,9 +13,12 @@ layout (location=1) in vec2 inUV;
 
 layout (location=0) out vec2 vUV;
 layout (location=1) out vec3 vColor;
+layout (location=2) out vec3 vBary;
 
 void main() {
 	gl_Position = pc.MVP * vec4(inPos, 1.0);
 	vUV = inUV;
 	vColor = isWireframe ? vec3(0.0) : inPos.xyz;
+	// no edges: the indexed path cannot tell the corners of a triangle apart
+	vBary = vec3(1.0);
 }
\ No newline at end of file
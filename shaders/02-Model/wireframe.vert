@@ -0,0 +1,40 @@
+//
+#version 460 core
+#extension GL_EXT_buffer_reference : require
+
+// Vertex pulling: the draw is not indexed, so every triangle owns its 3 corners and can give them
+// barycentric coordinates for the wireframe overlay in main.frag
+
+struct Vertex {
+	float x, y, z;
+	float u, v;
+};
+
+layout(std430, buffer_reference) readonly buffer Vertices {
+	Vertex vertices[];
+};
+
+layout(std430, buffer_reference) readonly buffer Indices {
+	uint indices[];
+};
+
+layout(push_constant) uniform PerFrameData {
+	mat4 MVP;
+	uint textureId;
+	Vertices vb;
+	Indices ib;
+} pc;
+
+layout (location=0) out vec2 vUV;
+layout (location=1) out vec3 vColor;
+layout (location=2) out vec3 vBary;
+
+void main() {
+	Vertex v = pc.vb.vertices[pc.ib.indices[gl_VertexIndex]];
+
+	gl_Position = pc.MVP * vec4(v.x, v.y, v.z, 1.0);
+	vUV = vec2(v.u, v.v);
+	vColor = vec3(0.0);
+	vBary = vec3(0.0);
+	vBary[gl_VertexIndex % 3] = 1.0;
+}
\ No newline at end of file
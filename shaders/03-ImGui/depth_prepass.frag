@@ -0,0 +1,5 @@
+//
+// Depth-only pass: the depth test and write are all that is needed, the fragment shader does nothing
+
+void main() {
+}
\ No newline at end of file
@@ -1,9 +1,22 @@
 //
 #version 460 core
 
+layout(push_constant) uniform PerFrameData {
+	mat4 mvp;
+	bool isWireframe;
+};
+
 layout (location=0) in vec3 color;
+layout (location=1) in vec3 bary;
 layout (location=0) out vec4 out_FragColor;
 
+// 0 on the edges of the triangle, 1 further than `thickness` pixels away from them
+float edgeFactor(float thickness) {
+	vec3 d = fwidth(bary);
+	vec3 a = smoothstep(vec3(0.0), d * thickness, bary);
+	return min(min(a.x, a.y), a.z);
+}
+
 void main() {
-	out_FragColor = vec4(color, 1.0);
+	out_FragColor = vec4(isWireframe ? mix(vec3(0.0), color, edgeFactor(1.0)) : color, 1.0);
 }
\ No newline at end of file
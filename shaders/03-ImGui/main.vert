@@ -7,6 +7,7 @@ layout(push_constant) uniform PerFrameData {
 };
 
 layout (location=0) out vec3 color;
+layout (location=1) out vec3 bary;
 
 const vec3 pos[8] = vec3[8](
 	vec3(-1.0,-1.0, 1.0), vec3( 1.0,-1.0, 1.0), vec3( 1.0, 1.0, 1.0), vec3(-1.0, 1.0, 1.0),
@@ -30,5 +31,7 @@ const uint indices[36] = uint[36](
 void main() {
 	uint idx = indices[gl_VertexIndex];
 	gl_Position = mvp * vec4(pos[idx], 1.0);
-	color = isWireframe ? vec3(0.0) : col[idx];
+	color = col[idx];
+	bary = vec3(0.0);
+	bary[gl_VertexIndex % 3] = 1.0;
 }
\ No newline at end of file
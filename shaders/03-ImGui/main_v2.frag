@@ -3,19 +3,26 @@
 #include <common.sp>
 
 layout (location=0) in PerVertex vtx;
+layout (location=3) flat in uint materialIndex;
 
 layout (location=0) out vec4 out_FragColor;
 
+layout(early_fragment_tests) in;
+
 void main() {
+	countOverdraw(gl_FragCoord.xy);
+
 	vec3 n = normalize(vtx.worldNormal);
 	vec3 v = normalize(pc.cameraPos.xyz - vtx.worldPos);
 	vec3 reflection = -normalize(reflect(v, n));
 
-	vec4 colorRefl = textureBindlessCube(pc.texCube, 0, reflection);
-	vec4 Ka = colorRefl * 0.3;
+	Material mat = pc.materials.data[materialIndex];
+
+	vec4 colorRefl = textureBindlessCube(pc.texCube, pc.samplerCube, reflection);
+	vec4 Ka = colorRefl * mat.reflectivity;
 
 	float NdotL = clamp(dot(n, normalize(vec3(0,0,-1))), 0.1, 1.0);
-	vec4 Kd = textureBindless2D(pc.tex, 0, vtx.uv) * NdotL;
+	vec4 Kd = textureBindless2D(mat.baseColorTexture, mat.baseColorSampler, vtx.uv) * mat.baseColorFactor * NdotL;
 
 	out_FragColor = Ka + Kd;
 };
\ No newline at end of file
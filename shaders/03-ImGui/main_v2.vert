@@ -7,14 +7,22 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 uv;
 
 layout (location=0) out PerVertex vtx;
+layout (location=3) flat out uint materialIndex;
+
+// the depth prepass and the color pass use different pipelines and must produce the same depth values
+invariant gl_Position;
 
 void main() {
-	gl_Position = pc.proj * pc.view * pc.model * vec4(pos, 1.0);
+	// firstInstance of every draw is the instance index
+	Instance instance = pc.instances.data[gl_InstanceIndex];
+	mat4 model = instance.transform * pc.model;
+
+	gl_Position = pc.proj * pc.view * model * vec4(pos, 1.0);
 
-	mat4 model = pc.model;
-	mat3 normalMatrix = transpose( inverse(mat3(pc.model)) );
+	mat3 normalMatrix = transpose( inverse(mat3(model)) );
 
 	vtx.uv = uv;
 	vtx.worldNormal = normalMatrix * normal;
 	vtx.worldPos = (model * vec4(pos, 1.0)).xyz;
+	materialIndex = instance.materialIndex;
 }
\ No newline at end of file
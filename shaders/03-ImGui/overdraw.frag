@@ -0,0 +1,21 @@
+//
+// Overdraw heat map: black for pixels nobody shaded, then green, yellow, orange and red for 1, 2, 3 and 4+ shaded fragments
+
+#include <common.sp>
+
+layout (location=0) in vec2 uv;
+
+layout (location=0) out vec4 out_FragColor;
+
+const vec3 colors[5] = vec3[5](
+	vec3(0.0, 0.0, 0.0),
+	vec3(0.0, 0.8, 0.0),
+	vec3(1.0, 1.0, 0.0),
+	vec3(1.0, 0.5, 0.0),
+	vec3(1.0, 0.0, 0.0)
+);
+
+void main() {
+	uint count = pc.overdraw.count[uint(gl_FragCoord.y) * pc.overdrawWidth + uint(gl_FragCoord.x)];
+	out_FragColor = vec4(colors[min(count, 4)], 1.0);
+}
\ No newline at end of file
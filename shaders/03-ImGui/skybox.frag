@@ -6,6 +6,9 @@ layout (location=0) in vec3 dir;
 
 layout (location=0) out vec4 out_FragColor;
 
+layout(early_fragment_tests) in;
+
 void main() {
-	out_FragColor = textureBindlessCube(pc.texCube, 0, dir);
+	countOverdraw(gl_FragCoord.xy);
+	out_FragColor = textureBindlessCube(pc.texCube, pc.samplerCube, dir);
 };
\ No newline at end of file
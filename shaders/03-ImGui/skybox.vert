@@ -27,6 +27,7 @@ const int indices[36] = int[36](
 
 void main() {
 	int idx = indices[gl_VertexIndex];
-	gl_Position = pc.proj * mat4(mat3(pc.view)) * vec4(1.0 * pos[idx], 1.0);
+	// z = w puts the skybox at depth 1.0, behind everything, so it can be drawn last with CompareOp_LessEqual
+	gl_Position = (pc.proj * mat4(mat3(pc.view)) * vec4(1.0 * pos[idx], 1.0)).xyww;
 	dir = pos[idx].xyz;
 }
\ No newline at end of file
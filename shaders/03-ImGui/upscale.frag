@@ -0,0 +1,18 @@
+//
+// Stretches the top-left `uvMax` part of the scene target, where the scene was rendered at a reduced resolution,
+// over the whole output. The bilinear footprint is kept inside that region, so nothing bleeds in from outside of it.
+
+layout (location=0) in vec2 uv;
+
+layout (location=0) out vec4 out_FragColor;
+
+layout(push_constant) uniform PushConstants {
+	vec2 uvScale;
+	vec2 uvMax;
+	uint texture;
+	uint sampler;
+} pc;
+
+void main() {
+	out_FragColor = textureBindless2D(pc.texture, pc.sampler, min(uv * pc.uvScale, pc.uvMax));
+}
\ No newline at end of file
@@ -1,19 +1,29 @@
 #include <iostream>
 #include <filesystem>
+#include <chrono>
 
 #include <GLFW/glfw3.h>
 
 #include "shader_processor.h"
+#include "headless.h"
 
 constexpr uint32_t width = 800;
 constexpr uint32_t height = 600;
 
-int main()
+int main(int argc, char** argv)
 {
+	const auto start = std::chrono::steady_clock::now();
+
 	// Compile shaders
 	compileShaderToSPIRV(std::filesystem::absolute("D:/Projects/Vulkan-Practice/shaders/00-Setup/main.vert"), std::filesystem::absolute("cache/o.vert.bin"));
 	compileShaderToSPIRV(std::filesystem::absolute("D:/Projects/Vulkan-Practice/shaders/00-Setup/main.frag"), std::filesystem::absolute("cache/o.frag.bin"));
 
+	// Nothing is rendered in this chapter, so headless mode only measures the shader compilation
+	if (parseHeadlessOptions(argc, argv).enabled)
+	{
+		printf("[00-Setup] shaders compiled in %.3f ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		return 0;
+	}
 
 	if (!glfwInit())
 	{
@@ -5,20 +5,38 @@
 #include <GLFW/glfw3.h>
 
 #include "shader_processor.h"
+#include "headless.h"
 
-int main()
+int main(int argc, char** argv)
 {
 	minilog::initialize(nullptr, { .threadNames = false });
 
+	const HeadlessOptions headless = parseHeadlessOptions(argc, argv);
+
 	// Giving non-positive numbers will let the window automatically pick the size
 	int width = -95;
 	int height = -90;
 
-	// We will use LVK's window instead
-	GLFWwindow* window = lvk::initWindow("Simple Window", width, height);
+	GLFWwindow* window = nullptr;
+	std::unique_ptr<lvk::IContext> ctx;
+
+	if (headless.enabled)
+	{
+		// No window and no swapchain, we render into an offscreen texture instead
+		ctx = createHeadlessContext(headless.deviceType);
+		if (!ctx)
+			return 255;
+	}
+	else
+	{
+		// We will use LVK's window instead
+		window = lvk::initWindow("Simple Window", width, height);
+
+		// Just like glfwMakeContextCurrent(window);
+		ctx = lvk::createVulkanContextWithSwapchain(window, width, height, {});
+	}
 
-	// Just like glfwMakeContextCurrent(window);
-	std::unique_ptr<lvk::IContext> ctx = lvk::createVulkanContextWithSwapchain(window, width, height, {});
+	const lvk::Format colorFormat = headless.enabled ? kHeadlessColorFormat : ctx->getSwapchainFormat();
 
 	lvk::Holder<lvk::ShaderModuleHandle> vert = loadShaderModule(ctx, std::filesystem::absolute("D:/Projects/Vulkan-Practice/shaders/00-Triangle/main.vert"));
 	lvk::Holder<lvk::ShaderModuleHandle> frag = loadShaderModule(ctx, std::filesystem::absolute("D:/Projects/Vulkan-Practice/shaders/00-Triangle/main.frag"));
@@ -27,24 +45,15 @@ int main()
 	lvk::Holder<lvk::RenderPipelineHandle> soildPipeline = ctx->createRenderPipeline({
 		.smVert = vert,
 		.smFrag = frag,
-		.color = {{.format = ctx->getSwapchainFormat()}}
+		.color = {{.format = colorFormat}}
 
 		});
 
-	while (!glfwWindowShouldClose(window))
-	{
-		glfwPollEvents();
-		glfwGetFramebufferSize(window, &width, &height);
-		// Skip rendering if width or height is zero
-		if (!width || !height)
-			continue;
-
-		// You record commands and submit them
-		lvk::ICommandBuffer& buff = ctx->acquireCommandBuffer();
+	auto renderFrame = [&](lvk::ICommandBuffer& buff, lvk::TextureHandle colorTarget) {
 		// Clear color, bind frame buffer etc
 		buff.cmdBeginRendering(
 			{ .color = { {.loadOp = lvk::LoadOp_Clear, .clearColor = { 1.0f, 1.0f, 1.0f, 1.0f } } } },
-			{ .color = { {.texture = ctx->getCurrentSwapchainTexture() } } });
+			{ .color = { {.texture = colorTarget } } });
 		// glUseProgram
 		buff.cmdBindRenderPipeline(soildPipeline);
 		buff.cmdPushDebugGroupLabel("Render Triangle", 0xff0000ff);
@@ -52,6 +61,27 @@ int main()
 		buff.cmdDraw(3);
 		buff.cmdPopDebugGroupLabel();
 		buff.cmdEndRendering();
+	};
+
+	if (headless.enabled)
+	{
+		const HeadlessStats stats = runHeadless(*ctx, headless, [&](lvk::ICommandBuffer& buf, lvk::TextureHandle colorTarget, uint32_t, uint32_t, double) {
+			renderFrame(buf, colorTarget);
+			});
+		printHeadlessStats("01-Triangle", stats);
+	}
+
+	while (window && !glfwWindowShouldClose(window))
+	{
+		glfwPollEvents();
+		glfwGetFramebufferSize(window, &width, &height);
+		// Skip rendering if width or height is zero
+		if (!width || !height)
+			continue;
+
+		// You record commands and submit them
+		lvk::ICommandBuffer& buff = ctx->acquireCommandBuffer();
+		renderFrame(buff, ctx->getCurrentSwapchainTexture());
 
 		//glfwSwapBuffers
 		ctx->submit(buff, ctx->getCurrentSwapchainTexture());
@@ -61,8 +91,12 @@ int main()
 	frag.reset();
 	vert.reset();
 	ctx.reset();
-	glfwDestroyWindow(window);
-	glfwTerminate();
+
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <chrono>
 
 #include <lvk/LVK.h>
 #include <GLFW/glfw3.h>
@@ -16,18 +17,65 @@
 
 #include "shader_processor.h"
 #include "model_loader.h"
+#include "headless.h"
+#include "render_graph.h"
+#include "pipeline_library.h"
+#include "meshlet_builder.h"
 
-int main()
+enum eRenderMode
+{
+	eRenderMode_Solid,
+	// solid pass, then the same mesh again with PolygonMode_Line and a depth bias
+	eRenderMode_TwoPassWireframe,
+	// one non-indexed draw; the fragment shader darkens pixels close to the triangle edges
+	eRenderMode_SinglePassWireframe,
+	// solid, drawn as meshlets which survived frustum and normal cone culling in a compute shader
+	eRenderMode_Meshlets,
+	eRenderMode_Count
+};
+
+static const char* getRenderModeName(uint32_t mode)
+{
+	static const char* kNames[] = { "solid", "two-pass wireframe", "single-pass wireframe", "meshlets" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eRenderMode_Count);
+	return mode < eRenderMode_Count ? kNames[mode] : "unknown";
+}
+
+int main(int argc, char** argv)
 {
 	minilog::initialize(nullptr, { .threadNames = false });
 
+	const auto startupStart = std::chrono::steady_clock::now();
+
+	const HeadlessOptions headless = parseHeadlessOptions(argc, argv);
+
 	int width = -95;
 	int height = -90;
 
-	GLFWwindow* window = lvk::initWindow("Model", width, height);
+	GLFWwindow* window = nullptr;
 
 	// Context
-	std::unique_ptr<lvk::IContext> ctx = lvk::createVulkanContextWithSwapchain(window, width, height, {});
+	std::unique_ptr<lvk::IContext> ctx;
+
+	const std::vector<uint8_t> pipelineCacheData = loadPipelineCacheData();
+	const char* pipelineCacheState = pipelineCacheData.empty() ? "cold" : "warm";
+
+	if (headless.enabled)
+	{
+		ctx = createHeadlessContext(headless.deviceType, makeContextConfig(pipelineCacheData));
+		if (!ctx)
+			return 255;
+		width = (int)headless.width;
+		height = (int)headless.height;
+	}
+	else
+	{
+		window = lvk::initWindow("Model", width, height);
+		ctx = lvk::createVulkanContextWithSwapchain(window, width, height, makeContextConfig(pipelineCacheData));
+	}
+
+	const lvk::Format colorFormat = headless.enabled ? kHeadlessColorFormat : ctx->getSwapchainFormat();
+	const lvk::Format depthFormat = lvk::Format_Z_F32;
 
 	std::vector<Vertex> verts;
 	std::vector<uint32_t> indices;
@@ -38,8 +86,9 @@ int main()
 	lvk::Holder<lvk::TextureHandle> texture = loadTexture(std::filesystem::absolute("../../../models/rubber_duck/textures/Duck_baseColor.png"), ctx);
 
 	// Vertex Buffer
+	// Storage usage lets the single-pass wireframe shader pull vertices through buffer device addresses
 	lvk::Holder<lvk::BufferHandle> vertexBuffer = ctx->createBuffer({
-		.usage = lvk::BufferUsageBits_Vertex,
+		.usage = lvk::BufferUsageBits_Vertex | lvk::BufferUsageBits_Storage,
 		.storage = lvk::StorageType_Device,
 		.size = sizeof(Vertex) * verts.size(),
 		.data = verts.data(),
@@ -47,22 +96,77 @@ int main()
 		});
 	// Index Buffer
 	lvk::Holder<lvk::BufferHandle> indexBuffer = ctx->createBuffer({
-		.usage = lvk::BufferUsageBits_Index,
+		.usage = lvk::BufferUsageBits_Index | lvk::BufferUsageBits_Storage,
 		.storage = lvk::StorageType_Device,
 		.size = sizeof(uint32_t) * indices.size(),
 		.data = indices.data(),
 		.debugName = "Buffer: index"
 		});
 
-	// Depth Texture
-	lvk::Holder<lvk::TextureHandle> depthTexture = ctx->createTexture({
-		.type = lvk::TextureType_2D,
-		.format = lvk::Format_Z_F32,
-		.dimensions = {(uint32_t)width, (uint32_t)height},
-		.usage = lvk::TextureUsageBits_Attachment,
-		.debugName = "Depth buffer"
+	// Meshlets
+	const MeshletData meshlets = buildMeshlets(&verts[0].position.x, sizeof(Vertex), verts.size(), indices);
+	const std::vector<uint32_t> meshletIndices = getMeshletIndices(meshlets);
+	const uint32_t numMeshlets = (uint32_t)meshlets.meshlets.size();
+	{
+		const MeshletStats stats = getMeshletStats(meshlets, verts.size());
+		printf("[02-Model] %u meshlets, %u triangles: vertex fill %.1f%%, triangle fill %.1f%%, vertex duplication %.2fx, %u cone-cullable\n",
+			stats.numMeshlets, stats.numTriangles, stats.vertexFill * 100.0f, stats.triangleFill * 100.0f, stats.vertexDuplication, stats.numConeCullable);
+	}
+
+	lvk::Holder<lvk::BufferHandle> meshletBuffer = ctx->createBuffer({
+		.usage = lvk::BufferUsageBits_Storage,
+		.storage = lvk::StorageType_Device,
+		.size = sizeof(Meshlet) * numMeshlets,
+		.data = meshlets.meshlets.data(),
+		.debugName = "Buffer: meshlets"
+		});
+	lvk::Holder<lvk::BufferHandle> meshletBoundsBuffer = ctx->createBuffer({
+		.usage = lvk::BufferUsageBits_Storage,
+		.storage = lvk::StorageType_Device,
+		.size = sizeof(MeshletBounds) * numMeshlets,
+		.data = meshlets.bounds.data(),
+		.debugName = "Buffer: meshlet bounds"
+		});
+	lvk::Holder<lvk::BufferHandle> meshletIndexBuffer = ctx->createBuffer({
+		.usage = lvk::BufferUsageBits_Index,
+		.storage = lvk::StorageType_Device,
+		.size = sizeof(uint32_t) * meshletIndices.size(),
+		.data = meshletIndices.data(),
+		.debugName = "Buffer: meshlet index"
+		});
+	// VkDrawIndexedIndirectCommand for every meshlet, written by meshlet_cull.comp
+	lvk::Holder<lvk::BufferHandle> drawCommandsBuffer = ctx->createBuffer({
+		.usage = lvk::BufferUsageBits_Storage | lvk::BufferUsageBits_Indirect,
+		.storage = lvk::StorageType_Device,
+		.size = sizeof(uint32_t) * 5 * numMeshlets,
+		.debugName = "Buffer: meshlet draw commands"
+		});
+	lvk::Holder<lvk::BufferHandle> drawCountBuffer = ctx->createBuffer({
+		.usage = lvk::BufferUsageBits_Storage | lvk::BufferUsageBits_Indirect,
+		.storage = lvk::StorageType_Device,
+		.size = sizeof(uint32_t),
+		.debugName = "Buffer: meshlet draw count"
+		});
+
+	// Matches `CullData` in meshlet_cull.comp
+	struct MeshletCullData
+	{
+		glm::vec4 planes[6];
+		glm::vec4 cameraPos;
+		uint32_t numMeshlets;
+		uint32_t enableCulling;
+	};
+
+	lvk::Holder<lvk::BufferHandle> cullDataBuffer = ctx->createBuffer({
+		.usage = lvk::BufferUsageBits_Storage,
+		.storage = lvk::StorageType_Device,
+		.size = sizeof(MeshletCullData),
+		.debugName = "Buffer: meshlet cull data"
 		});
 
+	// Render graph: owns the depth buffer and recreates it when the framebuffer is resized
+	RenderGraph renderGraph(*ctx);
+
 	// Attribute pointer
 	const lvk::VertexInput vdesc = {
 		.attributes = { 
@@ -80,100 +184,251 @@ int main()
 		.inputBindings = { {.stride = sizeof(Vertex) } }
 	};
 
+	PipelineLibrary pipelines(*ctx);
+
 	// Shaders
-	lvk::Holder<lvk::ShaderModuleHandle> vert = loadShaderModule(ctx, std::filesystem::absolute("../../../shaders/02-Model/main.vert"));
-	lvk::Holder<lvk::ShaderModuleHandle> frag = loadShaderModule(ctx, std::filesystem::absolute("../../../shaders/02-Model/main.frag"));
+	const std::vector<lvk::ShaderModuleHandle> shaders = pipelines.loadShaderModules({
+		std::filesystem::absolute("../../../shaders/02-Model/main.vert"),
+		std::filesystem::absolute("../../../shaders/02-Model/main.frag"),
+		std::filesystem::absolute("../../../shaders/02-Model/wireframe.vert"),
+		std::filesystem::absolute("../../../shaders/02-Model/meshlet_cull.comp"),
+		});
+	const lvk::ShaderModuleHandle vert = shaders[0];
+	const lvk::ShaderModuleHandle frag = shaders[1];
+	const lvk::ShaderModuleHandle vertWireframeOverlay = shaders[2];
+	const lvk::ShaderModuleHandle compMeshletCull = shaders[3];
 
 	// Render piplines
 	// Soild pipeline
-	lvk::Holder<lvk::RenderPipelineHandle> pipelineSolid = ctx->createRenderPipeline({
+	const lvk::RenderPipelineHandle pipelineSolid = pipelines.getRenderPipeline({
 			.vertexInput = vdesc,
 			.smVert = vert,
 			.smFrag = frag,
-			.color = { {.format = ctx->getSwapchainFormat() } },
-			.depthFormat = ctx->getFormat(depthTexture),
+			.color = { {.format = colorFormat } },
+			.depthFormat = depthFormat,
 			.cullMode = lvk::CullMode_Back
 		});
 
 	const uint32_t isWireframe = 1;
 
 	// Wireframe pipeline
-	lvk::Holder<lvk::RenderPipelineHandle> pipelineWireframe = ctx->createRenderPipeline({
+	const lvk::RenderPipelineHandle pipelineWireframe = pipelines.getRenderPipeline({
 			  .vertexInput = vdesc,
 			  .smVert = vert,
 			  .smFrag = frag,
 			  .specInfo = {.entries = { {.constantId = 0, .size = sizeof(uint32_t) } }, .data = &isWireframe, .dataSize = sizeof(isWireframe) },
-			  .color = { {.format = ctx->getSwapchainFormat() } },
-			  .depthFormat = ctx->getFormat(depthTexture),
+			  .color = { {.format = colorFormat } },
+			  .depthFormat = depthFormat,
 			  .cullMode = lvk::CullMode_Back,
 			  .polygonMode = lvk::PolygonMode_Line,
 		});
 
+	const uint32_t isWireframeOverlay = 1;
+
+	// Single-pass wireframe pipeline: no vertex input, vertices are fetched by the shader
+	const lvk::RenderPipelineHandle pipelineWireframeOverlay = pipelines.getRenderPipeline({
+			.smVert = vertWireframeOverlay,
+			.smFrag = frag,
+			.specInfo = {.entries = { {.constantId = 1, .size = sizeof(uint32_t) } }, .data = &isWireframeOverlay, .dataSize = sizeof(isWireframeOverlay) },
+			.color = { {.format = colorFormat } },
+			.depthFormat = depthFormat,
+			.cullMode = lvk::CullMode_Back,
+		});
+
 	LVK_ASSERT(pipelineSolid.valid());
 	LVK_ASSERT(pipelineWireframe.valid());
+	LVK_ASSERT(pipelineWireframeOverlay.valid());
 
-	while (!glfwWindowShouldClose(window))
-	{
-		glfwPollEvents();
-		int width, height;
-		glfwGetFramebufferSize(window, &width, &height);
-		if (!width || !height)
-		{
-			continue;
-		}
+	lvk::Holder<lvk::ComputePipelineHandle> pipelineMeshletCull = ctx->createComputePipeline({ .smComp = compMeshletCull, .debugName = "Pipeline: meshlet culling" });
 
+	LVK_ASSERT(pipelineMeshletCull.valid());
+
+	uint32_t renderMode = eRenderMode_SinglePassWireframe;
+
+	auto renderFrame = [&](lvk::ICommandBuffer& buf, lvk::TextureHandle colorTarget, int width, int height, double time) {
 		const float ratio = width / (float)height;
 
 		const glm::mat4 m = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1, 0, 0));
-		const glm::mat4 v = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, -1.5f)), (float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 v = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, -1.5f)), (float)time, glm::vec3(0.0f, 1.0f, 0.0f));
 		const glm::mat4 p = glm::perspective(45.0f, ratio, 0.1f, 1000.0f);
 
-		// Clear color
-		const lvk::RenderPass renderPass = {
-			.color = {{.loadOp = lvk::LoadOp_Clear, .clearColor = { 1.0f, 1.0f, 1.0f, 1.0f }}},
-			.depth = {.loadOp = lvk::LoadOp_Clear, .clearDepth = 1.0f}
-		};
-
-		const lvk::Framebuffer framebuffer = {
-			.color = { { .texture = ctx->getCurrentSwapchainTexture() } },
-			.depthStencil = { .texture = depthTexture }
-		};
-
 		// Perframe data
 		const struct PerFrameData
 		{
 			glm::mat4 mvp;
 			uint32_t textureId;
+			uint64_t vertices;
+			uint64_t indices;
 		} pc = {
 			.mvp = p * v * m,
-			.textureId = texture.index()
+			.textureId = texture.index(),
+			.vertices = ctx->gpuAddress(vertexBuffer),
+			.indices = ctx->gpuAddress(indexBuffer),
 		};
 
-		lvk::ICommandBuffer& buf = ctx->acquireCommandBuffer();
+		if (renderMode == eRenderMode_Meshlets)
 		{
-			buf.cmdBeginRendering(renderPass, framebuffer);
-			buf.cmdPushDebugGroupLabel("Mesh", 0xff0000ff);
+			// in object space, so the meshlet bounds need no transformation
+			MeshletCullData cullData = {
+				.cameraPos = glm::inverse(v * m) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+				.numMeshlets = numMeshlets,
+				.enableCulling = 1,
+			};
+			getFrustumPlanes(pc.mvp, cullData.planes);
+
+			const struct
 			{
-				buf.cmdBindVertexBuffer(0, vertexBuffer);
-				buf.cmdBindIndexBuffer(indexBuffer, lvk::IndexFormat_UI32);
-				buf.cmdBindRenderPipeline(pipelineSolid);
+				uint64_t cullData;
+				uint64_t meshlets;
+				uint64_t bounds;
+				uint64_t drawCommands;
+				uint64_t drawCount;
+			} cullPc = {
+				.cullData = ctx->gpuAddress(cullDataBuffer),
+				.meshlets = ctx->gpuAddress(meshletBuffer),
+				.bounds = ctx->gpuAddress(meshletBoundsBuffer),
+				.drawCommands = ctx->gpuAddress(drawCommandsBuffer),
+				.drawCount = ctx->gpuAddress(drawCountBuffer),
+			};
+
+			buf.cmdUpdateBuffer(cullDataBuffer, cullData);
+			buf.cmdUpdateBuffer(drawCountBuffer, 0u);
+			buf.cmdPushDebugGroupLabel("Meshlet culling", 0xff00ff00);
+			buf.cmdBindComputePipeline(pipelineMeshletCull);
+			buf.cmdPushConstants(cullPc);
+			buf.cmdDispatchThreadGroups({ .width = (numMeshlets + 63) / 64 }, { .buffers = { lvk::BufferHandle(cullDataBuffer), lvk::BufferHandle(drawCountBuffer) } });
+			buf.cmdPopDebugGroupLabel();
+		}
+
+		renderGraph.beginFrame(width, height);
+
+		const RenderGraphResource color = renderGraph.importTexture("Color", colorTarget);
+		const RenderGraphResource depth = renderGraph.createTexture("Depth buffer", { .format = depthFormat });
+
+		renderGraph.markOutput(color);
+
+		renderGraph.addPass({
+			.name = "Mesh",
+			.color = { {.resource = color, .loadOp = lvk::LoadOp_Clear, .clearColor = { 1.0f, 1.0f, 1.0f, 1.0f } } },
+			.depth = {.resource = depth, .loadOp = lvk::LoadOp_Clear, .storeOp = lvk::StoreOp_DontCare, .clearDepth = 1.0f },
+			.readBuffers = renderMode == eRenderMode_Meshlets ? std::vector<lvk::BufferHandle>{ drawCommandsBuffer, drawCountBuffer } : std::vector<lvk::BufferHandle>{},
+			.execute = [&](lvk::ICommandBuffer& buf, const lvk::Framebuffer&) {
+				buf.cmdPushDebugGroupLabel("Mesh", 0xff0000ff);
 				buf.cmdBindDepthState({ .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true });
 				buf.cmdPushConstants(pc);
-				buf.cmdDrawIndexed(indices.size());
-				buf.cmdBindRenderPipeline(pipelineWireframe);
-				buf.cmdSetDepthBiasEnable(true);
-				buf.cmdSetDepthBias(0.0f, -1.0f, 0.0f);
-				buf.cmdDrawIndexed(indices.size());
+				if (renderMode == eRenderMode_SinglePassWireframe)
+				{
+					buf.cmdBindRenderPipeline(pipelineWireframeOverlay);
+					buf.cmdDraw(indices.size());
+				}
+				else if (renderMode == eRenderMode_Meshlets)
+				{
+					buf.cmdBindVertexBuffer(0, vertexBuffer);
+					buf.cmdBindIndexBuffer(meshletIndexBuffer, lvk::IndexFormat_UI32);
+					buf.cmdBindRenderPipeline(pipelineSolid);
+					buf.cmdDrawIndexedIndirectCount(drawCommandsBuffer, 0, drawCountBuffer, 0, numMeshlets, sizeof(uint32_t) * 5);
+				}
+				else
+				{
+					buf.cmdBindVertexBuffer(0, vertexBuffer);
+					buf.cmdBindIndexBuffer(indexBuffer, lvk::IndexFormat_UI32);
+					buf.cmdBindRenderPipeline(pipelineSolid);
+					buf.cmdDrawIndexed(indices.size());
+					if (renderMode == eRenderMode_TwoPassWireframe)
+					{
+						buf.cmdBindRenderPipeline(pipelineWireframe);
+						buf.cmdSetDepthBiasEnable(true);
+						buf.cmdSetDepthBias(0.0f, -1.0f, 0.0f);
+						buf.cmdDrawIndexed(indices.size());
+					}
+				}
+				buf.cmdPopDebugGroupLabel();
+			},
+			});
+
+		renderGraph.compile();
+		renderGraph.execute(buf);
+	};
+
+	if (headless.enabled)
+	{
+		const double setupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+
+		// Same frames in every render mode, each mode writes its own image
+		HeadlessStats stats[eRenderMode_Count];
+
+		for (renderMode = 0; renderMode != eRenderMode_Count; renderMode++)
+		{
+			HeadlessOptions opts = headless;
+			if (!opts.outputImage.empty())
+				opts.outputImage = std::filesystem::path(opts.outputImage).replace_extension().string() + "_" + std::to_string(renderMode) + ".png";
+
+			stats[renderMode] = runHeadless(*ctx, opts, [&](lvk::ICommandBuffer& buf, lvk::TextureHandle colorTarget, uint32_t w, uint32_t h, double time) {
+				renderFrame(buf, colorTarget, (int)w, (int)h, time);
+				});
+			printHeadlessStats((std::string("02-Model, ") + getRenderModeName(renderMode)).c_str(), stats[renderMode]);
+		}
+
+		printf("[02-Model] time to first frame: %.1f ms (%s pipeline cache)\n", setupMs + stats[0].firstFrameMs, pipelineCacheState);
+		{
+			// the camera of the first frame
+			const glm::mat4 m = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1, 0, 0));
+			const glm::mat4 v = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, -1.5f));
+			const glm::mat4 p = glm::perspective(45.0f, headless.width / (float)headless.height, 0.1f, 1000.0f);
+			const MeshletCullStats cull = cullMeshlets(meshlets, p * v * m, glm::vec3(glm::inverse(v * m) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+			printf("[02-Model] meshlet culling, first frame: %u visible (%u triangles), %u frustum culled, %u cone culled\n", cull.numVisible,
+				cull.numVisibleTriangles, cull.numFrustumCulled, cull.numConeCulled);
+		}
+		printf("[02-Model] single-pass vs two-pass wireframe: avg %.3f ms vs %.3f ms, p95 %.3f ms vs %.3f ms\n",
+			stats[eRenderMode_SinglePassWireframe].avgMs, stats[eRenderMode_TwoPassWireframe].avgMs,
+			stats[eRenderMode_SinglePassWireframe].p95Ms, stats[eRenderMode_TwoPassWireframe].p95Ms);
+	}
+	else
+	{
+		glfwSetWindowUserPointer(window, &renderMode);
+		glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int, int action, int) {
+			if (key == GLFW_KEY_M && action == GLFW_PRESS)
+			{
+				uint32_t& mode = *static_cast<uint32_t*>(glfwGetWindowUserPointer(window));
+				mode = (mode + 1) % eRenderMode_Count;
+				LLOGL("Render mode: %s\n", getRenderModeName(mode));
 			}
-			buf.cmdPopDebugGroupLabel();
-			buf.cmdEndRendering();
+			});
+	}
+
+	bool firstFrame = true;
+
+	while (window && !glfwWindowShouldClose(window))
+	{
+		glfwPollEvents();
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		if (!width || !height)
+		{
+			continue;
 		}
 
-		ctx->submit(buf, ctx->getCurrentSwapchainTexture());
+		lvk::ICommandBuffer& buf = ctx->acquireCommandBuffer();
+		renderFrame(buf, ctx->getCurrentSwapchainTexture(), width, height, glfwGetTime());
+		const lvk::SubmitHandle submitHandle = ctx->submit(buf, ctx->getCurrentSwapchainTexture());
+
+		if (firstFrame)
+		{
+			ctx->wait(submitHandle);
+			printf("[02-Model] time to first frame: %.1f ms (%s pipeline cache)\n",
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count(), pipelineCacheState);
+			firstFrame = false;
+		}
 	}
 
+	pipelines.printStats("02-Model");
+	savePipelineCacheData(*ctx);
+	pipelines.clear();
 
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 	return 0;
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <string.h>
+#include <memory>
 #include <vector>
 
 #include <glm/glm.hpp>
 
+#include "image_pool.h"
+
 enum eBitmapType
 {
 	eBitmapType_2D,
@@ -17,7 +20,7 @@ enum eBitmapFormat
 	eBitmapFormat_Float,
 };
 
-/// R/RG/RGB/RGBA bitmaps
+/// R/RG/RGB/RGBA bitmaps. The data comes from the image pool (see image_pool.h), or is a view made with wrap().
 struct Bitmap
 {
 	Bitmap() = default;
@@ -37,13 +40,25 @@ struct Bitmap
 		initGetSetFuncs();
 		memcpy(data_.data(), ptr, data_.size());
 	}
+	/// No copy of `ptr`; `owner` is released with the last view, e.g. std::shared_ptr<void>(ptr, stbi_image_free)
+	static Bitmap wrap(int w, int h, int comp, eBitmapFormat fmt, void* ptr, std::shared_ptr<void> owner = {})
+	{
+		Bitmap b;
+		b.w_ = w;
+		b.h_ = h;
+		b.comp_ = comp;
+		b.fmt_ = fmt;
+		b.data_ = ImageBuffer::wrap(ptr, size_t(w) * h * comp * getBytesPerComponent(fmt), std::move(owner));
+		b.initGetSetFuncs();
+		return b;
+	}
 	int w_ = 0;
 	int h_ = 0;
 	int d_ = 1;
 	int comp_ = 3;
 	eBitmapFormat fmt_ = eBitmapFormat_UnsignedByte;
 	eBitmapType type_ = eBitmapType_2D;
-	std::vector<uint8_t> data_;
+	ImageBuffer data_;
 
 	static int getBytesPerComponent(eBitmapFormat fmt)
 	{
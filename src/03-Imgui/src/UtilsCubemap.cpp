@@ -1,11 +1,22 @@
 #include "UtilsMath.h"
 #include "UtilsCubemap.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
 #include "stb_image_resize2.h"
+#include "job_system.h"
+#include "image_pool.h"
+#include "low_discrepancy.h"
+
+// SSE2 is part of every x86-64 target, so it needs no compiler flags
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define UTILS_CUBEMAP_SSE2 1
+#endif
 
 using glm::vec2;
 using glm::vec3;
@@ -32,6 +43,30 @@ vec2 hammersley2d(uint32_t i, uint32_t N)
     return vec2(float(i)/float(N), radicalInverse_VdC(i));
 }
 
+// The texel and the direction of every sample of a sequence over a w x h equirectangular map. They are the same for every
+// output texel, so the convolutions compute them once per call. The arrays come from the scratch arena of the caller.
+struct EquirectSamples
+{
+	const uint32_t* index = nullptr;
+	const vec3* dir = nullptr;
+};
+
+static EquirectSamples getEquirectSamples(const SampleSequence& seq, int w, int h)
+{
+	uint32_t* index = getScratchArena().allocate<uint32_t>(seq.size());
+	vec3* dir = getScratchArena().allocate<vec3>(seq.size());
+
+	for (uint32_t i = 0; i != seq.size(); i++)
+	{
+		const int x1 = int(floor(seq.u[i] * w));
+		const int y1 = int(floor(seq.v[i] * h));
+		index[i] = uint32_t(y1 * w + x1);
+		dir[i] = Math::equirectToDirection(vec2(float(x1) / float(w), float(y1) / float(h)));
+	}
+
+	return { index, dir };
+}
+
 void convolveLambertian(const vec3* data, int srcW, int srcH, int dstW, int dstH, vec3* output, int numMonteCarloSamples)
 {
 	// only equirectangular maps are supported
@@ -39,44 +74,43 @@ void convolveLambertian(const vec3* data, int srcW, int srcH, int dstW, int dstH
 
 	if (srcW != 2 * srcH) return;
 
-	std::vector<vec3> tmp(dstW * dstH);
+	// the downsampled source lives only for this call; the arena keeps its memory for the next one
+	ScratchArena::Scope scope(getScratchArena());
+	vec3* tmp = getScratchArena().allocate<vec3>(size_t(dstW) * dstH);
 
 	stbir_resize(
-      reinterpret_cast<const float*>(data), srcW, srcH, 0, reinterpret_cast<float*>(tmp.data()), dstW, dstH, 0, STBIR_RGB, STBIR_TYPE_FLOAT,
+      reinterpret_cast<const float*>(data), srcW, srcH, 0, reinterpret_cast<float*>(tmp), dstW, dstH, 0, STBIR_RGB, STBIR_TYPE_FLOAT,
       STBIR_EDGE_WRAP, STBIR_FILTER_CUBICBSPLINE);
 
-	const vec3* scratch = tmp.data();
+	const vec3* scratch = tmp;
 	srcW = dstW;
 	srcH = dstH;
 
-	for (int y = 0; y != dstH; y++)
+	// the same samples for every output texel
+	const SampleSequence& seq = *getSampleSequence(eSequence_Hammersley, (uint32_t)std::max(numMonteCarloSamples, 0));
+	const EquirectSamples samples = getEquirectSamples(seq, srcW, srcH);
+
+	// one job per few rows, every output texel is independent
+	getJobSystem().parallelFor((uint32_t)dstH, [&](uint32_t row)
 	{
-		printf("Line %i...\n", y);
-		const float theta1 = float(y) / float(dstH) * Math::PI;
+		const int y = (int)row;
 		for (int x = 0; x != dstW; x++)
 		{
-			const float phi1 = float(x) / float(dstW) * Math::TWOPI;
-			const vec3 V1 = vec3(sin(theta1) * cos(phi1), sin(theta1) * sin(phi1), cos(theta1));
+			const vec3 V1 = Math::equirectToDirection(vec2(float(x) / float(dstW), float(y) / float(dstH)));
 			vec3 color = vec3(0.0f);
 			float weight = 0.0f;
 			for (int i = 0; i != numMonteCarloSamples; i++)
 			{
-				const vec2 h = hammersley2d(i, numMonteCarloSamples);
-				const int x1 = int(floor(h.x * srcW));
-				const int y1 = int(floor(h.y * srcH));
-				const float theta2 = float(y1) / float(srcH) * Math::PI;
-				const float phi2 = float(x1) / float(srcW) * Math::TWOPI;
-				const vec3 V2 = vec3(sin(theta2) * cos(phi2), sin(theta2) * sin(phi2), cos(theta2));
-				const float D = std::max(0.0f, glm::dot(V1, V2));
+				const float D = std::max(0.0f, glm::dot(V1, samples.dir[i]));
 				if (D > 0.01f)
 				{
-					color += scratch[y1 * srcW + x1] * D;
+					color += scratch[samples.index[i]] * D;
 					weight += D;
 				}
 			}
 			output[y * dstW + x] = color / weight;
 		}
-	}
+	});
 }
 
 void convolveGGX(const vec3* data, int srcW, int srcH, int dstW, int dstH, vec3* output, int numMonteCarloSamples)
@@ -87,58 +121,279 @@ void convolveGGX(const vec3* data, int srcW, int srcH, int dstW, int dstH, vec3*
   if (srcW != 2 * srcH)
     return;
 
-  std::vector<vec3> tmp(dstW * dstH);
+  ScratchArena::Scope scope(getScratchArena());
+  vec3* tmp = getScratchArena().allocate<vec3>(size_t(dstW) * dstH);
 
   stbir_resize(
-      reinterpret_cast<const float*>(data), srcW, srcH, 0, reinterpret_cast<float*>(tmp.data()), dstW, dstH, 0, STBIR_RGB, STBIR_TYPE_FLOAT,
+      reinterpret_cast<const float*>(data), srcW, srcH, 0, reinterpret_cast<float*>(tmp), dstW, dstH, 0, STBIR_RGB, STBIR_TYPE_FLOAT,
       STBIR_EDGE_WRAP, STBIR_FILTER_CUBICBSPLINE);
 
-  const vec3* scratch = tmp.data();
+  const vec3* scratch = tmp;
   srcW                = dstW;
   srcH                = dstH;
 
-  for (int y = 0; y != dstH; y++) {
-    printf("Line %i...\n", y);
-    const float theta1 = float(y) / float(dstH) * Math::PI;
+  const SampleSequence& seq      = *getSampleSequence(eSequence_Hammersley, (uint32_t)std::max(numMonteCarloSamples, 0));
+  const EquirectSamples samples  = getEquirectSamples(seq, srcW, srcH);
+
+  getJobSystem().parallelFor((uint32_t)dstH, [&](uint32_t row) {
+    const int y = (int)row;
     for (int x = 0; x != dstW; x++) {
-      const float phi1 = float(x) / float(dstW) * Math::TWOPI;
-      const vec3 V1    = vec3(sin(theta1) * cos(phi1), sin(theta1) * sin(phi1), cos(theta1));
-      vec3 color       = vec3(0.0f);
+      const vec3 V1 = Math::equirectToDirection(vec2(float(x) / float(dstW), float(y) / float(dstH)));
+      vec3 color    = vec3(0.0f);
       float weight     = 0.0f;
       for (int i = 0; i != numMonteCarloSamples; i++) {
-        const vec2 h       = hammersley2d(i, numMonteCarloSamples);
-        const int x1       = int(floor(h.x * srcW));
-        const int y1       = int(floor(h.y * srcH));
-
-
-        const float theta2 = float(y1) / float(srcH) * Math::PI;
-        const float phi2   = float(x1) / float(srcW) * Math::TWOPI;
-        const vec3 V2      = vec3(sin(theta2) * cos(phi2), sin(theta2) * sin(phi2), cos(theta2));
-        const float D      = std::max(0.0f, glm::dot(V1, V2));
+        const float D = std::max(0.0f, glm::dot(V1, samples.dir[i]));
         if (D > 0.01f) {
-          color += scratch[y1 * srcW + x1] * D;
+          color += scratch[samples.index[i]] * D;
           weight += D;
         }
       }
       output[y * dstW + x] = color / weight;
     }
-  }
+  });
+}
+
+static float getLuminance(const vec3& c)
+{
+	return glm::dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// texel centers; theta is measured from +Z, as in the convolutions above
+static vec3 getEquirectDirection(int x, int y, int w, int h)
+{
+	return Math::equirectToDirection(vec2((float(x) + 0.5f) / float(w), (float(y) + 0.5f) / float(h)));
+}
+
+EnvironmentCdf buildEnvironmentCdf(const vec3* data, int w, int h, float uniformFraction)
+{
+	EnvironmentCdf cdf = { .w = w, .h = h };
+	cdf.marginal.resize(h + 1);
+	cdf.conditional.resize(size_t(h) * (w + 1));
+
+	// weighted luminance of every row; sin(theta) is the solid angle of its texels up to a constant
+	std::vector<double> rowLum(h);
+	std::vector<double> rowSin(h);
+	getJobSystem().parallelFor((uint32_t)h, [&](uint32_t y) {
+		const double sinTheta = sin((double(y) + 0.5) / double(h) * M_PI);
+		double sum = 0.0;
+		for (int x = 0; x != w; x++)
+			sum += getLuminance(data[size_t(y) * w + x]);
+		rowLum[y] = sum * sinTheta;
+		rowSin[y] = double(w) * sinTheta;
+	});
+
+	double totalLum = 0.0;
+	double totalSin = 0.0;
+	for (int y = 0; y != h; y++)
+	{
+		totalLum += rowLum[y];
+		totalSin += rowSin[y];
+	}
+
+	// a black map is sampled by solid angle alone
+	const double f = totalLum > 0.0 ? std::clamp(double(uniformFraction), 0.0, 1.0) : 1.0;
+	// the probability of texel (x, y) is (a * luminance + b) * sin(theta); all of them add up to 1
+	const double a = totalLum > 0.0 ? (1.0 - f) / totalLum : 0.0;
+	const double b = f / totalSin;
+
+	// one texel covers (2pi / w) * (pi / h) * sin(theta) steradians, so the sin(theta) cancels out of the density
+	const double texelsPerSteradian = double(w) * double(h) / (2.0 * M_PI * M_PI);
+	cdf.lumScale = float(a * texelsPerSteradian);
+	cdf.uniformScale = float(b * texelsPerSteradian);
+
+	std::vector<double> rowMass(h);
+	getJobSystem().parallelFor((uint32_t)h, [&](uint32_t y) {
+		const double sinTheta = sin((double(y) + 0.5) / double(h) * M_PI);
+		float* cond = &cdf.conditional[size_t(y) * (w + 1)];
+		double sum = 0.0;
+		cond[0] = 0.0f;
+		for (int x = 0; x != w; x++)
+		{
+			sum += (a * getLuminance(data[size_t(y) * w + x]) + b) * sinTheta;
+			cond[x + 1] = float(sum);
+		}
+		// normalized per row, so rounding never leaves a gap at the end
+		for (int x = 1; x <= w; x++)
+			cond[x] = sum > 0.0 ? float(cond[x] / sum) : float(x) / float(w);
+		cond[w] = 1.0f;
+		rowMass[y] = sum;
+	});
+
+	double sum = 0.0;
+	cdf.marginal[0] = 0.0f;
+	for (int y = 0; y != h; y++)
+	{
+		sum += rowMass[y];
+		cdf.marginal[y + 1] = float(sum);
+	}
+	for (int y = 1; y <= h; y++)
+		cdf.marginal[y] = float(cdf.marginal[y] / sum);
+	cdf.marginal[h] = 1.0f;
+
+	return cdf;
+}
+
+// the interval [cdf[i], cdf[i + 1]) which holds u; empty intervals are never picked
+static int sampleCdf(const float* cdf, int count, float u)
+{
+	const int i = int(std::upper_bound(cdf, cdf + count + 1, u) - cdf) - 1;
+	return std::clamp(i, 0, count - 1);
+}
+
+void convolveLambertianImportance(const vec3* data, const EnvironmentCdf& cdf, int dstW, int dstH, vec3* output, int numSamples)
+{
+	if (!cdf.w || !cdf.h || numSamples <= 0)
+		return;
+
+	struct Sample
+	{
+		vec3 dir;
+		// radiance divided by the probability density of its direction
+		vec3 value;
+	};
+
+	ScratchArena::Scope scope(getScratchArena());
+	Sample* samples = getScratchArena().allocate<Sample>(numSamples);
+
+	const SampleSequence& seq = *getSampleSequence(eSequence_Hammersley, (uint32_t)numSamples);
+
+	for (int i = 0; i != numSamples; i++)
+	{
+		const vec2 u = seq[i];
+		const int y = sampleCdf(cdf.marginal.data(), cdf.h, u.x);
+		const int x = sampleCdf(&cdf.conditional[size_t(y) * (cdf.w + 1)], cdf.w, u.y);
+		const vec3 L = data[size_t(y) * cdf.w + x];
+		const float pdf = cdf.lumScale * getLuminance(L) + cdf.uniformScale;
+		samples[i] = { getEquirectDirection(x, y, cdf.w, cdf.h), pdf > 0.0f ? L / pdf : vec3(0.0f) };
+	}
+
+	// the integral of the cosine over the hemisphere is pi
+	const float scale = 1.0f / (float(numSamples) * Math::PI);
+
+	getJobSystem().parallelFor((uint32_t)dstH, [&](uint32_t row)
+	{
+		const int y = (int)row;
+		for (int x = 0; x != dstW; x++)
+		{
+			const vec3 V1 = Math::equirectToDirection(vec2(float(x) / float(dstW), float(y) / float(dstH)));
+			vec3 color = vec3(0.0f);
+			for (int i = 0; i != numSamples; i++)
+				color += samples[i].value * std::max(0.0f, glm::dot(V1, samples[i].dir));
+			output[y * dstW + x] = color * scale;
+		}
+	});
 }
 
 
 vec3 faceCoordsToXYZ(int i, int j, int faceID, int faceSize)
 {
-	const float A = 2.0f * float(i) / faceSize;
-	const float B = 2.0f * float(j) / faceSize;
+	return Math::cubeFaceToDirection(faceID, vec2(float(i), float(j)) / float(faceSize));
+}
+
+// The BRDF integral for one NdotV over the half vectors of one roughness, which are given as separate X and Z arrays
+static vec2 integrateBrdf(const float* hx, const float* hz, int numSamples, float NdotV, float k)
+{
+	const float vx = sqrt(1.0f - NdotV * NdotV);
+	const float vz = NdotV;
+	// G * VdotH / (NdotH * NdotV) with the view term and 1 / NdotV taken out of the loop
+	const float gv = 1.0f / (NdotV * (1.0f - k) + k);
+
+	float scale = 0.0f;
+	float bias = 0.0f;
+	int i = 0;
+
+#if defined(UTILS_CUBEMAP_SSE2)
+	// four samples at a time, the same math as the loop below
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 simdVx = _mm_set1_ps(vx);
+	const __m128 simdVz = _mm_set1_ps(vz);
+	const __m128 simdK = _mm_set1_ps(k);
+	const __m128 simdOneMinusK = _mm_set1_ps(1.0f - k);
+	const __m128 simdGv = _mm_set1_ps(gv);
+	__m128 sumScale = zero;
+	__m128 sumBias = zero;
+	for (; i + 4 <= numSamples; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(hx + i);
+		const __m128 z = _mm_loadu_ps(hz + i);
+		const __m128 VdotH = _mm_max_ps(_mm_add_ps(_mm_mul_ps(simdVx, x), _mm_mul_ps(simdVz, z)), zero);
+		const __m128 NdotL = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(_mm_add_ps(VdotH, VdotH), z), simdVz), zero);
+		const __m128 gl = _mm_div_ps(NdotL, _mm_add_ps(_mm_mul_ps(NdotL, simdOneMinusK), simdK));
+		const __m128 vis = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(simdGv, gl), VdotH), z);
+		const __m128 t = _mm_sub_ps(one, VdotH);
+		const __m128 t2 = _mm_mul_ps(t, t);
+		const __m128 fcVis = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t2, t2), t), vis);
+		sumScale = _mm_add_ps(sumScale, _mm_sub_ps(vis, fcVis));
+		sumBias = _mm_add_ps(sumBias, fcVis);
+	}
+	alignas(16) float lanes[8];
+	_mm_store_ps(lanes, sumScale);
+	_mm_store_ps(lanes + 4, sumBias);
+	scale = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	bias = (lanes[4] + lanes[5]) + (lanes[6] + lanes[7]);
+#endif
+
+	for (; i != numSamples; i++)
+	{
+		const float VdotH = std::max(vx * hx[i] + vz * hz[i], 0.0f);
+		const float NdotL = std::max(2.0f * VdotH * hz[i] - vz, 0.0f);
+		// 0 for directions under the horizon
+		const float gl = NdotL / (NdotL * (1.0f - k) + k);
+		const float vis = gv * gl * VdotH / hz[i];
+		const float t = 1.0f - VdotH;
+		const float fcVis = (t * t) * (t * t) * t * vis;
+		scale += vis - fcVis;
+		bias += fcVis;
+	}
+
+	return vec2(scale, bias) / float(numSamples);
+}
+
+std::vector<vec2> generateBrdfLut(int size, int numSamples)
+{
+	std::vector<vec2> lut(size_t(size) * size);
 
-	if (faceID == 0) return vec3(-1.0f, A - 1.0f, B - 1.0f);
-	if (faceID == 1) return vec3(A - 1.0f, -1.0f, 1.0f - B);
-	if (faceID == 2) return vec3(1.0f, A - 1.0f, 1.0f - B);
-	if (faceID == 3) return vec3(1.0f - A, 1.0f, 1.0f - B);
-	if (faceID == 4) return vec3(B - 1.0f, A - 1.0f, 1.0f);
-	if (faceID == 5) return vec3(1.0f - B, A - 1.0f, -1.0f);
+	if (size <= 0 || numSamples <= 0)
+		return lut;
 
-	return vec3();
+	// the azimuths of the samples are the same for every roughness
+	const SampleSequence& seq = *getSampleSequence(eSequence_Hammersley, (uint32_t)numSamples);
+	const std::vector<float>& xi = seq.v;
+	std::vector<float> cosPhi(numSamples);
+	for (int i = 0; i != numSamples; i++)
+		cosPhi[i] = Math::fastCos(Math::TWOPI * seq.u[i]);
+
+	getJobSystem().parallelFor((uint32_t)size, [&](uint32_t row)
+	{
+		const float roughness = (float(row) + 0.5f) / float(size);
+		const float a = roughness * roughness;
+		// Schlick-GGX geometry term for image based lighting
+		const float k = a / 2.0f;
+
+		// GGX importance sampled half vectors around N = +Z; V lies in the XZ plane, so the Y of H never matters
+		ScratchArena::Scope scope(getScratchArena());
+		float* hx = getScratchArena().allocate<float>(numSamples);
+		float* hz = getScratchArena().allocate<float>(numSamples);
+		for (int i = 0; i != numSamples; i++)
+		{
+			const float cosTheta = sqrt((1.0f - xi[i]) / (1.0f + (a * a - 1.0f) * xi[i]));
+			const float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+			hx[i] = sinTheta * cosPhi[i];
+			hz[i] = cosTheta;
+		}
+
+		for (int x = 0; x != size; x++)
+			lut[size_t(row) * size + x] = integrateBrdf(hx, hz, numSamples, (float(x) + 0.5f) / float(size), k);
+	});
+
+	return lut;
+}
+
+// The vertical cross samples its equirectangular map half a turn around Z from the convolutions: u = 0 is at -X
+static vec3 getCrossDirection(const vec3& P)
+{
+	return vec3(-P.x, -P.y, P.z);
 }
 
 Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& b)
@@ -165,38 +420,64 @@ Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& b)
 	const int clampW = b.w_ - 1;
 	const int clampH = b.h_ - 1;
 
-	for (int face = 0; face != 6; face++)
+	// one column of one face per index
+	getJobSystem().parallelFor(uint32_t(6 * faceSize), [&](uint32_t column)
 	{
-		for (int i = 0; i != faceSize; i++)
+		const int face = int(column) / faceSize;
+		const int i = int(column) % faceSize;
+
+		// the source coordinates of the whole column first, four texels at a time
+		ScratchArena::Scope scope(getScratchArena());
+		float* srcU = getScratchArena().allocate<float>(faceSize);
+		float* srcV = getScratchArena().allocate<float>(faceSize);
+		int j = 0;
+#if defined(UTILS_MATH_SSE2)
+		for (; j + 4 <= faceSize; j += 4)
 		{
-			for (int j = 0; j != faceSize; j++)
+			alignas(16) float px[4], py[4], pz[4];
+			for (int k = 0; k != 4; k++)
 			{
-				const vec3 P = faceCoordsToXYZ(i, j, face, faceSize);
-				const float R = hypot(P.x, P.y);
-				const float theta = atan2(P.y, P.x);
-				const float phi = atan2(P.z, R);
-				//	float point source coordinates
-				const float Uf = float(2.0f * faceSize * (theta + M_PI) / M_PI);
-				const float Vf = float(2.0f * faceSize * (M_PI / 2.0f - phi) / M_PI);
-				// 4-samples for bilinear interpolation
-				const int U1 = clamp(int(floor(Uf)), 0, clampW);
-				const int V1 = clamp(int(floor(Vf)), 0, clampH);
-				const int U2 = clamp(U1 + 1, 0, clampW);
-				const int V2 = clamp(V1 + 1, 0, clampH);
-				// fractional part
-				const float s = Uf - U1;
-				const float t = Vf - V1;
-				// fetch 4-samples
-				const vec4 A = b.getPixel(U1, V1);
-				const vec4 B = b.getPixel(U2, V1);
-				const vec4 C = b.getPixel(U1, V2);
-				const vec4 D = b.getPixel(U2, V2);
-				// bilinear interpolation
-				const vec4 color = A * (1 - s) * (1 - t) + B * (s) * (1 - t) + C * (1 - s) * t + D * (s) * (t);
-				result.setPixel(i + kFaceOffsets[face].x, j + kFaceOffsets[face].y, color);
+				const vec3 P = getCrossDirection(faceCoordsToXYZ(i, j + k, face, faceSize));
+				px[k] = P.x;
+				py[k] = P.y;
+				pz[k] = P.z;
 			}
-		};
-	}
+			__m128 u, v;
+			Math::directionToEquirectx4(_mm_load_ps(px), _mm_load_ps(py), _mm_load_ps(pz), u, v);
+			_mm_storeu_ps(srcU + j, u);
+			_mm_storeu_ps(srcV + j, v);
+		}
+#endif
+		for (; j != faceSize; j++)
+		{
+			const vec2 uv = Math::directionToEquirect(getCrossDirection(faceCoordsToXYZ(i, j, face, faceSize)));
+			srcU[j] = uv.x;
+			srcV[j] = uv.y;
+		}
+
+		for (j = 0; j != faceSize; j++)
+		{
+			//	float point source coordinates
+			const float Uf = 4.0f * faceSize * srcU[j];
+			const float Vf = 2.0f * faceSize * srcV[j];
+			// 4-samples for bilinear interpolation
+			const int U1 = clamp(int(floor(Uf)), 0, clampW);
+			const int V1 = clamp(int(floor(Vf)), 0, clampH);
+			const int U2 = clamp(U1 + 1, 0, clampW);
+			const int V2 = clamp(V1 + 1, 0, clampH);
+			// fractional part
+			const float s = Uf - U1;
+			const float t = Vf - V1;
+			// fetch 4-samples
+			const vec4 A = b.getPixel(U1, V1);
+			const vec4 B = b.getPixel(U2, V1);
+			const vec4 C = b.getPixel(U1, V2);
+			const vec4 D = b.getPixel(U2, V2);
+			// bilinear interpolation
+			const vec4 color = A * (1 - s) * (1 - t) + B * (s) * (1 - t) + C * (1 - s) * t + D * (s) * (t);
+			result.setPixel(i + kFaceOffsets[face].x, j + kFaceOffsets[face].y, color);
+		}
+	});
 
 	return result;
 }
@@ -210,7 +491,6 @@ Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap& b)
   cubemap.type_ = eBitmapType_Cube;
 
   const uint8_t* src = b.data_.data();
-  uint8_t* dst       = cubemap.data_.data();
 
   /*
       ------
@@ -226,56 +506,222 @@ Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap& b)
 
   const int pixelSize = cubemap.comp_ * Bitmap::getBytesPerComponent(cubemap.fmt_);
 
-  for (int face = 0; face != 6; ++face) {
-    for (int j = 0; j != faceHeight; ++j) {
-      for (int i = 0; i != faceWidth; ++i) {
-        int x = 0;
-        int y = 0;
-
-        switch (face) {
-          // CUBE_MAP_POSITIVE_X
-        case 0:
-          x = 2 * faceWidth + i;
-          y = 1 * faceHeight + j;
-          break;
-
-          // CUBE_MAP_NEGATIVE_X
-        case 1:
-          x = i;
-          y = faceHeight + j;
-          break;
-
-          // CUBE_MAP_POSITIVE_Y
-        case 2:
-          x = 1 * faceWidth + i;
-          y = j;
-          break;
-
-          // CUBE_MAP_NEGATIVE_Y
-        case 3:
-          x = 1 * faceWidth + i;
-          y = 2 * faceHeight + j;
-          break;
-
-          // CUBE_MAP_POSITIVE_Z
-        case 4:
-          x = faceWidth + i;
-          y = faceHeight + j;
-          break;
-
-          // CUBE_MAP_NEGATIVE_Z
-        case 5:
-          x = 2 * faceWidth - (i + 1);
-          y = b.h_ - (j + 1);
-          break;
-        }
+  // one row of one face per index
+  getJobSystem().parallelFor(uint32_t(6 * faceHeight), [&](uint32_t row) {
+    const int face = int(row) / faceHeight;
+    const int j    = int(row) % faceHeight;
+    uint8_t* dst   = cubemap.data_.data() + size_t(row) * faceWidth * pixelSize;
+    for (int i = 0; i != faceWidth; ++i) {
+      int x = 0;
+      int y = 0;
+
+      switch (face) {
+        // CUBE_MAP_POSITIVE_X
+      case 0:
+        x = 2 * faceWidth + i;
+        y = 1 * faceHeight + j;
+        break;
+
+        // CUBE_MAP_NEGATIVE_X
+      case 1:
+        x = i;
+        y = faceHeight + j;
+        break;
+
+        // CUBE_MAP_POSITIVE_Y
+      case 2:
+        x = 1 * faceWidth + i;
+        y = j;
+        break;
+
+        // CUBE_MAP_NEGATIVE_Y
+      case 3:
+        x = 1 * faceWidth + i;
+        y = 2 * faceHeight + j;
+        break;
+
+        // CUBE_MAP_POSITIVE_Z
+      case 4:
+        x = faceWidth + i;
+        y = faceHeight + j;
+        break;
+
+        // CUBE_MAP_NEGATIVE_Z
+      case 5:
+        x = 2 * faceWidth - (i + 1);
+        y = b.h_ - (j + 1);
+        break;
+      }
 
-        memcpy(dst, src + (y * b.w_ + x) * pixelSize, pixelSize);
+      memcpy(dst, src + (y * b.w_ + x) * pixelSize, pixelSize);
 
-        dst += pixelSize;
-      }
+      dst += pixelSize;
     }
-  }
+  });
 
   return cubemap;
+}
+
+namespace
+{
+
+/// The inverse of the Vulkan cube face selection; `s` and `t` are in [-1, 1] on the face and outside of it for the neighbours
+vec3 cubeFaceToDirection(int face, float s, float t)
+{
+	switch (face)
+	{
+	case 0: return vec3(1.0f, -t, -s);
+	case 1: return vec3(-1.0f, -t, s);
+	case 2: return vec3(s, 1.0f, t);
+	case 3: return vec3(s, -1.0f, -t);
+	case 4: return vec3(s, -t, 1.0f);
+	case 5: return vec3(-s, -t, -1.0f);
+	}
+	return vec3();
+}
+
+/// Vulkan cube face selection
+ivec2 directionToCubeTexel(const vec3& dir, int faceSize, int* outFace)
+{
+	const vec3 a = glm::abs(dir);
+
+	int face = 0;
+	float sc = 0.0f;
+	float tc = 0.0f;
+	float ma = 1.0f;
+
+	if (a.x >= a.y && a.x >= a.z)
+	{
+		face = dir.x > 0.0f ? 0 : 1;
+		sc = dir.x > 0.0f ? -dir.z : dir.z;
+		tc = -dir.y;
+		ma = a.x;
+	}
+	else if (a.y >= a.z)
+	{
+		face = dir.y > 0.0f ? 2 : 3;
+		sc = dir.x;
+		tc = dir.y > 0.0f ? dir.z : -dir.z;
+		ma = a.y;
+	}
+	else
+	{
+		face = dir.z > 0.0f ? 4 : 5;
+		sc = dir.z > 0.0f ? dir.x : -dir.x;
+		tc = -dir.y;
+		ma = a.z;
+	}
+
+	*outFace = face;
+
+	const float u = 0.5f * (sc / ma + 1.0f);
+	const float v = 0.5f * (tc / ma + 1.0f);
+
+	return ivec2(clamp(int(u * faceSize), 0, faceSize - 1), clamp(int(v * faceSize), 0, faceSize - 1));
+}
+
+/// Faces are stacked vertically in cube Bitmaps; `x` and `y` may be outside of the face
+vec4 fetchCubeTexel(const Bitmap& cube, int face, int x, int y)
+{
+	const int size = cube.w_;
+
+	if (x < 0 || y < 0 || x >= size || y >= size)
+	{
+		const float s = 2.0f * (float(x) + 0.5f) / float(size) - 1.0f;
+		const float t = 2.0f * (float(y) + 0.5f) / float(size) - 1.0f;
+		const ivec2 p = directionToCubeTexel(cubeFaceToDirection(face, s, t), size, &face);
+		x = p.x;
+		y = p.y;
+	}
+
+	return cube.getPixel(x, face * size + y);
+}
+
+void downsampleCubeRows(const Bitmap& src, Bitmap& dst, int face, int firstRow, int lastRow)
+{
+	const float scale = float(src.w_) / float(dst.w_);
+
+	for (int y = firstRow; y != lastRow; y++)
+	{
+		// the center of the destination texel in source texels
+		const float cy = (float(y) + 0.5f) * scale;
+
+		for (int x = 0; x != dst.w_; x++)
+		{
+			const float cx = (float(x) + 0.5f) * scale;
+
+			vec4 sum(0.0f);
+			float weight = 0.0f;
+
+			for (int j = int(cy) - 2; j <= int(cy) + 1; j++)
+			{
+				const float wy = std::max(0.0f, 1.0f - std::abs(float(j) + 0.5f - cy) * 0.5f);
+				for (int i = int(cx) - 2; i <= int(cx) + 1; i++)
+				{
+					const float w = wy * std::max(0.0f, 1.0f - std::abs(float(i) + 0.5f - cx) * 0.5f);
+					if (w <= 0.0f)
+						continue;
+					sum += fetchCubeTexel(src, face, i, j) * w;
+					weight += w;
+				}
+			}
+
+			dst.setPixel(x, face * dst.w_ + y, sum / weight);
+		}
+	}
+}
+
+} // namespace
+
+std::vector<Bitmap> generateCubeMipChain(const Bitmap& cube, CubeMipChainStats* outStats)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<Bitmap> levels;
+
+	if (cube.type_ != eBitmapType_Cube || cube.d_ != 6 || cube.w_ != cube.h_)
+		return levels;
+
+	levels.push_back(cube);
+
+	while (levels.back().w_ > 1)
+	{
+		const Bitmap& src = levels.back();
+		const int size = std::max(1, src.w_ / 2);
+
+		Bitmap dst(size, size, 6, src.comp_, src.fmt_);
+		dst.type_ = eBitmapType_Cube;
+
+		// rows of all faces in one range, so the small levels still give every thread some work
+		getJobSystem().parallelFor(uint32_t(6 * size), [&](uint32_t row) {
+			downsampleCubeRows(src, dst, int(row) / size, int(row) % size, int(row) % size + 1);
+		});
+
+		levels.push_back(std::move(dst));
+	}
+
+	if (outStats)
+	{
+		*outStats = { .numLevels = (uint32_t)levels.size(), .baseBytes = levels.front().data_.size() };
+		for (const Bitmap& b : levels)
+			outStats->totalBytes += b.data_.size();
+		outStats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	return levels;
+}
+
+std::vector<uint8_t> packMipChain(const std::vector<Bitmap>& levels)
+{
+	size_t size = 0;
+	for (const Bitmap& b : levels)
+		size += b.data_.size();
+
+	std::vector<uint8_t> data;
+	data.reserve(size);
+
+	for (const Bitmap& b : levels)
+		data.insert(data.end(), b.data_.begin(), b.data_.end());
+
+	return data;
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 
+#include <vector>
+
 #include "Bitmap.h"
 
 Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& b);
@@ -11,5 +13,56 @@ inline Bitmap convertEquirectangularMapToCubeMapFaces(const Bitmap& b) {
 	return convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCross(b));
 }
 
+float radicalInverse_VdC(uint32_t bits);
+glm::vec2 hammersley2d(uint32_t i, uint32_t N);
+
 void convolveLambertian(const glm::vec3* data, int srcW, int srcH, int dstW, int dstH, glm::vec3* output, int numMonteCarloSamples);
-void convolveGGX(const glm::vec3* data, int srcW, int srcH, int dstW, int dstH, glm::vec3* output, int numMonteCarloSamples);
\ No newline at end of file
+void convolveGGX(const glm::vec3* data, int srcW, int srcH, int dstW, int dstH, glm::vec3* output, int numMonteCarloSamples);
+
+/// Importance sampling of an equirectangular map: texels are picked with a probability proportional to their luminance
+/// times their solid angle, mixed with `uniformFraction` of sampling by solid angle alone, so the dark parts of the sky
+/// are still reached. The marginal CDF picks a row, the conditional CDF of that row picks a texel; both are built once per
+/// map and serve every convolution of it.
+struct EnvironmentCdf
+{
+	int w = 0;
+	int h = 0;
+	/// h + 1 values from 0 to 1
+	std::vector<float> marginal;
+	/// w + 1 values from 0 to 1 for every row
+	std::vector<float> conditional;
+	/// The probability density of a texel per steradian is (lumScale * luminance + uniformScale)
+	float lumScale = 0.0f;
+	float uniformScale = 0.0f;
+};
+
+EnvironmentCdf buildEnvironmentCdf(const glm::vec3* data, int w, int h, float uniformFraction = 0.1f);
+
+/// The cosine-weighted average of the environment around every output direction, as convolveLambertian(), but estimated
+/// from `numSamples` texels of the full-resolution map drawn from `cdf` instead of uniformly from a downsampled copy.
+/// A small, very bright sun gets most of the samples, so the result converges with far fewer of them.
+/// The same samples serve every output texel; they are drawn once per call.
+void convolveLambertianImportance(const glm::vec3* data, const EnvironmentCdf& cdf, int dstW, int dstH, glm::vec3* output, int numSamples);
+
+struct CubeMipChainStats
+{
+	uint32_t numLevels = 0;
+	size_t baseBytes = 0;
+	size_t totalBytes = 0;
+	double ms = 0.0;
+};
+
+/// Level 0 is a copy of `cube`, every next level halves the face size down to 1x1. Each texel is a tent filter over the
+/// 4x4 texels around it in the previous level; texels across a face edge are fetched from the adjacent face, so edges
+/// stay continuous on every level. Levels depend on each other; the faces and rows of one level are filtered in parallel.
+std::vector<Bitmap> generateCubeMipChain(const Bitmap& cube, CubeMipChainStats* outStats = nullptr);
+
+/// All levels back to back, which is what lvk::TextureDesc::data expects with dataNumMipLevels:
+/// the six faces of level 0, then the six faces of level 1, and so on.
+std::vector<uint8_t> packMipChain(const std::vector<Bitmap>& levels);
+
+/// The split-sum BRDF integration table: the scale (x) and the bias (y) to apply to F0 for a GGX specular lobe,
+/// integrated over the hemisphere with `numSamples` importance-sampled Hammersley directions. Columns are NdotV and rows
+/// are the roughness, both at texel centers, from 0 to 1. Rows are generated in parallel; the half vectors of a row are
+/// computed once and integrated for every NdotV four samples at a time with SSE2, where it is available.
+std::vector<glm::vec2> generateBrdfLut(int size, int numSamples);
@@ -5,8 +5,36 @@
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
 
+#include <cfloat>
+#include <cstdint>
 #include <vector>
 
+#include "frustum.h"
+
+// SSE2 is part of every x86-64 target, so it needs no compiler flags
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define UTILS_MATH_SSE2 1
+#endif
+
+// UTILS_MATH_ACCURACY, e.g. from the CMake option of the same name, selects the trigonometry kernels at the end of this file:
+//   UTILS_MATH_ACCURACY_STD     - the standard library, e.g. to rule the approximations out when looking for an artifact
+//   UTILS_MATH_ACCURACY_PRECISE - polynomials within a few float ulps of the standard library (the default)
+//   UTILS_MATH_ACCURACY_FAST    - shorter polynomials, about 1e-5 radians
+// 0 is not a mode: an unknown name, e.g. UTILS_MATH_ACCURACY_fast, evaluates to 0 in #if and has to fail the build.
+#define UTILS_MATH_ACCURACY_STD 1
+#define UTILS_MATH_ACCURACY_PRECISE 2
+#define UTILS_MATH_ACCURACY_FAST 3
+
+#ifndef UTILS_MATH_ACCURACY
+#define UTILS_MATH_ACCURACY UTILS_MATH_ACCURACY_PRECISE
+#endif
+
+#if UTILS_MATH_ACCURACY != UTILS_MATH_ACCURACY_STD && UTILS_MATH_ACCURACY != UTILS_MATH_ACCURACY_PRECISE && \
+    UTILS_MATH_ACCURACY != UTILS_MATH_ACCURACY_FAST
+#error "UTILS_MATH_ACCURACY must be UTILS_MATH_ACCURACY_STD, UTILS_MATH_ACCURACY_PRECISE or UTILS_MATH_ACCURACY_FAST"
+#endif
+
 using glm::mat4;
 using glm::vec2;
 using glm::vec3;
@@ -100,30 +128,6 @@ inline vec3 randVec()
   return randomVec(vec3(-5, -5, -5), vec3(5, 5, 5));
 }
 
-inline void getFrustumPlanes(mat4 viewProj, vec4* planes)
-{
-  viewProj  = glm::transpose(viewProj);
-  planes[0] = vec4(viewProj[3] + viewProj[0]); // left
-  planes[1] = vec4(viewProj[3] - viewProj[0]); // right
-  planes[2] = vec4(viewProj[3] + viewProj[1]); // bottom
-  planes[3] = vec4(viewProj[3] - viewProj[1]); // top
-  planes[4] = vec4(viewProj[3] + viewProj[2]); // near
-  planes[5] = vec4(viewProj[3] - viewProj[2]); // far
-}
-
-inline void getFrustumCorners(mat4 viewProj, vec4* points)
-{
-  const vec4 corners[] = { vec4(-1, -1, -1, 1), vec4(1, -1, -1, 1), vec4(1, 1, -1, 1), vec4(-1, 1, -1, 1),
-                           vec4(-1, -1, 1, 1),  vec4(1, -1, 1, 1),  vec4(1, 1, 1, 1),  vec4(-1, 1, 1, 1) };
-
-  const glm::mat4 invViewProj = glm::inverse(viewProj);
-
-  for (int i = 0; i != 8; i++) {
-    const vec4 q = invViewProj * corners[i];
-    points[i]    = q / q.w;
-  }
-}
-
 inline bool isBoxInFrustum(glm::vec4* frustumPlanes, glm::vec4* frustumCorners, const BoundingBox& box)
 {
   using glm::dot;
@@ -196,4 +200,339 @@ inline BoundingBox combineBoxes(const std::vector<BoundingBox>& boxes)
   }
 
   return BoundingBox(allPoints.data(), allPoints.size());
-}
\ No newline at end of file
+}
+
+// Trigonometry of direction conversions: scalar kernels and the same math four lanes at a time. The scalar and SSE2 versions
+// do the same operations in the same order, so they return the same values.
+
+namespace Math
+{
+static constexpr float HALFPI = 1.57079632679f;
+
+/// The largest absolute differences from the standard library in double precision, in radians for fastAtan2() and as
+/// values for fastSinCos(); the benchmarks check them
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_STD
+static constexpr float kMaxAtan2Error  = 5e-7f;
+static constexpr float kMaxSinCosError = 2e-7f;
+#elif UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_PRECISE
+static constexpr float kMaxAtan2Error  = 1e-6f;
+static constexpr float kMaxSinCosError = 5e-7f;
+#else
+static constexpr float kMaxAtan2Error  = 2e-5f;
+static constexpr float kMaxSinCosError = 2e-6f;
+#endif
+
+namespace detail
+{
+// tan(pi / 8): above it atan(t) = pi / 4 + atan((t - 1) / (t + 1))
+static constexpr float kTanPi8 = 0.414213562373f;
+// pi / 4 in three parts, so that x - k * pi / 4 is exact for |x| < 8192
+static constexpr float kDP1 = 0.78515625f;
+static constexpr float kDP2 = 2.4187564849853515625e-4f;
+static constexpr float kDP3 = 3.77489497744594108e-8f;
+static constexpr float kFourOverPi = 1.27323954474f;
+
+// atan(t) for t in [-tan(pi / 8), tan(pi / 8)] (precise), or in [0, 1] (fast)
+inline float atanKernel(float t)
+{
+  const float z = t * t;
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  // Abramowitz and Stegun 4.4.47
+  return t * (0.9998660f + z * (-0.3302995f + z * (0.1801410f + z * (-0.0851330f + z * 0.0208351f))));
+#else
+  // Cephes atanf
+  return t + t * z * (-3.33329491539e-1f + z * (1.99777106478e-1f + z * (-1.38776856032e-1f + z * 8.05374449538e-2f)));
+#endif
+}
+
+// sin(r) and cos(r) for r in [-pi / 4, pi / 4]
+inline float sinKernel(float r, float z)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  return r + r * z * (-1.6662834e-1f + z * 8.1529920e-3f);
+#else
+  // Cephes sinf
+  return r + r * z * (-1.6666654611e-1f + z * (8.3321608736e-3f + z * -1.9515295891e-4f));
+#endif
+}
+
+inline float cosKernel(float z)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  return 1.0f - 0.5f * z + z * z * (4.1661279e-2f + z * -1.3652449e-3f);
+#else
+  // Cephes cosf
+  return 1.0f - 0.5f * z + z * z * (4.166664568298827e-2f + z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+#endif
+}
+} // namespace detail
+
+/// atan2() in [-pi, pi], including the signed zeros of std::atan2()
+inline float fastAtan2(float y, float x)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_STD
+  return std::atan2(y, x);
+#else
+  const float ax = std::abs(x);
+  const float ay = std::abs(y);
+  const float mx = std::max(ax, ay);
+  const float mn = std::min(ax, ay);
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  float r = detail::atanKernel(mn / std::max(mx, FLT_MIN));
+#else
+  // one division for both ranges: (t - 1) / (t + 1) with t = mn / mx
+  const bool big = mn > detail::kTanPi8 * mx;
+  float r        = detail::atanKernel((big ? mn - mx : mn) / std::max(big ? mn + mx : mx, FLT_MIN)) + (big ? 0.25f * PI : 0.0f);
+#endif
+  r = ay > ax ? HALFPI - r : r;
+  r = std::signbit(x) ? PI - r : r;
+  return std::copysign(r, y);
+#endif
+}
+
+/// sin(x) and cos(x) for |x| < 8192
+inline void fastSinCos(float x, float& s, float& c)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_STD
+  s = std::sin(x);
+  c = std::cos(x);
+#else
+  const float ax = std::abs(x);
+  // the nearest even multiple of pi / 4 leaves r in [-pi / 4, pi / 4]
+  const int32_t j = (int32_t(ax * detail::kFourOverPi) + 1) & ~1;
+  const float y   = float(j);
+  const float r   = ((ax - y * detail::kDP1) - y * detail::kDP2) - y * detail::kDP3;
+  const float z   = r * r;
+  const float ps  = detail::sinKernel(r, z);
+  const float pc  = detail::cosKernel(z);
+  // quadrants 1 and 3 swap sine and cosine
+  const bool swap = (j & 2) != 0;
+  s               = swap ? pc : ps;
+  c               = swap ? ps : pc;
+  s               = ((j & 4) != 0) != (x < 0.0f) ? -s : s;
+  c               = ((j + 2) & 4) != 0 ? -c : c;
+#endif
+}
+
+inline float fastSin(float x)
+{
+  float s, c;
+  fastSinCos(x, s, c);
+  return s;
+}
+
+inline float fastCos(float x)
+{
+  float s, c;
+  fastSinCos(x, s, c);
+  return c;
+}
+
+#if defined(UTILS_MATH_SSE2)
+namespace detail
+{
+inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128 atanKernel4(__m128 t)
+{
+  const __m128 z = _mm_mul_ps(t, t);
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  __m128 p = _mm_add_ps(_mm_set1_ps(-0.0851330f), _mm_mul_ps(z, _mm_set1_ps(0.0208351f)));
+  p        = _mm_add_ps(_mm_set1_ps(0.1801410f), _mm_mul_ps(z, p));
+  p        = _mm_add_ps(_mm_set1_ps(-0.3302995f), _mm_mul_ps(z, p));
+  p        = _mm_add_ps(_mm_set1_ps(0.9998660f), _mm_mul_ps(z, p));
+  return _mm_mul_ps(t, p);
+#else
+  __m128 p = _mm_add_ps(_mm_set1_ps(-1.38776856032e-1f), _mm_mul_ps(z, _mm_set1_ps(8.05374449538e-2f)));
+  p        = _mm_add_ps(_mm_set1_ps(1.99777106478e-1f), _mm_mul_ps(z, p));
+  p        = _mm_add_ps(_mm_set1_ps(-3.33329491539e-1f), _mm_mul_ps(z, p));
+  return _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(t, z), p));
+#endif
+}
+
+inline __m128 sinKernel4(__m128 r, __m128 z)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  const __m128 p = _mm_add_ps(_mm_set1_ps(-1.6662834e-1f), _mm_mul_ps(z, _mm_set1_ps(8.1529920e-3f)));
+#else
+  __m128 p = _mm_add_ps(_mm_set1_ps(8.3321608736e-3f), _mm_mul_ps(z, _mm_set1_ps(-1.9515295891e-4f)));
+  p        = _mm_add_ps(_mm_set1_ps(-1.6666654611e-1f), _mm_mul_ps(z, p));
+#endif
+  return _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), p));
+}
+
+inline __m128 cosKernel4(__m128 z)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  const __m128 p = _mm_add_ps(_mm_set1_ps(4.1661279e-2f), _mm_mul_ps(z, _mm_set1_ps(-1.3652449e-3f)));
+#else
+  __m128 p = _mm_add_ps(_mm_set1_ps(-1.388731625493765e-3f), _mm_mul_ps(z, _mm_set1_ps(2.443315711809948e-5f)));
+  p        = _mm_add_ps(_mm_set1_ps(4.166664568298827e-2f), _mm_mul_ps(z, p));
+#endif
+  return _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_mul_ps(_mm_mul_ps(z, z), p));
+}
+} // namespace detail
+
+/// fastAtan2() of four lanes
+inline __m128 fastAtan2x4(__m128 y, __m128 x)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_STD
+  alignas(16) float ys[4], xs[4];
+  _mm_store_ps(ys, y);
+  _mm_store_ps(xs, x);
+  for (int i = 0; i != 4; i++)
+    ys[i] = std::atan2(ys[i], xs[i]);
+  return _mm_load_ps(ys);
+#else
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  const __m128 ax       = _mm_andnot_ps(signMask, x);
+  const __m128 ay       = _mm_andnot_ps(signMask, y);
+  const __m128 mx       = _mm_max_ps(ax, ay);
+  const __m128 mn       = _mm_min_ps(ax, ay);
+  const __m128 minDen   = _mm_set1_ps(FLT_MIN);
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_FAST
+  __m128 r = detail::atanKernel4(_mm_div_ps(mn, _mm_max_ps(mx, minDen)));
+#else
+  const __m128 big = _mm_cmpgt_ps(mn, _mm_mul_ps(_mm_set1_ps(detail::kTanPi8), mx));
+  const __m128 num = detail::select(big, _mm_sub_ps(mn, mx), mn);
+  const __m128 den = detail::select(big, _mm_add_ps(mn, mx), mx);
+  __m128 r = _mm_add_ps(detail::atanKernel4(_mm_div_ps(num, _mm_max_ps(den, minDen))), _mm_and_ps(big, _mm_set1_ps(0.25f * PI)));
+#endif
+  r = detail::select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(HALFPI), r), r);
+  // the sign bit rather than x < 0, so that atan2(0, -0) is pi
+  const __m128 negativeX = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(x), 31));
+  r = detail::select(negativeX, _mm_sub_ps(_mm_set1_ps(PI), r), r);
+  // r is never negative, so this is copysign()
+  return _mm_or_ps(r, _mm_and_ps(y, signMask));
+#endif
+}
+
+/// fastSinCos() of four lanes
+inline void fastSinCosx4(__m128 x, __m128& s, __m128& c)
+{
+#if UTILS_MATH_ACCURACY == UTILS_MATH_ACCURACY_STD
+  alignas(16) float ss[4], cs[4];
+  _mm_store_ps(ss, x);
+  for (int i = 0; i != 4; i++) {
+    cs[i] = std::cos(ss[i]);
+    ss[i] = std::sin(ss[i]);
+  }
+  s = _mm_load_ps(ss);
+  c = _mm_load_ps(cs);
+#else
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  const __m128 ax       = _mm_andnot_ps(signMask, x);
+  const __m128i j = _mm_and_si128(_mm_add_epi32(_mm_cvttps_epi32(_mm_mul_ps(ax, _mm_set1_ps(detail::kFourOverPi))), _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+  const __m128 y  = _mm_cvtepi32_ps(j);
+  __m128 r        = _mm_sub_ps(ax, _mm_mul_ps(y, _mm_set1_ps(detail::kDP1)));
+  r               = _mm_sub_ps(r, _mm_mul_ps(y, _mm_set1_ps(detail::kDP2)));
+  r               = _mm_sub_ps(r, _mm_mul_ps(y, _mm_set1_ps(detail::kDP3)));
+  const __m128 z  = _mm_mul_ps(r, r);
+  const __m128 ps = detail::sinKernel4(r, z);
+  const __m128 pc = detail::cosKernel4(z);
+  const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+  // bit 2 of the octant moves to the sign bit
+  const __m128 sinSign = _mm_xor_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)), _mm_and_ps(x, signMask));
+  const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+  s = _mm_xor_ps(detail::select(swap, pc, ps), sinSign);
+  c = _mm_xor_ps(detail::select(swap, ps, pc), cosSign);
+#endif
+}
+#endif // UTILS_MATH_SSE2
+
+/// Equirectangular maps as the convolutions in UtilsCubemap.cpp lay them out: u = phi / 2pi around +Z starting at +X,
+/// v = theta / pi down from +Z
+inline vec3 equirectToDirection(const vec2& uv)
+{
+  float sinTheta, cosTheta, sinPhi, cosPhi;
+  fastSinCos(uv.y * PI, sinTheta, cosTheta);
+  fastSinCos(uv.x * TWOPI, sinPhi, cosPhi);
+  return vec3(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta);
+}
+
+/// The inverse of equirectToDirection(); `dir` does not have to be normalized. u is in [0, 1], v in [0, 1].
+/// u wraps on the sign bit, so -0 (y = -0 with x > 0) maps to 1, as atan2(y, x) + pi does for the negated direction.
+inline vec2 directionToEquirect(const vec3& dir)
+{
+  const float u = fastAtan2(dir.y, dir.x) * (1.0f / TWOPI);
+  // atan2() of the distance from the axis gives theta without normalizing
+  const float v = fastAtan2(std::sqrt(dir.x * dir.x + dir.y * dir.y), dir.z) * (1.0f / PI);
+  return vec2(std::signbit(u) ? u + 1.0f : u, v);
+}
+
+#if defined(UTILS_MATH_SSE2)
+/// directionToEquirect() of four directions given as separate X, Y and Z lanes
+inline void directionToEquirectx4(__m128 x, __m128 y, __m128 z, __m128& u, __m128& v)
+{
+  u = _mm_mul_ps(fastAtan2x4(y, x), _mm_set1_ps(1.0f / TWOPI));
+  // all ones in the lanes with the sign bit set, including -0
+  const __m128 negative = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(u), 31));
+  u = _mm_add_ps(u, _mm_and_ps(negative, _mm_set1_ps(1.0f)));
+  v = _mm_mul_ps(fastAtan2x4(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))), z), _mm_set1_ps(1.0f / PI));
+}
+
+/// equirectToDirection() of four (u, v) lanes
+inline void equirectToDirectionx4(__m128 u, __m128 v, __m128& x, __m128& y, __m128& z)
+{
+  __m128 sinTheta, sinPhi, cosPhi;
+  fastSinCosx4(_mm_mul_ps(v, _mm_set1_ps(PI)), sinTheta, z);
+  fastSinCosx4(_mm_mul_ps(u, _mm_set1_ps(TWOPI)), sinPhi, cosPhi);
+  x = _mm_mul_ps(sinTheta, cosPhi);
+  y = _mm_mul_ps(sinTheta, sinPhi);
+}
+#endif // UTILS_MATH_SSE2
+
+/// A point of a cube face as faceCoordsToXYZ() lays the faces out, with (s, t) = (i, j) / faceSize; not normalized
+inline vec3 cubeFaceToDirection(int face, const vec2& st)
+{
+  const float A = 2.0f * st.x;
+  const float B = 2.0f * st.y;
+
+  switch (face) {
+  case 0:
+    return vec3(-1.0f, A - 1.0f, B - 1.0f);
+  case 1:
+    return vec3(A - 1.0f, -1.0f, 1.0f - B);
+  case 2:
+    return vec3(1.0f, A - 1.0f, 1.0f - B);
+  case 3:
+    return vec3(1.0f - A, 1.0f, 1.0f - B);
+  case 4:
+    return vec3(B - 1.0f, A - 1.0f, 1.0f);
+  case 5:
+    return vec3(1.0f - B, A - 1.0f, -1.0f);
+  }
+
+  return vec3();
+}
+
+/// The inverse of cubeFaceToDirection(): the face `dir` points at, and (s, t) in [0, 1] on it
+inline int directionToCubeFace(const vec3& dir, vec2& st)
+{
+  const vec3 a = glm::abs(dir);
+
+  int face = 0;
+  vec2 p;
+
+  if (a.x >= a.y && a.x >= a.z) {
+    const float k = 1.0f / std::max(a.x, FLT_MIN);
+    face          = dir.x < 0.0f ? 0 : 2;
+    p             = vec2(dir.y * k, dir.x < 0.0f ? dir.z * k : -dir.z * k);
+  } else if (a.y >= a.z) {
+    const float k = 1.0f / a.y;
+    face          = dir.y < 0.0f ? 1 : 3;
+    p             = vec2(dir.y < 0.0f ? dir.x * k : -dir.x * k, -dir.z * k);
+  } else {
+    const float k = 1.0f / a.z;
+    face          = dir.z < 0.0f ? 5 : 4;
+    p             = vec2(dir.y * k, dir.z < 0.0f ? -dir.x * k : dir.x * k);
+  }
+
+  st = 0.5f * p + vec2(0.5f);
+
+  return face;
+}
+} // namespace Math
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <ktx.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "UtilsCubemap.h"
+#include "mapped_file.h"
+
+/// The split-sum BRDF integration table which goes with the irradiance and the prefiltered environment maps.
+/// It depends on nothing but these settings, so it is generated once and cached as a KTX2 file in RG16F.
+constexpr int kBrdfLutSize = 256;
+constexpr int kBrdfLutSamples = 1024;
+/// Bump when generateBrdfLut() changes, so cached tables are generated again
+constexpr uint32_t kBrdfLutVersion = 1;
+// VK_FORMAT_R16G16_SFLOAT
+constexpr uint32_t kBrdfLutVkFormat = 83;
+constexpr const char* kBrdfLutKey = "VulkanPractice.brdfLut";
+
+struct BrdfLutReference
+{
+	float NdotV = 0.0f;
+	float roughness = 0.0f;
+	glm::vec2 value = glm::vec2(0.0f);
+};
+
+/// Integrated over the hemisphere on a 4096 x 4096 grid of light directions in double precision, with the same GGX
+/// distribution and Schlick-GGX geometry term (k = roughness^2 / 2), so they do not depend on the sampling at all
+static const BrdfLutReference kBrdfLutReference[] = {
+	{ 0.10f, 0.25f, { 0.3913f, 0.2911f } },
+	{ 0.50f, 0.25f, { 0.9023f, 0.0305f } },
+	{ 0.90f, 0.25f, { 0.9872f, 0.0001f } },
+	{ 0.10f, 0.50f, { 0.5902f, 0.0984f } },
+	{ 0.50f, 0.50f, { 0.7285f, 0.0185f } },
+	{ 0.90f, 0.50f, { 0.8709f, 0.0003f } },
+	{ 0.10f, 0.90f, { 0.5943f, 0.0197f } },
+	{ 0.50f, 0.90f, { 0.4752f, 0.0037f } },
+	{ 0.90f, 0.90f, { 0.4203f, 0.0002f } },
+};
+
+/// Covers 1024 samples, bilinear filtering of a 256 x 256 table and the half precision of the cached values
+constexpr float kBrdfLutTolerance = 1e-2f;
+
+struct BrdfLutStats
+{
+	bool fromCache = false;
+	double ms = 0.0;
+	/// The largest difference from kBrdfLutReference
+	float maxError = 0.0f;
+	bool passed = false;
+};
+
+/// RG16F texels as a texture upload expects them: the scale in the low half, the bias in the high half
+inline std::vector<uint32_t> packBrdfLut(const std::vector<glm::vec2>& lut)
+{
+	std::vector<uint32_t> texels(lut.size());
+	for (size_t i = 0; i != lut.size(); i++)
+		texels[i] = glm::packHalf2x16(lut[i]);
+	return texels;
+}
+
+/// Bilinear, like the sampler of the shaders; texel centers are at (i + 0.5) / size
+inline glm::vec2 sampleBrdfLut(const std::vector<uint32_t>& texels, int size, float NdotV, float roughness)
+{
+	const float fx = std::clamp(NdotV * float(size) - 0.5f, 0.0f, float(size - 1));
+	const float fy = std::clamp(roughness * float(size) - 0.5f, 0.0f, float(size - 1));
+	const int x0 = int(fx);
+	const int y0 = int(fy);
+	const int x1 = std::min(x0 + 1, size - 1);
+	const int y1 = std::min(y0 + 1, size - 1);
+	const float tx = fx - float(x0);
+	const float ty = fy - float(y0);
+
+	auto texel = [&](int x, int y) { return glm::unpackHalf2x16(texels[size_t(y) * size + x]); };
+
+	const glm::vec2 top = texel(x0, y0) * (1.0f - tx) + texel(x1, y0) * tx;
+	const glm::vec2 bottom = texel(x0, y1) * (1.0f - tx) + texel(x1, y1) * tx;
+	return top * (1.0f - ty) + bottom * ty;
+}
+
+/// The largest difference of the table from the reference values
+inline float checkBrdfLut(const std::vector<uint32_t>& texels, int size)
+{
+	if (texels.size() != size_t(size) * size)
+		return INFINITY;
+
+	float maxError = 0.0f;
+	for (const BrdfLutReference& r : kBrdfLutReference)
+	{
+		const glm::vec2 v = sampleBrdfLut(texels, size, r.NdotV, r.roughness);
+		const float error = std::max(std::abs(v.x - r.value.x), std::abs(v.y - r.value.y));
+		// NaN fails the check
+		maxError = std::isnan(error) ? INFINITY : std::max(maxError, error);
+	}
+	return maxError;
+}
+
+/// Identifies the settings a cached table was generated with
+inline std::string getBrdfLutKeyValue(int size, int numSamples)
+{
+	return "size=" + std::to_string(size) + " samples=" + std::to_string(numSamples) + " version=" + std::to_string(kBrdfLutVersion);
+}
+
+inline bool saveBrdfLutKtx(const std::filesystem::path& file, const std::vector<uint32_t>& texels, int size, int numSamples)
+{
+	ktxTextureCreateInfo info = {
+		.vkFormat = kBrdfLutVkFormat,
+		.baseWidth = (uint32_t)size,
+		.baseHeight = (uint32_t)size,
+		.baseDepth = 1,
+		.numDimensions = 2,
+		.numLevels = 1,
+		.numLayers = 1,
+		.numFaces = 1,
+		.isArray = KTX_FALSE,
+		.generateMipmaps = KTX_FALSE,
+	};
+
+	ktxTexture2* texture = nullptr;
+	if (ktxTexture2_Create(&info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) != KTX_SUCCESS)
+		return false;
+
+	const std::string value = getBrdfLutKeyValue(size, numSamples);
+
+	std::error_code ec;
+	std::filesystem::create_directories(file.parent_path(), ec);
+
+	const bool ok =
+		ktxTexture_SetImageFromMemory(ktxTexture(texture), 0, 0, 0, reinterpret_cast<const ktx_uint8_t*>(texels.data()),
+			texels.size() * sizeof(uint32_t)) == KTX_SUCCESS &&
+		ktxHashList_AddKVPair(&texture->kvDataHead, kBrdfLutKey, (unsigned int)value.size() + 1, value.c_str()) == KTX_SUCCESS &&
+		ktxTexture_WriteToNamedFile(ktxTexture(texture), file.string().c_str()) == KTX_SUCCESS;
+
+	ktxTexture_Destroy(ktxTexture(texture));
+
+	return ok;
+}
+
+/// False when there is no cached table, or it was generated with other settings
+inline bool loadBrdfLutKtx(const std::filesystem::path& file, int size, int numSamples, std::vector<uint32_t>& texels)
+{
+	if (!fileExists(file))
+		return false;
+
+	const MappedFile mapped(file, eAssetClass_Cache);
+
+	ktxTexture2* texture = nullptr;
+	if (!mapped.size() ||
+		ktxTexture2_CreateFromMemory(mapped.data(), mapped.size(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture) != KTX_SUCCESS)
+		return false;
+
+	const std::string expected = getBrdfLutKeyValue(size, numSamples);
+
+	unsigned int valueLength = 0;
+	void* value = nullptr;
+	ktx_size_t offset = 0;
+
+	const bool ok = texture->vkFormat == kBrdfLutVkFormat && texture->baseWidth == (uint32_t)size && texture->baseHeight == (uint32_t)size &&
+					ktxHashList_FindValue(&texture->kvDataHead, kBrdfLutKey, &valueLength, &value) == KTX_SUCCESS &&
+					valueLength == expected.size() + 1 && !memcmp(value, expected.c_str(), valueLength) &&
+					ktxTexture_GetImageOffset(ktxTexture(texture), 0, 0, 0, &offset) == KTX_SUCCESS &&
+					offset + size_t(size) * size * sizeof(uint32_t) <= ktxTexture_GetDataSize(ktxTexture(texture));
+
+	if (ok)
+	{
+		texels.resize(size_t(size) * size);
+		memcpy(texels.data(), ktxTexture_GetData(ktxTexture(texture)) + offset, texels.size() * sizeof(uint32_t));
+	}
+
+	ktxTexture_Destroy(ktxTexture(texture));
+
+	return ok;
+}
+
+/// The table cached in `cacheFile`, or a new one when the file is missing or was generated with other settings.
+/// A new table is checked against the reference values and cached only when it passes.
+inline std::vector<uint32_t> getBrdfLut(
+	const std::filesystem::path& cacheFile, BrdfLutStats* outStats = nullptr, int size = kBrdfLutSize, int numSamples = kBrdfLutSamples)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	BrdfLutStats stats;
+
+	std::vector<uint32_t> texels;
+	stats.fromCache = loadBrdfLutKtx(cacheFile, size, numSamples, texels);
+	if (!stats.fromCache)
+		texels = packBrdfLut(generateBrdfLut(size, numSamples));
+
+	stats.maxError = checkBrdfLut(texels, size);
+	stats.passed = stats.maxError <= kBrdfLutTolerance;
+
+	if (!stats.fromCache && stats.passed && !saveBrdfLutKtx(cacheFile, texels, size, numSamples))
+		printf("Unable to write %s\n", cacheFile.string().c_str());
+
+	stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (outStats)
+		*outStats = stats;
+
+	return texels;
+}
+
+inline void printBrdfLutStats(const char* prefix, const BrdfLutStats& s)
+{
+	printf("[%s] BRDF LUT: %s in %.1f ms, max error %.2e against the reference, %s\n", prefix, s.fromCache ? "loaded from cache" : "generated",
+		s.ms, s.maxError, s.passed ? "passed" : "FAILED");
+}
@@ -1,13 +1,27 @@
 #pragma once
 
 #include "lvk/LVK.h"
+#include <lvk/HelpersImGui.h>
 
 #include "shader_processor.h"
 #include "model_loader.h"
 #include "Bitmap.h"
 #include "UtilsCubemap.h"
+#include "frame_profiler.h"
+#include "gpu_profiler.h"
+#include "headless.h"
+#include "render_graph.h"
+#include "gpu_culling.h"
+#include "ibl_baker.h"
+#include "texture_manager.h"
+#include "material_table.h"
+#include "dynamic_resolution.h"
+#include "overdraw.h"
+#include "asset_pipeline.h"
+#include "mapped_file.h"
 
 #include <GLFW/glfw3.h>
+#include <implot/implot.h>
 
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
@@ -18,32 +32,49 @@
 #include <assimp/postprocess.h>
 #include <assimp/cimport.h>
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <memory>
 
-inline void cubemap()
+/// `numInstances` copies of the duck are laid out on a grid behind the first one and culled according to the culling mode.
+/// The environment cube map is baked with `iblBackend`; headless runs also check the GPU backend against the CPU one.
+/// Dynamic resolution keeps the frame time at `targetFrameMs`; 0 means 60 FPS in a window, and no dynamic resolution
+/// in headless runs, whose images have to be reproducible. Headless runs also compare the depth modes, in time and overdraw.
+/// Returns non-zero when the context cannot be created or a headless check fails, so CI runs fail with it.
+inline int cubemap(const HeadlessOptions& headless = {}, uint32_t numInstances = 1, eIblBackend iblBackend = eIblBackend_CPU, float targetFrameMs = 0.0f)
 {
 	minilog::initialize(nullptr, { .threadNames = false });
 
 	GLFWwindow* window = nullptr;
 
 	std::unique_ptr<lvk::IContext> ctx;
-	lvk::Holder<lvk::TextureHandle> depthTexture;
 
 	int width = -95;
 	int height = -90;
 
-	window = lvk::initWindow("Simple Example", width, height);
-	ctx = lvk::createVulkanContextWithSwapchain(window, width, height, {});
+	// cleared by every headless check which fails
+	bool checksPassed = true;
 
-	depthTexture = ctx->createTexture(
-		{
-			.type = lvk::TextureType_2D,
-			.format = lvk::Format_Z_F32,
-			.dimensions = {(uint32_t)width, (uint32_t)height},
-			.usage = lvk::TextureUsageBits_Attachment,
-			.debugName = "Depth buffer"
-		});
+	if (headless.enabled)
+	{
+		ctx = createHeadlessContext(headless.deviceType);
+		if (!ctx)
+			return 1;
+		width = (int)headless.width;
+		height = (int)headless.height;
+	}
+	else
+	{
+		window = lvk::initWindow("Simple Example", width, height);
+		ctx = lvk::createVulkanContextWithSwapchain(window, width, height, {});
+	}
+
+	const lvk::Format colorFormat = headless.enabled ? kHeadlessColorFormat : ctx->getSwapchainFormat();
+	const lvk::Format depthFormat = lvk::Format_Z_F32;
+
+	// Attachments are allocated by the render graph, which follows the framebuffer size
+	RenderGraph renderGraph(*ctx);
 
 	struct VertexData
 	{
@@ -52,11 +83,6 @@ inline void cubemap()
 		glm::vec2 tc;
 	};
 
-	lvk::Holder<lvk::ShaderModuleHandle> vert = loadShaderModule(ctx, "../../../shaders/03-ImGui/main_v2.vert");
-	lvk::Holder<lvk::ShaderModuleHandle> frag = loadShaderModule(ctx, "../../../shaders/03-ImGui/main_v2.frag");
-	lvk::Holder<lvk::ShaderModuleHandle> vertSkybox = loadShaderModule(ctx, "../../../shaders/03-ImGui/skybox.vert");
-	lvk::Holder<lvk::ShaderModuleHandle> fragSkybox = loadShaderModule(ctx, "../../../shaders/03-ImGui/skybox.frag");
-
 	const lvk::VertexInput vdesc = {
 	  .attributes = {	{.location = 0, .format = lvk::VertexFormat::Float3, .offset = offsetof(VertexData, pos) },
 						{.location = 1, .format = lvk::VertexFormat::Float3, .offset = offsetof(VertexData, n) },
@@ -64,67 +90,269 @@ inline void cubemap()
 	  .inputBindings = { {.stride = sizeof(VertexData) } },
 	};
 
-	// Pipelines
-	lvk::Holder<lvk::RenderPipelineHandle> pipeline = ctx->createRenderPipeline({
-		   .vertexInput = vdesc,
-		   .smVert = vert,
-		   .smFrag = frag,
-		   .color = { {.format = ctx->getSwapchainFormat() } },
-		   .depthFormat = ctx->getFormat(depthTexture),
-		   .cullMode = lvk::CullMode_Back,
-		});
+	/// Matches `Instance` in common.sp
+	struct InstanceData
+	{
+		glm::mat4 transform;
+		uint32_t materialIndex = 0;
+		uint32_t padding[3] = {};
+	};
 
-	lvk::Holder<lvk::RenderPipelineHandle> pipelineSkybox = ctx->createRenderPipeline({
-		.smVert = vertSkybox,
-		.smFrag = fragSkybox,
-		.color = { {.format = ctx->getSwapchainFormat() } },
-		.depthFormat = ctx->getFormat(depthTexture),
-		});
+	// every instance of one draw may have its own material
+	const Material kMaterials[] = {
+		{ .reflectivity = 0.3f },
+		{ .baseColorFactor = glm::vec4(1.0f, 0.45f, 0.4f, 1.0f), .reflectivity = 0.1f },
+		{ .baseColorFactor = glm::vec4(0.45f, 1.0f, 0.5f, 1.0f), .reflectivity = 0.5f },
+		{ .baseColorFactor = glm::vec4(0.4f, 0.55f, 1.0f, 1.0f), .reflectivity = 0.8f },
+	};
+	const uint32_t kNumMaterials = sizeof(kMaterials) / sizeof(kMaterials[0]);
 
-	const aiScene* scene = aiImportFile("../../../models/rubber_duck/scene.gltf", aiProcess_Triangulate);
+	// Dynamic resolution: the scene is rendered into the top-left part of an offscreen target, which is stretched over the output.
+	// The target keeps the size of the output, and the Hi-Z pyramid is allocated for it, so scale changes never reallocate anything.
+	bool dynamicResolution = !headless.enabled || targetFrameMs > 0.0f;
+	DynamicResolutionController resolutionController({ .targetFrameMs = targetFrameMs > 0.0f ? targetFrameMs : 1000.0f / 60.0f });
 
-	if (!scene || !scene->HasMeshes()) {
-		printf("Unable to load data/rubber_duck/scene.gltf\n");
-		exit(255);
-	}
+	// Overdraw: the heat map replaces the scene while it is shown; headless runs read the counters back
+	uint32_t depthMode = eDepthMode_SkyboxLast;
+	bool showOverdraw = false;
+
+	std::unique_ptr<OverdrawCounter> overdrawCounter = std::make_unique<OverdrawCounter>(ctx, headless.enabled);
+
+	// Startup: file reads and decodes run in jobs, the shaders compile on this thread meanwhile, and everything which
+	// goes to the GPU is uploaded in one batch once its inputs are ready
+	lvk::Holder<lvk::ShaderModuleHandle> vert, frag, vertSkybox, fragSkybox, fragDepthPrepass, vertUpscale, fragUpscale, fragOverdraw;
+	lvk::Holder<lvk::RenderPipelineHandle> pipeline, pipelineDepthPrepass, pipelineSkybox, pipelineUpscale, pipelineOverdraw;
+	lvk::Holder<lvk::SamplerHandle> samplerUpscale;
 
-	// Model Loading
-	const aiMesh* mesh = scene->mMeshes[0];
+	const aiScene* scene = nullptr;
+	bool modelLoaded = false;
 	std::vector<VertexData> vertices;
-	for (uint32_t i = 0; i != mesh->mNumVertices; i++) {
-		const aiVector3D v = mesh->mVertices[i];
-		const aiVector3D n = mesh->mNormals[i];
-		const aiVector3D t = mesh->mTextureCoords[0][i];
-		vertices.push_back({ .pos = glm::vec3(v.x, v.y, v.z), .n = glm::vec3(n.x, n.y, n.z), .tc = glm::vec2(t.x, t.y) });
-	}
 	std::vector<uint32_t> indices;
-	for (uint32_t i = 0; i != mesh->mNumFaces; i++) {
-		for (uint32_t j = 0; j != 3; j++)
-			indices.push_back(mesh->mFaces[i].mIndices[j]);
+	std::vector<InstanceData> instances(std::max(numInstances, 1u));
+	std::vector<BoundingBox> instanceBoxes(instances.size());
+
+	TextureManager::MipChain textureMips;
+
+	Bitmap hdr;
+	Bitmap cross;
+	Bitmap cubemapFaces;
+	CubeMipChainStats mipStats;
+	std::vector<uint8_t> cubemapMips;
+
+	lvk::Holder<lvk::BufferHandle> bufferIndices, bufferVertices, bufferInstances;
+	std::unique_ptr<GpuCulling> gpuCulling;
+	std::unique_ptr<TextureManager> textureManager;
+	uint32_t texture = ~0u;
+	lvk::Holder<lvk::TextureHandle> cubemapTex;
+
+	const std::filesystem::path kTextureFile = std::filesystem::absolute("../../../models/rubber_duck/textures/Duck_baseColor.png");
+
+	AssetPipeline startup;
+
+	const AssetNode nodeShaders = startup.addMainThread("Shaders", [&]() {
+		vert = loadShaderModule(ctx, "../../../shaders/03-ImGui/main_v2.vert");
+		frag = loadShaderModule(ctx, "../../../shaders/03-ImGui/main_v2.frag");
+		vertSkybox = loadShaderModule(ctx, "../../../shaders/03-ImGui/skybox.vert");
+		fragSkybox = loadShaderModule(ctx, "../../../shaders/03-ImGui/skybox.frag");
+		fragDepthPrepass = loadShaderModule(ctx, "../../../shaders/03-ImGui/depth_prepass.frag");
+		vertUpscale = loadShaderModule(ctx, "../../../shaders/03-ImGui/upscale.vert");
+		fragUpscale = loadShaderModule(ctx, "../../../shaders/03-ImGui/upscale.frag");
+		fragOverdraw = loadShaderModule(ctx, "../../../shaders/03-ImGui/overdraw.frag");
+	});
+
+	const AssetNode nodePipelines = startup.addMainThread("Pipelines", [&]() {
+		pipeline = ctx->createRenderPipeline({
+			   .vertexInput = vdesc,
+			   .smVert = vert,
+			   .smFrag = frag,
+			   .color = { {.format = colorFormat } },
+			   .depthFormat = depthFormat,
+			   .cullMode = lvk::CullMode_Back,
+			});
+
+		pipelineDepthPrepass = ctx->createRenderPipeline({
+			   .vertexInput = vdesc,
+			   .smVert = vert,
+			   .smFrag = fragDepthPrepass,
+			   .color = {},
+			   .depthFormat = depthFormat,
+			   .cullMode = lvk::CullMode_Back,
+			});
+
+		pipelineSkybox = ctx->createRenderPipeline({
+			.smVert = vertSkybox,
+			.smFrag = fragSkybox,
+			.color = { {.format = colorFormat } },
+			.depthFormat = depthFormat,
+			});
+
+		pipelineUpscale = ctx->createRenderPipeline({
+			.smVert = vertUpscale,
+			.smFrag = fragUpscale,
+			.color = { {.format = colorFormat } },
+			});
+
+		pipelineOverdraw = ctx->createRenderPipeline({
+			.smVert = vertUpscale,
+			.smFrag = fragOverdraw,
+			.color = { {.format = colorFormat } },
+			});
+
+		samplerUpscale = ctx->createSampler({
+			.wrapU = lvk::SamplerWrap_Clamp,
+			.wrapV = lvk::SamplerWrap_Clamp,
+			.wrapW = lvk::SamplerWrap_Clamp,
+			.debugName = "Sampler: upscale",
+			});
+	}, { nodeShaders });
+
+	const AssetNode nodeImport = startup.add("Model import", [&]() {
+		scene = aiImportFileMapped("../../../models/rubber_duck/scene.gltf", aiProcess_Triangulate);
+	});
+
+	const AssetNode nodeMesh = startup.add("Mesh", [&]() {
+		if (!scene || !scene->HasMeshes())
+			return;
+
+		const aiMesh* mesh = scene->mMeshes[0];
+		vertices.reserve(mesh->mNumVertices);
+		for (uint32_t i = 0; i != mesh->mNumVertices; i++) {
+			const aiVector3D v = mesh->mVertices[i];
+			const aiVector3D n = mesh->mNormals[i];
+			const aiVector3D t = mesh->mTextureCoords[0][i];
+			vertices.push_back({ .pos = glm::vec3(v.x, v.y, v.z), .n = glm::vec3(n.x, n.y, n.z), .tc = glm::vec2(t.x, t.y) });
+		}
+		indices.reserve(3 * mesh->mNumFaces);
+		for (uint32_t i = 0; i != mesh->mNumFaces; i++) {
+			for (uint32_t j = 0; j != 3; j++)
+				indices.push_back(mesh->mFaces[i].mIndices[j]);
+		}
+		aiReleaseImport(scene);
+		modelLoaded = true;
+
+		// Instances: translations on a grid, the first one at the origin.
+		// The model only rotates around its origin, so a box around its bounding sphere fits every frame.
+		float radius = 0.0f;
+		for (const VertexData& v : vertices)
+			radius = std::max(radius, glm::length(v.pos));
+
+		const uint32_t side = (uint32_t)std::ceil(std::sqrt((float)instances.size()));
+		const float spacing = 2.0f * radius + 0.2f;
+
+		for (uint32_t i = 0; i != instances.size(); i++)
+		{
+			const int col = int((i + side / 2) % side) - int(side / 2);
+			const glm::vec3 t = glm::vec3(float(col) * spacing, 0.0f, float(i / side) * spacing);
+			instances[i] = { .transform = glm::translate(glm::mat4(1.0f), t), .materialIndex = i % kNumMaterials };
+			instanceBoxes[i] = BoundingBox(t - glm::vec3(radius), t + glm::vec3(radius));
+		}
+	}, { nodeImport });
+
+	const AssetNode nodeTexture = startup.add("Texture decode", [&]() { textureMips = TextureManager::decode(kTextureFile); });
+
+	const AssetNode nodeHdr = startup.add("HDR decode", [&]() {
+		int w = 0;
+		int h = 0;
+		float* img = stbiLoadfMapped("../../../HDR/piazza_bologni_1k.hdr", &w, &h, nullptr, 4);
+		// the bakes read the decoder output in place; it is freed with the last view
+		hdr = Bitmap::wrap(w, h, 4, eBitmapFormat_Float, img, std::shared_ptr<void>(img, stbi_image_free));
+	});
+
+	// the GPU backend submits to the context, so it bakes on this thread
+	auto bakeCross = [&]() { cross = IblBaker(ctx, iblBackend).convertEquirectangularMapToVerticalCross(hdr); };
+	const AssetNode nodeCross = iblBackend == eIblBackend_CPU ? startup.add("Equirect to cross", bakeCross, { nodeHdr })
+															  : startup.addMainThread("Equirect to cross", bakeCross, { nodeHdr });
+
+	startup.add("HDR debug write", [&]() {
+		stbi_write_hdr(".cache/screenshot.hdr", cross.w_, cross.h_, cross.comp_, (const float*)cross.data_.data());
+	}, { nodeCross });
+
+	const AssetNode nodeFaces = startup.add("Cross to faces", [&]() { cubemapFaces = convertVerticalCrossToCubeMapFaces(cross); }, { nodeCross });
+
+	const AssetNode nodeCubeMips = startup.add("Cube mips", [&]() {
+		cubemapMips = packMipChain(generateCubeMipChain(cubemapFaces, &mipStats));
+	}, { nodeFaces });
+
+	if (headless.enabled)
+		startup.addMainThread("IBL comparison", [&]() { checksPassed &= printIblComparison("03-ImGui", compareIblBackends(ctx, hdr)); }, { nodeHdr });
+
+	startup.addMainThread("GPU upload", [&]() {
+		if (!modelLoaded)
+			return;
+
+		// indices
+		bufferIndices = ctx->createBuffer(
+			{ .usage = lvk::BufferUsageBits_Index,
+			  .storage = lvk::StorageType_Device,
+			  .size = sizeof(uint32_t) * indices.size(),
+			  .data = indices.data(),
+			  .debugName = "Buffer: indices" },
+			nullptr);
+
+		// vertices
+		bufferVertices = ctx->createBuffer(
+			{ .usage = lvk::BufferUsageBits_Vertex,
+			  .storage = lvk::StorageType_Device,
+			  .size = sizeof(VertexData) * vertices.size(),
+			  .data = vertices.data(),
+			  .debugName = "Buffer: vertices" },
+			nullptr);
+
+		bufferInstances = ctx->createBuffer(
+			{ .usage = lvk::BufferUsageBits_Storage,
+			  .storage = lvk::StorageType_Device,
+			  .size = sizeof(InstanceData) * instances.size(),
+			  .data = instances.data(),
+			  .debugName = "Buffer: instances" },
+			nullptr);
+
+		// Headless runs read the culling results back to check them against the CPU
+		gpuCulling = std::make_unique<GpuCulling>(ctx, instanceBoxes, (uint32_t)indices.size(), headless.enabled);
+
+		// textures
+		textureManager = std::make_unique<TextureManager>(ctx, 256ull * 1024 * 1024);
+		texture = textureManager->add(kTextureFile, textureMips);
+		textureMips = {};
+
+		// cube map
+		cubemapTex = ctx->createTexture({
+			.type = lvk::TextureType_Cube,
+			.format = lvk::Format_RGBA_F32,
+			.dimensions = {(uint32_t)cubemapFaces.w_, (uint32_t)cubemapFaces.h_},
+			.usage = lvk::TextureUsageBits_Sampled,
+			.numMipLevels = mipStats.numLevels,
+			.data = cubemapMips.data(),
+			.dataNumMipLevels = mipStats.numLevels,
+			.debugName = "data/piazza_bologni_1k.hdr",
+			});
+		cubemapMips = {};
+	}, { nodeMesh, nodeTexture, nodeCubeMips, nodePipelines });
+
+	startup.run();
+
+	if (!modelLoaded) {
+		printf("Unable to load data/rubber_duck/scene.gltf\n");
+		exit(255);
 	}
-	aiReleaseImport(scene);
 
-	const size_t kSizeIndices = sizeof(uint32_t) * indices.size();
-	const size_t kSizeVertices = sizeof(VertexData) * vertices.size();
+	if (texture == ~0u) {
+		printf("Unable to load %s\n", kTextureFile.string().c_str());
+		exit(255);
+	}
 
-	// indices
-	lvk::Holder<lvk::BufferHandle> bufferIndices = ctx->createBuffer(
-		{ .usage = lvk::BufferUsageBits_Index,
-		  .storage = lvk::StorageType_Device,
-		  .size = kSizeIndices,
-		  .data = indices.data(),
-		  .debugName = "Buffer: indices" },
-		nullptr);
+	printf("[03-ImGui] Cube map mips: %u levels in %.1f ms, %.1f MB instead of %.1f MB (+%.0f%%)\n", mipStats.numLevels, mipStats.ms,
+		mipStats.totalBytes / 1048576.0, mipStats.baseBytes / 1048576.0, 100.0 * (mipStats.totalBytes - mipStats.baseBytes) / mipStats.baseBytes);
+	startup.printTimeline("03-ImGui");
+	printFileIoStats("03-ImGui");
+	printImageMemoryStats("03-ImGui");
 
-	// vertices
-	lvk::Holder<lvk::BufferHandle> bufferVertices = ctx->createBuffer(
-		{ .usage = lvk::BufferUsageBits_Vertex,
-		  .storage = lvk::StorageType_Device,
-		  .size = kSizeVertices,
-		  .data = vertices.data(),
-		  .debugName = "Buffer: vertices" },
-		nullptr);
+	// the cube map is on the GPU; the bake inputs go back to the heap
+	hdr = {};
+	cross = {};
+	cubemapFaces = {};
+	getImageBufferPool().trim();
 
+	uint32_t cullingMode = eCullingMode_GPU_HiZ;
 
 	struct PerFrameData
 	{
@@ -132,8 +360,12 @@ inline void cubemap()
 		glm::mat4 view;
 		glm::mat4 proj;
 		glm::vec4 cameraPos;
-		uint32_t tex = 0;
 		uint32_t texCube = 0;
+		uint32_t samplerCube = 0;
+		uint64_t instances = 0;
+		uint64_t materials = 0;
+		uint64_t overdraw = 0;
+		uint32_t overdrawWidth = 0;
 	};
 
 	lvk::Holder<lvk::BufferHandle> bufferPerFrame = ctx->createBuffer(
@@ -143,40 +375,92 @@ inline void cubemap()
 		  .debugName = "Buffer: per-frame" },
 		nullptr);
 
-	// texture
-	lvk::Holder<lvk::TextureHandle> texture = loadTexture(std::filesystem::absolute("../../../models/rubber_duck/textures/Duck_baseColor.png"), ctx);
+	// materials
+	std::unique_ptr<MaterialTable> materialTable = std::make_unique<MaterialTable>(ctx);
+	for (const Material& m : kMaterials)
+		materialTable->add(m);
+
+	// the default sampler ignores mip levels
+	lvk::Holder<lvk::SamplerHandle> samplerCube = ctx->createSampler({
+		.mipMap = lvk::SamplerMip_Linear,
+		.wrapU = lvk::SamplerWrap_Clamp,
+		.wrapV = lvk::SamplerWrap_Clamp,
+		.wrapW = lvk::SamplerWrap_Clamp,
+		.debugName = "Sampler: cube map mips",
+		});
 
-	// cube map
-	lvk::Holder<lvk::TextureHandle> cubemapTex;
-	{
-		int w, h;
-		const float* img = stbi_loadf("../../../HDR/piazza_bologni_1k.hdr", &w, &h, nullptr, 4);
-		Bitmap in(w, h, 4, eBitmapFormat_Float, img);
-		Bitmap out = convertEquirectangularMapToVerticalCross(in);
-		stbi_image_free((void*)img);
+	// Profilers
+	FrameProfiler profiler;
+	std::unique_ptr<GpuProfiler> gpuProfiler = std::make_unique<GpuProfiler>(*ctx);
+
+	// Imgui
+	std::unique_ptr<lvk::ImGuiRenderer> imgui;
+	ImPlotContext* implotCtx = nullptr;
+
+	auto drawImGui = [&](lvk::ICommandBuffer& buf, const lvk::Framebuffer& framebuffer) {
+		gpuProfiler->pushDebugGroup(buf, "ImGui", 0xff0000ff);
+		imgui->beginFrame(framebuffer);
+		profiler.drawOverlay([&]() {
+			gpuProfiler->drawOverlay();
+			textureManager->drawOverlay();
+			const MaterialTableStats materialStats = materialTable->getStats();
+			ImGui::Text("Materials: %u, %llu bytes uploaded", materialStats.numMaterials, (unsigned long long)materialStats.uploadedBytes);
+			ImGui::Checkbox("Dynamic resolution", &dynamicResolution);
+			if (dynamicResolution)
+			{
+				const DynamicResolutionStats resolutionStats = resolutionController.getStats();
+				ImGui::Text("Scale: %.2f, %.2f ms for %.2f ms target", resolutionStats.scale, resolutionStats.avgFrameMs,
+					resolutionController.getSettings().targetFrameMs);
+			}
+			for (uint32_t mode = 0; mode != eDepthMode_Count; mode++)
+			{
+				if (ImGui::RadioButton(getDepthModeName(mode), depthMode == mode))
+					depthMode = mode;
+				ImGui::SameLine();
+			}
+			ImGui::NewLine();
+			ImGui::Checkbox("Overdraw", &showOverdraw);
+			ImGui::Text("Instances: %u", numInstances);
+			for (uint32_t mode = 0; mode != eCullingMode_Count; mode++)
+			{
+				if (ImGui::RadioButton(getCullingModeName(mode), cullingMode == mode))
+					cullingMode = mode;
+				ImGui::SameLine();
+			}
+			ImGui::NewLine();
+		});
+		imgui->endFrame(buf);
+		gpuProfiler->popDebugGroup(buf);
+	};
 
-		stbi_write_hdr(".cache/screenshot.hdr", out.w_, out.h_, out.comp_, (const float*)out.data_.data());
+	auto findGpuZone = [&](const char* name) -> const GpuProfiler::ZoneTiming* {
+		for (const GpuProfiler::ZoneTiming& t : gpuProfiler->getTimings())
+		{
+			if (t.name == name)
+				return &t;
+		}
+		return nullptr;
+	};
 
-		Bitmap cubemap = convertVerticalCrossToCubeMapFaces(out);
+	// The GPU time of the whole frame when timestamps are available: with vsync the frame rate only shows missed frames, not the headroom
+	auto getFrameCostMs = [&](float cpuFrameMs) {
+		const GpuProfiler::ZoneTiming* t = findGpuZone("Frame");
+		return t ? t->lastMs : cpuFrameMs;
+	};
 
-		cubemapTex = ctx->createTexture({
-			.type = lvk::TextureType_Cube,
-			.format = lvk::Format_RGBA_F32,
-			.dimensions = {(uint32_t)cubemap.w_, (uint32_t)cubemap.h_},
-			.usage = lvk::TextureUsageBits_Sampled,
-			.data = cubemap.data_.data(),
-			.debugName = "data/piazza_bologni_1k.hdr",
-			});
-	}
+	// the region of the last frame which contains the scene
+	uint32_t lastSceneWidth = 0;
+	uint32_t lastSceneHeight = 0;
 
-	// window loop
-	while (!glfwWindowShouldClose(window))
-	{
-		glfwPollEvents();
-		int width, height;
-		glfwGetFramebufferSize(window, &width, &height);
-		if (!width || !height)
-			continue;
+	auto renderFrame = [&](lvk::ICommandBuffer& buf, lvk::TextureHandle colorTarget, int width, int height, double time) {
+		gpuProfiler->beginFrame(buf);
+		gpuProfiler->pushDebugGroup(buf, "Frame", 0xffffffff);
+
+		const float scale = dynamicResolution ? resolutionController.getScale() : 1.0f;
+		const uint32_t sceneWidth = std::max(1u, uint32_t(float(width) * scale));
+		const uint32_t sceneHeight = std::max(1u, uint32_t(float(height) * scale));
+		lastSceneWidth = sceneWidth;
+		lastSceneHeight = sceneHeight;
 
 		const float ratio = width / (float)height;
 
@@ -184,73 +468,412 @@ inline void cubemap()
 
 		const glm::mat4 p = glm::perspective(glm::radians(60.0f), ratio, 0.1f, 1000.0f);
 		const glm::mat4 m1 = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1, 0, 0));
-		const glm::mat4 m2 = glm::rotate(glm::mat4(1.0f), (float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 m2 = glm::rotate(glm::mat4(1.0f), (float)time, glm::vec3(0.0f, 1.0f, 0.0f));
 		const glm::mat4 v = glm::lookAt(cameraPos, glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-		const lvk::RenderPass renderPass = {
-			.color = { {.loadOp = lvk::LoadOp_Clear, .clearColor = { 1.0f, 1.0f, 1.0f, 1.0f } } },
-			.depth = {.loadOp = lvk::LoadOp_Clear, .clearDepth = 1.0f }
-		};
+		// the residency manager replaces the texture when it evicts or reloads mips; only changed materials are uploaded
+		const uint32_t baseColorTexture = textureManager->get(texture).index();
+		for (uint32_t i = 0; i != materialTable->getNumMaterials(); i++)
+		{
+			Material m = materialTable->get(i);
+			m.baseColorTexture = baseColorTexture;
+			materialTable->set(i, m);
+		}
+		materialTable->flush(buf);
 
-		const lvk::Framebuffer framebuffer = {
-		  .color = { {.texture = ctx->getCurrentSwapchainTexture() } },
-		  .depthStencil = {.texture = depthTexture },
-		};
+		if (showOverdraw)
+			overdrawCounter->beginFrame(buf, width, height);
 
-		lvk::ICommandBuffer& buf = ctx->acquireCommandBuffer();
 		buf.cmdUpdateBuffer(
 			bufferPerFrame, PerFrameData{
 								.model = m2 * m1,
 								.view = v,
 								.proj = p,
 								.cameraPos = glm::vec4(cameraPos, 1.0f),
-								.tex = texture.index(),
 								.texCube = cubemapTex.index(),
+								.samplerCube = samplerCube.index(),
+								.instances = ctx->gpuAddress(bufferInstances),
+								.materials = materialTable->getAddress(),
+								.overdraw = showOverdraw ? overdrawCounter->getAddress() : 0,
+								.overdrawWidth = showOverdraw ? uint32_t(width) : 0,
 			});
 
+		const bool gpuCull = cullingMode != eCullingMode_CPU;
+		const bool useHiZ = cullingMode == eCullingMode_GPU_HiZ;
+
+		if (gpuCull)
 		{
-			buf.cmdBeginRendering(renderPass, framebuffer);
+			gpuProfiler->pushDebugGroup(buf, "Culling", 0xff00ff00);
+			gpuCulling->cull(buf, p * v, useHiZ);
+			gpuProfiler->popDebugGroup(buf);
+		}
+
+		renderGraph.beginFrame(width, height);
+
+		const RenderGraphResource color = renderGraph.importTexture("Color", colorTarget);
+		const RenderGraphResource depth = renderGraph.createTexture("Depth buffer",
+			{ .format = depthFormat, .usage = uint8_t(lvk::TextureUsageBits_Attachment | lvk::TextureUsageBits_Sampled) });
+
+		const RenderGraphResource sceneColor = dynamicResolution
+			? renderGraph.createTexture("Scene color", { .format = colorFormat, .usage = uint8_t(lvk::TextureUsageBits_Attachment | lvk::TextureUsageBits_Sampled) })
+			: color;
+
+		renderGraph.markOutput(color);
+
+		const std::vector<lvk::BufferHandle> cullingResults = gpuCull ? std::vector<lvk::BufferHandle>{ gpuCulling->getDrawCommands(), gpuCulling->getDrawCount() }
+			: std::vector<lvk::BufferHandle>{};
+
+		auto bindSceneViewport = [&](lvk::ICommandBuffer& buf) {
+			if (dynamicResolution)
 			{
+				buf.cmdBindViewport({ .width = float(sceneWidth), .height = float(sceneHeight) });
+				buf.cmdBindScissorRect({ .width = sceneWidth, .height = sceneHeight });
+			}
+		};
+
+		// the pipeline and the depth state are bound by the caller
+		auto drawMesh = [&](lvk::ICommandBuffer& buf) {
+			buf.cmdBindVertexBuffer(0, bufferVertices);
+			buf.cmdBindIndexBuffer(bufferIndices, lvk::IndexFormat_UI32);
+			if (gpuCull)
+			{
+				buf.cmdDrawIndexedIndirectCount(gpuCulling->getDrawCommands(), 0, gpuCulling->getDrawCount(), 0, gpuCulling->getNumInstances());
+			}
+			else
+			{
+				// the baseline: CPU work grows with the number of instances
+				vec4 planes[6];
+				vec4 corners[8];
+				getFrustumPlanes(p * v, planes);
+				getFrustumCorners(p * v, corners);
+				for (uint32_t i = 0; i != instanceBoxes.size(); i++)
 				{
-					buf.cmdPushDebugGroupLabel("Skybox", 0xff0000ff);
-					buf.cmdBindRenderPipeline(pipelineSkybox);
-					buf.cmdPushConstants(ctx->gpuAddress(bufferPerFrame));
-					buf.cmdDraw(36);
-					buf.cmdPopDebugGroupLabel();
+					if (isBoxInFrustum(planes, corners, instanceBoxes[i]))
+						buf.cmdDrawIndexed(indices.size(), 1, 0, 0, i);
 				}
+			}
+		};
+
+		auto drawSkybox = [&](lvk::ICommandBuffer& buf) {
+			gpuProfiler->pushDebugGroup(buf, "Skybox", 0xff0000ff);
+			buf.cmdBindRenderPipeline(pipelineSkybox);
+			// skybox.vert puts the skybox at depth 1.0, which only passes where the depth buffer is still clear
+			buf.cmdBindDepthState(depthMode == eDepthMode_SkyboxFirst ? lvk::DepthState{} : lvk::DepthState{ .compareOp = lvk::CompareOp_LessEqual });
+			buf.cmdPushConstants(ctx->gpuAddress(bufferPerFrame));
+			buf.cmdDraw(36);
+			gpuProfiler->popDebugGroup(buf);
+		};
+
+		const bool prepass = depthMode == eDepthMode_Prepass;
+
+		if (prepass)
+		{
+			renderGraph.addPass({
+				.name = "Depth prepass",
+				.depth = {.resource = depth, .loadOp = lvk::LoadOp_Clear, .storeOp = lvk::StoreOp_Store, .clearDepth = 1.0f },
+				.readBuffers = cullingResults,
+				.execute = [&](lvk::ICommandBuffer& buf, const lvk::Framebuffer&) {
+					bindSceneViewport(buf);
+					gpuProfiler->pushDebugGroup(buf, "Depth prepass", 0xff0000ff);
+					buf.cmdBindRenderPipeline(pipelineDepthPrepass);
+					buf.cmdBindDepthState({ .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true });
+					buf.cmdPushConstants(ctx->gpuAddress(bufferPerFrame));
+					drawMesh(buf);
+					gpuProfiler->popDebugGroup(buf);
+				},
+				});
+		}
+
+		renderGraph.addPass({
+			.name = "Scene",
+			.color = { {.resource = sceneColor, .loadOp = lvk::LoadOp_Clear, .clearColor = { 1.0f, 1.0f, 1.0f, 1.0f } } },
+			// the Hi-Z pyramid is built from the depth buffer after the pass
+			.depth = {.resource = depth, .loadOp = prepass ? lvk::LoadOp_Load : lvk::LoadOp_Clear, .storeOp = useHiZ ? lvk::StoreOp_Store : lvk::StoreOp_DontCare, .clearDepth = 1.0f },
+			.readBuffers = cullingResults,
+			.execute = [&](lvk::ICommandBuffer& buf, const lvk::Framebuffer& framebuffer) {
+				bindSceneViewport(buf);
+				if (depthMode == eDepthMode_SkyboxFirst)
+					drawSkybox(buf);
 				{
-					buf.cmdPushDebugGroupLabel("Mesh", 0xff0000ff);
-					buf.cmdBindVertexBuffer(0, bufferVertices);
+					gpuProfiler->pushDebugGroup(buf, "Mesh", 0xff0000ff);
 					buf.cmdBindRenderPipeline(pipeline);
-					buf.cmdBindDepthState({ .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true });
-					buf.cmdBindIndexBuffer(bufferIndices, lvk::IndexFormat_UI32);
-					buf.cmdDrawIndexed(indices.size());
-					buf.cmdPopDebugGroupLabel();
+					// after the prepass only the visible fragments pass; main_v2.vert makes gl_Position invariant, so the depths match
+					buf.cmdBindDepthState(prepass ? lvk::DepthState{ .compareOp = lvk::CompareOp_LessEqual }
+												  : lvk::DepthState{ .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true });
+					buf.cmdPushConstants(ctx->gpuAddress(bufferPerFrame));
+					drawMesh(buf);
+					gpuProfiler->popDebugGroup(buf);
 				}
-				buf.cmdEndRendering();
+				if (depthMode != eDepthMode_SkyboxFirst)
+					drawSkybox(buf);
+				if (imgui && !dynamicResolution && !showOverdraw)
+					drawImGui(buf, framebuffer);
+			},
+			});
+
+		if (showOverdraw)
+		{
+			renderGraph.addPass({
+				.name = "Overdraw",
+				.color = { {.resource = sceneColor, .loadOp = lvk::LoadOp_Load } },
+				.readBuffers = { overdrawCounter->getBuffer() },
+				.execute = [&](lvk::ICommandBuffer& buf, const lvk::Framebuffer& framebuffer) {
+					bindSceneViewport(buf);
+					buf.cmdBindRenderPipeline(pipelineOverdraw);
+					buf.cmdBindDepthState({});
+					buf.cmdPushConstants(ctx->gpuAddress(bufferPerFrame));
+					buf.cmdDraw(3);
+					if (imgui && !dynamicResolution)
+						drawImGui(buf, framebuffer);
+				},
+				});
+		}
+
+		if (dynamicResolution)
+		{
+			renderGraph.addPass({
+				.name = "Upscale",
+				.color = { {.resource = color, .loadOp = lvk::LoadOp_DontCare } },
+				.reads = { sceneColor },
+				.execute = [&](lvk::ICommandBuffer& buf, const lvk::Framebuffer& framebuffer) {
+					gpuProfiler->pushDebugGroup(buf, "Upscale", 0xff0000ff);
+					const struct
+					{
+						glm::vec2 uvScale;
+						glm::vec2 uvMax;
+						uint32_t texture;
+						uint32_t sampler;
+					} pc = {
+						.uvScale = glm::vec2(float(sceneWidth) / float(width), float(sceneHeight) / float(height)),
+						// half a texel in, so bilinear filtering never reaches past the rendered region
+						.uvMax = glm::vec2((float(sceneWidth) - 0.5f) / float(width), (float(sceneHeight) - 0.5f) / float(height)),
+						.texture = renderGraph.getTexture(sceneColor).index(),
+						.sampler = samplerUpscale.index(),
+					};
+					buf.cmdBindRenderPipeline(pipelineUpscale);
+					buf.cmdBindDepthState({});
+					buf.cmdPushConstants(pc);
+					buf.cmdDraw(3);
+					gpuProfiler->popDebugGroup(buf);
+					if (imgui)
+						drawImGui(buf, framebuffer);
+				},
+				});
+		}
+
+		renderGraph.compile();
+		renderGraph.execute(buf);
+
+		if (useHiZ)
+		{
+			gpuProfiler->pushDebugGroup(buf, "Hi-Z", 0xff00ff00);
+			gpuCulling->buildHiZ(buf, renderGraph.getTexture(depth), width, height, sceneWidth, sceneHeight);
+			gpuProfiler->popDebugGroup(buf);
+		}
+
+		gpuProfiler->popDebugGroup(buf);
+
+		textureManager->update();
+	};
+
+	if (headless.enabled)
+	{
+		std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
+
+		auto renderHeadlessFrame = [&](lvk::ICommandBuffer& buf, lvk::TextureHandle colorTarget, uint32_t w, uint32_t h, double time) {
+			// runHeadless() waits for the previous frame before starting the next one
+			const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (dynamicResolution)
+				resolutionController.update(getFrameCostMs(std::chrono::duration<float, std::milli>(now - lastFrame).count()));
+			lastFrame = now;
+			renderFrame(buf, colorTarget, (int)w, (int)h, time);
+			// runHeadless() waits for every frame, so the readback latency is irrelevant here
+			gpuProfiler->endFrame({});
+		};
+
+		for (cullingMode = 0; cullingMode != eCullingMode_Count; cullingMode++)
+		{
+			const std::string name = std::string("03-ImGui, ") + std::to_string(numInstances) + " instances, " + getCullingModeName(cullingMode) + " culling";
+
+			HeadlessOptions opts = headless;
+			if (!opts.outputImage.empty())
+				opts.outputImage = std::filesystem::path(opts.outputImage).replace_extension().string() + "_" + std::to_string(cullingMode) + ".png";
+
+			lastFrame = std::chrono::steady_clock::now();
+
+			const HeadlessStats stats = runHeadless(*ctx, opts, renderHeadlessFrame);
+			printHeadlessStats(name.c_str(), stats);
+
+			if (cullingMode != eCullingMode_CPU)
+			{
+				uint32_t numVisible = 0;
+				const bool ok = gpuCulling->validate(instanceBoxes, cullingMode == eCullingMode_GPU_HiZ, &numVisible);
+				checksPassed &= ok;
+				printf("[%s] %u of %u instances drawn, CPU reference check %s\n", name.c_str(), numVisible, numInstances, ok ? "passed" : "FAILED");
 			}
 		}
-		ctx->submit(buf, ctx->getCurrentSwapchainTexture());
+		for (const GpuProfiler::ZoneTiming& t : gpuProfiler->getTimings())
+			printf("[03-ImGui] GPU %s: avg %.3f ms\n", t.name.c_str(), t.avgMs);
+
+		// The depth modes with the default culling: the timed run, then one frame with the overdraw counters and the heat map
+		cullingMode = eCullingMode_GPU_HiZ;
+
+		uint64_t imageHashes[eDepthMode_Count] = {};
+
+		for (depthMode = 0; depthMode != eDepthMode_Count; depthMode++)
+		{
+			const std::string name = std::string("03-ImGui, ") + std::to_string(numInstances) + " instances, " + getDepthModeName(depthMode);
+
+			HeadlessOptions opts = headless;
+			if (!opts.outputImage.empty())
+				opts.outputImage = std::filesystem::path(headless.outputImage).replace_extension().string() + "_depth" + std::to_string(depthMode) + ".png";
+
+			lastFrame = std::chrono::steady_clock::now();
+
+			const HeadlessStats stats = runHeadless(*ctx, opts, renderHeadlessFrame);
+			printHeadlessStats(name.c_str(), stats);
+			imageHashes[depthMode] = stats.imageHash;
+
+			// the zone averages converge to the current mode within the run
+			char gpuTimes[256] = "";
+			int length = 0;
+			for (const char* zone : { "Frame", "Depth prepass", "Mesh", "Skybox" })
+			{
+				const GpuProfiler::ZoneTiming* t = findGpuZone(zone);
+				if (t && (depthMode == eDepthMode_Prepass || strcmp(zone, "Depth prepass")))
+					length += snprintf(gpuTimes + length, sizeof(gpuTimes) - length, "%s%s %.3f ms", length ? ", " : "", zone, t->avgMs);
+			}
+			if (length)
+				printf("[%s] GPU: %s\n", name.c_str(), gpuTimes);
+
+			if (!opts.outputImage.empty())
+				opts.outputImage = std::filesystem::path(headless.outputImage).replace_extension().string() + "_overdraw" + std::to_string(depthMode) + ".png";
+			opts.numFrames = 1;
+
+			showOverdraw = true;
+			runHeadless(*ctx, opts, renderHeadlessFrame);
+			showOverdraw = false;
+
+			const OverdrawStats o = overdrawCounter->readback(lastSceneWidth, lastSceneHeight);
+			printf("[%s] Overdraw: %.3f shaded fragments per pixel, %.1f%% of pixels shaded more than once, max %u\n", name.c_str(),
+				o.getAvgPerPixel(), 100.0f * o.numPixelsShadedMoreThanOnce / std::max(o.numPixels, 1u), o.maxPerPixel);
+		}
+
+		// the depth modes change the order of the work, not the image
+		if (!dynamicResolution)
+		{
+			const bool same = std::all_of(imageHashes, imageHashes + eDepthMode_Count, [&](uint64_t h) { return h == imageHashes[0]; });
+			printf("[03-ImGui] Depth modes: images %s\n", same ? "identical" : "DIFFERENT");
+			checksPassed &= same;
+		}
+
+		if (dynamicResolution)
+		{
+			const DynamicResolutionStats r = resolutionController.getStats();
+			printf("[03-ImGui] Dynamic resolution: scale %.2f, %.2f ms for %.2f ms target, %.0f%% of frames within the range, %.0f%% over budget, %u changes\n",
+				r.scale, r.avgFrameMs, resolutionController.getSettings().targetFrameMs, 100.0f * r.numFramesInRange / std::max(r.numFrames, 1u),
+				100.0f * r.numFramesOverBudget / std::max(r.numFrames, 1u), r.numChanges);
+		}
+
+		const TextureResidencyStats s = textureManager->getStats();
+		printf("[03-ImGui] Textures: %u, %llu of %llu bytes resident, budget %llu, %u mips evicted, %u reloads, %u failed loads\n", s.numTextures,
+			(unsigned long long)s.residentBytes, (unsigned long long)s.fullBytes, (unsigned long long)s.budgetBytes, s.numEvictions, s.numReloads,
+			s.numLoadFailures);
+	}
+	else
+	{
+		imgui = std::make_unique<lvk::ImGuiRenderer>(*ctx, "../../../fonts/OpenSans-Light.ttf", 30.0f);
+
+		glfwSetCursorPosCallback(window, [](auto* window, double x, double y) { ImGui::GetIO().MousePos = ImVec2(x, y); });
+		glfwSetMouseButtonCallback(window, [](auto* window, int button, int action, int mods) {
+			double xpos, ypos;
+			glfwGetCursorPos(window, &xpos, &ypos);
+			const ImGuiMouseButton_ imguiButton = (button == GLFW_MOUSE_BUTTON_LEFT)
+				? ImGuiMouseButton_Left
+				: (button == GLFW_MOUSE_BUTTON_RIGHT ? ImGuiMouseButton_Right : ImGuiMouseButton_Middle);
+			ImGuiIO& io = ImGui::GetIO();
+			io.MousePos = ImVec2((float)xpos, (float)ypos);
+			io.MouseDown[imguiButton] = action == GLFW_PRESS;
+			});
+
+		implotCtx = ImPlot::CreateContext();
 	}
 
+	// window loop
+	while (window && !glfwWindowShouldClose(window))
+	{
+		profiler.beginFrame();
+
+		FRAME_PROFILER_ZONE(profiler, eFrameZone_Poll, 0x00ff00);
+		glfwPollEvents();
+		FRAME_PROFILER_ZONE_END(profiler, eFrameZone_Poll);
+
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		if (!width || !height)
+		{
+			// minimized; the frame is still closed, so the next one starts clean
+			profiler.endFrame();
+			continue;
+		}
+
+		lvk::ICommandBuffer& buf = ctx->acquireCommandBuffer();
+
+		FRAME_PROFILER_ZONE(profiler, eFrameZone_Record, 0xffffff);
+		renderFrame(buf, ctx->getCurrentSwapchainTexture(), width, height, glfwGetTime());
+		FRAME_PROFILER_ZONE_END(profiler, eFrameZone_Record);
+
+		FRAME_PROFILER_ZONE(profiler, eFrameZone_Submit, 0xff0000);
+		gpuProfiler->endFrame(ctx->submit(buf, ctx->getCurrentSwapchainTexture()));
+		FRAME_PROFILER_ZONE_END(profiler, eFrameZone_Submit);
+
+		if (dynamicResolution)
+			resolutionController.update(getFrameCostMs(profiler.getFPS() > 0.0f ? 1000.0f / profiler.getFPS() : 0.0f));
+
+		profiler.endFrame();
+	}
+
+	if (implotCtx)
+		ImPlot::DestroyContext(implotCtx);
+
+	gpuProfiler = nullptr;
+	textureManager = nullptr;
+	materialTable = nullptr;
+	gpuCulling = nullptr;
+	overdrawCounter = nullptr;
+	imgui = nullptr;
+
 	vert.reset();
 	frag.reset();
 	vertSkybox.reset();
 	fragSkybox.reset();
+	fragDepthPrepass.reset();
+	fragOverdraw.reset();
 
-	texture.reset();
 	cubemapTex.reset();
-	depthTexture.reset();
+	samplerCube.reset();
 
 	bufferVertices.reset();
 	bufferIndices.reset();
 	bufferPerFrame.reset();
+	bufferInstances.reset();
 
 	pipeline.reset();
 	pipelineSkybox.reset();
+	pipelineDepthPrepass.reset();
+	pipelineOverdraw.reset();
+	pipelineUpscale.reset();
+	vertUpscale.reset();
+	fragUpscale.reset();
+	samplerUpscale.reset();
 
 	ctx.reset();
 
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+
+	return checksPassed ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <lvk/LVK.h>
+
+#include <imgui/imgui.h>
+#include <implot/implot.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#include "fps.h"
+
+enum eFrameZone
+{
+	eFrameZone_Poll,
+	eFrameZone_Update,
+	eFrameZone_Record,
+	eFrameZone_Submit,
+	eFrameZone_Count
+};
+
+inline const char* getFrameZoneName(uint32_t zone)
+{
+	static const char* kNames[] = { "Poll", "Update", "Record", "Submit" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eFrameZone_Count);
+	return zone < eFrameZone_Count ? kNames[zone] : "Unknown";
+}
+
+/// CPU timings of a single frame, in milliseconds
+struct FrameSample
+{
+	uint64_t frameIndex = 0;
+	float frameMs = 0.0f;
+	float zoneMs[eFrameZone_Count] = {};
+};
+
+struct FrameStats
+{
+	float avg = 0.0f;
+	float p50 = 0.0f;
+	float p95 = 0.0f;
+	float p99 = 0.0f;
+	float worst = 0.0f;
+	uint64_t worstFrameIndex = 0;
+};
+
+/// Per-frame telemetry on top of FramesPerSecondCounter. The main thread records frames into a fixed ring;
+/// any other thread (UI, exporters) can take a snapshot without locking. Every slot carries a sequence
+/// number which is odd while the slot is being written, so torn reads are detected and dropped.
+class FrameProfiler
+{
+public:
+	static constexpr uint32_t kCapacity = 1024;
+
+	FrameProfiler()
+	{
+		fpsCounter_.printFPS_ = false;
+	}
+
+	void beginFrame()
+	{
+		current_ = FrameSample{ .frameIndex = numFrames_ };
+		frameStart_ = Clock::now();
+	}
+
+	void beginZone(uint32_t zone)
+	{
+		assert(zone < eFrameZone_Count);
+		zoneStart_[zone] = Clock::now();
+	}
+
+	void endZone(uint32_t zone)
+	{
+		assert(zone < eFrameZone_Count);
+		current_.zoneMs[zone] += toMs(Clock::now() - zoneStart_[zone]);
+	}
+
+	void endFrame()
+	{
+		const Clock::duration frameTime = Clock::now() - frameStart_;
+		current_.frameMs = toMs(frameTime);
+		fpsCounter_.tick(std::chrono::duration<float>(frameTime).count());
+
+		Slot& slot = ring_[numFrames_ % kCapacity];
+		slot.seq.store(2 * numFrames_ + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.sample = current_;
+		slot.seq.store(2 * numFrames_ + 2, std::memory_order_release);
+
+		numFrames_++;
+		head_.store(numFrames_, std::memory_order_release);
+	}
+
+	/// Copies up to `maxFrames` most recent frames, oldest first
+	void snapshot(std::vector<FrameSample>& out, uint32_t maxFrames = kCapacity) const
+	{
+		out.clear();
+
+		const uint64_t head = head_.load(std::memory_order_acquire);
+		const uint64_t count = std::min<uint64_t>({ head, maxFrames, kCapacity });
+
+		out.reserve(count);
+
+		for (uint64_t i = head - count; i != head; i++)
+		{
+			const Slot& slot = ring_[i % kCapacity];
+			const uint64_t seq1 = slot.seq.load(std::memory_order_acquire);
+			const FrameSample sample = slot.sample;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64_t seq2 = slot.seq.load(std::memory_order_relaxed);
+			if (seq1 == seq2 && seq1 == 2 * i + 2)
+				out.push_back(sample);
+		}
+	}
+
+	/// `zone` == eFrameZone_Count selects the whole frame time
+	static FrameStats computeStats(const std::vector<FrameSample>& samples, uint32_t zone = eFrameZone_Count)
+	{
+		FrameStats stats;
+
+		if (samples.empty())
+			return stats;
+
+		std::vector<float> values;
+		values.reserve(samples.size());
+
+		double sum = 0.0;
+
+		for (const FrameSample& s : samples)
+		{
+			const float v = zone < eFrameZone_Count ? s.zoneMs[zone] : s.frameMs;
+			if (v > stats.worst)
+			{
+				stats.worst = v;
+				stats.worstFrameIndex = s.frameIndex;
+			}
+			sum += v;
+			values.push_back(v);
+		}
+
+		stats.avg = float(sum / values.size());
+
+		std::sort(values.begin(), values.end());
+
+		auto percentile = [&values](float p) { return values[std::min(size_t(p * values.size()), values.size() - 1)]; };
+
+		stats.p50 = percentile(0.50f);
+		stats.p95 = percentile(0.95f);
+		stats.p99 = percentile(0.99f);
+
+		return stats;
+	}
+
+	bool exportCSV(const std::filesystem::path& file) const
+	{
+		std::vector<FrameSample> samples;
+		snapshot(samples);
+
+		std::ofstream out = openExportFile(file);
+		if (!out)
+		{
+			LLOGW("Failed to open %s for writing\n", file.string().c_str());
+			return false;
+		}
+
+		out << "frame,frameMs";
+		for (uint32_t z = 0; z != eFrameZone_Count; z++)
+			out << "," << getFrameZoneName(z) << "Ms";
+		out << "\n";
+
+		for (const FrameSample& s : samples)
+		{
+			out << s.frameIndex << "," << s.frameMs;
+			for (uint32_t z = 0; z != eFrameZone_Count; z++)
+				out << "," << s.zoneMs[z];
+			out << "\n";
+		}
+
+		return true;
+	}
+
+	bool exportJSON(const std::filesystem::path& file) const
+	{
+		std::vector<FrameSample> samples;
+		snapshot(samples);
+
+		std::ofstream out = openExportFile(file);
+		if (!out)
+		{
+			LLOGW("Failed to open %s for writing\n", file.string().c_str());
+			return false;
+		}
+
+		auto writeStats = [&out](const char* name, const FrameStats& s) {
+			out << "    \"" << name << "\": { \"avg\": " << s.avg << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99
+				<< ", \"worst\": " << s.worst << ", \"worstFrame\": " << s.worstFrameIndex << " }";
+		};
+
+		out << "{\n  \"stats\": {\n";
+		writeStats("frame", computeStats(samples));
+		for (uint32_t z = 0; z != eFrameZone_Count; z++)
+		{
+			out << ",\n";
+			writeStats(getFrameZoneName(z), computeStats(samples, z));
+		}
+		out << "\n  },\n  \"frames\": [\n";
+
+		for (size_t i = 0; i != samples.size(); i++)
+		{
+			const FrameSample& s = samples[i];
+			out << "    { \"frame\": " << s.frameIndex << ", \"frameMs\": " << s.frameMs;
+			for (uint32_t z = 0; z != eFrameZone_Count; z++)
+				out << ", \"" << getFrameZoneName(z) << "\": " << s.zoneMs[z];
+			out << (i + 1 != samples.size() ? " },\n" : " }\n");
+		}
+		out << "  ]\n}\n";
+
+		return true;
+	}
+
+	/// Requires an active ImGui frame and an ImPlot context. `extraContent` is drawn into the same window.
+	void drawOverlay(const std::function<void()>& extraContent = {}, const char* exportPath = ".cache/frame_profile")
+	{
+		snapshot(overlaySamples_, kOverlayFrames);
+
+		if (!ImGui::Begin("Frame Profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+		{
+			ImGui::End();
+			return;
+		}
+
+		ImGui::Text("FPS : %.1f", fpsCounter_.getFPS());
+
+		if (ImGui::BeginTable("##FrameStats", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit))
+		{
+			for (const char* header : { "Zone", "avg", "p50", "p95", "p99", "worst" })
+				ImGui::TableSetupColumn(header);
+			ImGui::TableHeadersRow();
+
+			auto row = [](const char* name, const FrameStats& s) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(name);
+				for (float v : { s.avg, s.p50, s.p95, s.p99, s.worst })
+				{
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", v);
+				}
+			};
+
+			row("Frame", computeStats(overlaySamples_));
+			for (uint32_t z = 0; z != eFrameZone_Count; z++)
+				row(getFrameZoneName(z), computeStats(overlaySamples_, z));
+
+			ImGui::EndTable();
+		}
+
+		if (extraContent)
+			extraContent();
+
+		if (!overlaySamples_.empty() && ImPlot::BeginPlot("##FrameTimes", ImVec2(600, 220)))
+		{
+			ImPlot::SetupAxes("frame", "ms", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+			const int count = (int)overlaySamples_.size();
+			const int stride = sizeof(FrameSample);
+			ImPlot::PlotLine("Frame", &overlaySamples_[0].frameMs, count, 1.0, 0.0, 0, 0, stride);
+			for (uint32_t z = 0; z != eFrameZone_Count; z++)
+				ImPlot::PlotLine(getFrameZoneName(z), &overlaySamples_[0].zoneMs[z], count, 1.0, 0.0, 0, 0, stride);
+			ImPlot::EndPlot();
+		}
+
+		if (ImGui::Button("Export CSV"))
+			exportCSV(std::string(exportPath) + ".csv");
+		ImGui::SameLine();
+		if (ImGui::Button("Export JSON"))
+			exportJSON(std::string(exportPath) + ".json");
+
+		ImGui::End();
+	}
+
+	float getFPS() const { return fpsCounter_.getFPS(); }
+	uint64_t getNumFrames() const { return numFrames_; }
+
+private:
+	/// The default export path is under .cache, which nothing else creates
+	static std::ofstream openExportFile(const std::filesystem::path& file)
+	{
+		std::error_code ec;
+		if (file.has_parent_path())
+			std::filesystem::create_directories(file.parent_path(), ec);
+		return std::ofstream(file);
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr uint32_t kOverlayFrames = 300;
+
+	static float toMs(Clock::duration d)
+	{
+		return std::chrono::duration<float, std::milli>(d).count();
+	}
+
+	struct Slot
+	{
+		std::atomic<uint64_t> seq = 0;
+		FrameSample sample;
+	};
+
+	FramesPerSecondCounter fpsCounter_;
+
+	std::array<Slot, kCapacity> ring_;
+	std::atomic<uint64_t> head_ = 0;
+	uint64_t numFrames_ = 0;
+
+	FrameSample current_;
+	Clock::time_point frameStart_;
+	Clock::time_point zoneStart_[eFrameZone_Count];
+
+	std::vector<FrameSample> overlaySamples_;
+};
+
+/// Opens an LVK profiler zone (Tracy, when enabled) and times it in the FrameProfiler.
+/// Like LVK_PROFILER_ZONE, this opens a new scope which is closed by FRAME_PROFILER_ZONE_END.
+#define FRAME_PROFILER_ZONE(profiler, zone, color) \
+	LVK_PROFILER_ZONE(getFrameZoneName(zone), color); \
+	(profiler).beginZone(zone)
+
+#define FRAME_PROFILER_ZONE_END(profiler, zone) \
+	(profiler).endZone(zone); \
+	LVK_PROFILER_ZONE_END()
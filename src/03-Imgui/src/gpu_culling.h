@@ -0,0 +1,360 @@
+#pragma once
+
+#include <lvk/LVK.h>
+#include <lvk/vulkan/VulkanClasses.h>
+#include <minilog/minilog.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "UtilsMath.h"
+#include "shader_processor.h"
+
+enum eCullingMode
+{
+	// isBoxInFrustum() for every instance and one cmdDrawIndexed() per visible instance
+	eCullingMode_CPU,
+	// cull.comp writes the draws, one cmdDrawIndexedIndirectCount() for everything
+	eCullingMode_GPU,
+	// as above, plus the occlusion test against the Hi-Z pyramid of the previous frame
+	eCullingMode_GPU_HiZ,
+	eCullingMode_Count
+};
+
+inline const char* getCullingModeName(uint32_t mode)
+{
+	static const char* kNames[] = { "CPU", "GPU", "GPU + Hi-Z" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eCullingMode_Count);
+	return mode < eCullingMode_Count ? kNames[mode] : "Unknown";
+}
+
+/// The CPU reference of cull.comp without the occlusion test; returns the indices of the visible instances
+inline std::vector<uint32_t> cullInstancesCPU(const std::vector<BoundingBox>& boxes, const glm::mat4& viewProj)
+{
+	vec4 planes[6];
+	vec4 corners[8];
+	getFrustumPlanes(viewProj, planes);
+	getFrustumCorners(viewProj, corners);
+
+	std::vector<uint32_t> visible;
+	visible.reserve(boxes.size());
+
+	for (uint32_t i = 0; i != boxes.size(); i++)
+	{
+		if (isBoxInFrustum(planes, corners, boxes[i]))
+			visible.push_back(i);
+	}
+
+	return visible;
+}
+
+/// Compute dispatches in LVK only synchronize with earlier graphics work, so back-to-back compute passes need this
+inline void computeToComputeBarrier(lvk::ICommandBuffer& buf)
+{
+	const VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+	vkCmdPipelineBarrier(static_cast<lvk::CommandBuffer&>(buf).getVkCommandBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+/// Frustum and Hi-Z occlusion culling of instances on the GPU. The recorded work does not depend on the number of instances:
+/// one dispatch for culling, one dispatch per Hi-Z level, and the caller draws everything with a single indirect draw.
+class GpuCulling
+{
+public:
+	static constexpr uint32_t kMaxHiZLevels = 16;
+
+	GpuCulling(const std::unique_ptr<lvk::IContext>& ctx, const std::vector<BoundingBox>& boxes, uint32_t numIndices, bool readable = false)
+		: ctx_(*ctx)
+		, numInstances_((uint32_t)boxes.size())
+		, numIndices_(numIndices)
+	{
+		compCull_ = loadShaderModule(ctx, "../../../shaders/03-ImGui/cull.comp");
+		compHiZ_ = loadShaderModule(ctx, "../../../shaders/03-ImGui/hiz.comp");
+		pipelineCull_ = ctx_.createComputePipeline({ .smComp = compCull_, .debugName = "Pipeline: instance culling" });
+		pipelineHiZ_ = ctx_.createComputePipeline({ .smComp = compHiZ_, .debugName = "Pipeline: Hi-Z" });
+
+		// vec3 is padded to 16 bytes in std430
+		std::vector<glm::vec4> gpuBoxes;
+		gpuBoxes.reserve(boxes.size() * 2);
+		for (const BoundingBox& b : boxes)
+		{
+			gpuBoxes.push_back(vec4(b.min_, 1.0f));
+			gpuBoxes.push_back(vec4(b.max_, 1.0f));
+		}
+
+		bufferBoxes_ = ctx_.createBuffer({
+			.usage = lvk::BufferUsageBits_Storage,
+			.storage = lvk::StorageType_Device,
+			.size = sizeof(glm::vec4) * gpuBoxes.size(),
+			.data = gpuBoxes.data(),
+			.debugName = "Buffer: instance bounding boxes",
+			});
+		bufferCullData_ = ctx_.createBuffer({
+			.usage = lvk::BufferUsageBits_Storage,
+			.storage = lvk::StorageType_Device,
+			.size = sizeof(CullData),
+			.debugName = "Buffer: cull data",
+			});
+		// host visible only when the results are read back for validation
+		bufferDrawCommands_ = ctx_.createBuffer({
+			.usage = lvk::BufferUsageBits_Storage | lvk::BufferUsageBits_Indirect,
+			.storage = readable ? lvk::StorageType_HostVisible : lvk::StorageType_Device,
+			.size = sizeof(DrawIndexedIndirectCommand) * std::max(numInstances_, 1u),
+			.debugName = "Buffer: indirect draws",
+			});
+		bufferDrawCount_ = ctx_.createBuffer({
+			.usage = lvk::BufferUsageBits_Storage | lvk::BufferUsageBits_Indirect,
+			.storage = readable ? lvk::StorageType_HostVisible : lvk::StorageType_Device,
+			.size = sizeof(uint32_t),
+			.debugName = "Buffer: indirect draw count",
+			});
+	}
+
+	/// Records the culling dispatch. Must be called outside of rendering.
+	void cull(lvk::ICommandBuffer& buf, const glm::mat4& viewProj, bool useHiZ)
+	{
+		CullData data = {
+			.prevViewProj = prevViewProj_,
+			.numInstances = numInstances_,
+			.numIndices = numIndices_,
+			.hizEnabled = useHiZ && hizValid_ ? 1u : 0u,
+			.hizLevels = numHiZLevels_,
+			.hizWidth = numHiZLevels_ ? hizLevels_[0].width : 0,
+			.hizHeight = numHiZLevels_ ? hizLevels_[0].height : 0,
+		};
+		getFrustumPlanes(viewProj, data.frustumPlanes);
+		getFrustumCorners(viewProj, data.frustumCorners);
+		for (uint32_t i = 0; i != numHiZLevels_; i++)
+		{
+			data.hizOffsets[i] = hizLevels_[i].offset;
+			data.hizStrides[i] = hizLevels_[i].stride;
+		}
+
+		viewProj_ = viewProj;
+
+		const struct
+		{
+			uint64_t cullData;
+			uint64_t boxes;
+			uint64_t hiz;
+			uint64_t drawCommands;
+			uint64_t drawCount;
+		} pc = {
+			.cullData = ctx_.gpuAddress(bufferCullData_),
+			.boxes = ctx_.gpuAddress(bufferBoxes_),
+			.hiz = bufferHiZ_.valid() ? ctx_.gpuAddress(bufferHiZ_) : 0,
+			.drawCommands = ctx_.gpuAddress(bufferDrawCommands_),
+			.drawCount = ctx_.gpuAddress(bufferDrawCount_),
+		};
+
+		buf.cmdUpdateBuffer(bufferCullData_, data);
+		buf.cmdUpdateBuffer(bufferDrawCount_, 0u);
+
+		buf.cmdPushDebugGroupLabel("Instance culling", 0xff00ff00);
+		if (data.hizEnabled)
+			computeToComputeBarrier(buf);
+		buf.cmdBindComputePipeline(pipelineCull_);
+		buf.cmdPushConstants(pc);
+		buf.cmdDispatchThreadGroups({ .width = (numInstances_ + 63) / 64 }, { .buffers = { lvk::BufferHandle(bufferCullData_), lvk::BufferHandle(bufferDrawCount_) } });
+		buf.cmdPopDebugGroupLabel();
+	}
+
+	/// Reduces the top-left `regionWidth` x `regionHeight` texels of `depthTexture` (`width` x `height`, needs TextureUsageBits_Sampled)
+	/// into the Hi-Z pyramid used by the next cull() call. The pyramid is allocated for the whole texture, so a smaller region
+	/// (dynamic resolution) reuses it and keeps it valid; only a new texture size reallocates it.
+	void buildHiZ(lvk::ICommandBuffer& buf, lvk::TextureHandle depthTexture, uint32_t width, uint32_t height, uint32_t regionWidth,
+		uint32_t regionHeight)
+	{
+		if (width != depthWidth_ || height != depthHeight_)
+			resizeHiZ(width, height);
+
+		regionWidth = std::clamp(regionWidth, 1u, width);
+		regionHeight = std::clamp(regionHeight, 1u, height);
+
+		// the levels of the region are stored in the top-left corners of the levels allocated for the whole texture
+		numHiZLevels_ = 0;
+		for (uint32_t w = regionWidth, h = regionHeight; (w > 1 || h > 1) && numHiZLevels_ != hizLevels_.size(); numHiZLevels_++)
+		{
+			w = std::max(1u, w / 2);
+			h = std::max(1u, h / 2);
+			hizLevels_[numHiZLevels_].width = w;
+			hizLevels_[numHiZLevels_].height = h;
+		}
+
+		buf.cmdPushDebugGroupLabel("Hi-Z", 0xff00ff00);
+		buf.cmdBindComputePipeline(pipelineHiZ_);
+
+		for (uint32_t i = 0; i != numHiZLevels_; i++)
+		{
+			const HiZLevel& dst = hizLevels_[i];
+			const HiZLevel src = i ? hizLevels_[i - 1] : HiZLevel{ .width = regionWidth, .height = regionHeight };
+
+			const struct
+			{
+				uint64_t hiz;
+				uint32_t depthTexture;
+				uint32_t fromDepthTexture;
+				uint32_t srcOffset;
+				uint32_t srcStride;
+				uint32_t srcWidth;
+				uint32_t srcHeight;
+				uint32_t dstOffset;
+				uint32_t dstStride;
+				uint32_t dstWidth;
+				uint32_t dstHeight;
+			} pc = {
+				.hiz = ctx_.gpuAddress(bufferHiZ_),
+				.depthTexture = depthTexture.index(),
+				.fromDepthTexture = i == 0,
+				.srcOffset = src.offset,
+				.srcStride = src.stride,
+				.srcWidth = src.width,
+				.srcHeight = src.height,
+				.dstOffset = dst.offset,
+				.dstStride = dst.stride,
+				.dstWidth = dst.width,
+				.dstHeight = dst.height,
+			};
+
+			if (i)
+				computeToComputeBarrier(buf);
+			buf.cmdPushConstants(pc);
+			buf.cmdDispatchThreadGroups({ .width = (dst.width + 7) / 8, .height = (dst.height + 7) / 8 },
+				{ .textures = { i == 0 ? depthTexture : lvk::TextureHandle() } });
+		}
+
+		buf.cmdPopDebugGroupLabel();
+
+		prevViewProj_ = viewProj_;
+		hizValid_ = true;
+	}
+
+	lvk::BufferHandle getDrawCommands() const { return bufferDrawCommands_; }
+	lvk::BufferHandle getDrawCount() const { return bufferDrawCount_; }
+	uint32_t getNumInstances() const { return numInstances_; }
+
+	/// Reads back the result of the last completed cull() (the buffers must be readable) and compares it with cullInstancesCPU().
+	/// Hi-Z may only remove instances, so the GPU set has to be a subset of the CPU set, and equal to it without Hi-Z.
+	bool validate(const std::vector<BoundingBox>& boxes, bool usedHiZ, uint32_t* outNumVisible = nullptr)
+	{
+		uint32_t count = 0;
+		ctx_.download(bufferDrawCount_, &count, sizeof(count), 0);
+
+		std::vector<DrawIndexedIndirectCommand> draws(std::min(count, numInstances_));
+		if (!draws.empty())
+			ctx_.download(bufferDrawCommands_, draws.data(), sizeof(DrawIndexedIndirectCommand) * draws.size(), 0);
+
+		std::vector<uint32_t> gpu;
+		gpu.reserve(draws.size());
+		for (const DrawIndexedIndirectCommand& d : draws)
+			gpu.push_back(d.firstInstance);
+		std::sort(gpu.begin(), gpu.end());
+
+		const std::vector<uint32_t> cpu = cullInstancesCPU(boxes, viewProj_);
+
+		if (outNumVisible)
+			*outNumVisible = count;
+
+		const bool ok = count <= numInstances_ && std::adjacent_find(gpu.begin(), gpu.end()) == gpu.end() &&
+			(usedHiZ ? std::includes(cpu.begin(), cpu.end(), gpu.begin(), gpu.end()) : gpu == cpu);
+
+		if (!ok)
+			LLOGW("GPU culling mismatch: %u visible on the GPU, %u on the CPU\n", count, (uint32_t)cpu.size());
+
+		return ok;
+	}
+
+private:
+	/// Matches `CullData` in cull.comp
+	struct CullData
+	{
+		glm::vec4 frustumPlanes[6];
+		glm::vec4 frustumCorners[8];
+		glm::mat4 prevViewProj;
+		uint32_t numInstances;
+		uint32_t numIndices;
+		uint32_t hizEnabled;
+		uint32_t hizLevels;
+		uint32_t hizWidth;
+		uint32_t hizHeight;
+		uint32_t hizOffsets[kMaxHiZLevels];
+		uint32_t hizStrides[kMaxHiZLevels];
+	};
+
+	struct DrawIndexedIndirectCommand
+	{
+		uint32_t indexCount;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t firstInstance;
+	};
+
+	struct HiZLevel
+	{
+		uint32_t offset = 0;
+		/// Row pitch, the width of the level allocated for the whole depth texture
+		uint32_t stride = 0;
+		/// Size of the level covering the region of the last buildHiZ()
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	void resizeHiZ(uint32_t width, uint32_t height)
+	{
+		depthWidth_ = width;
+		depthHeight_ = height;
+		hizLevels_.clear();
+		numHiZLevels_ = 0;
+		hizValid_ = false;
+
+		uint32_t offset = 0;
+		uint32_t w = width;
+		uint32_t h = height;
+
+		// level 0 is half the depth buffer, the last level is 1x1
+		while ((w > 1 || h > 1) && hizLevels_.size() != kMaxHiZLevels)
+		{
+			w = std::max(1u, w / 2);
+			h = std::max(1u, h / 2);
+			hizLevels_.push_back({ .offset = offset, .stride = w, .width = w, .height = h });
+			offset += w * h;
+		}
+
+		bufferHiZ_ = ctx_.createBuffer({
+			.usage = lvk::BufferUsageBits_Storage,
+			.storage = lvk::StorageType_Device,
+			.size = sizeof(float) * std::max(offset, 1u),
+			.debugName = "Buffer: Hi-Z",
+			});
+	}
+
+	lvk::IContext& ctx_;
+
+	const uint32_t numInstances_;
+	const uint32_t numIndices_;
+
+	lvk::Holder<lvk::ShaderModuleHandle> compCull_;
+	lvk::Holder<lvk::ShaderModuleHandle> compHiZ_;
+	lvk::Holder<lvk::ComputePipelineHandle> pipelineCull_;
+	lvk::Holder<lvk::ComputePipelineHandle> pipelineHiZ_;
+
+	lvk::Holder<lvk::BufferHandle> bufferBoxes_;
+	lvk::Holder<lvk::BufferHandle> bufferCullData_;
+	lvk::Holder<lvk::BufferHandle> bufferDrawCommands_;
+	lvk::Holder<lvk::BufferHandle> bufferDrawCount_;
+	lvk::Holder<lvk::BufferHandle> bufferHiZ_;
+
+	std::vector<HiZLevel> hizLevels_;
+	uint32_t numHiZLevels_ = 0;
+	uint32_t depthWidth_ = 0;
+	uint32_t depthHeight_ = 0;
+	bool hizValid_ = false;
+
+	glm::mat4 viewProj_ = glm::mat4(1.0f);
+	glm::mat4 prevViewProj_ = glm::mat4(1.0f);
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <lvk/LVK.h>
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/// GPU timestamps around debug groups. Every frame writes its timestamps into its own slice of the query pool;
+/// the slice is read back `latency` frames later, when the GPU is done with it, so nothing ever stalls the pipeline.
+class GpuProfiler
+{
+public:
+	static constexpr uint32_t kMaxZones = 32;
+	static constexpr uint32_t kMaxLatency = 8;
+
+	struct ZoneTiming
+	{
+		std::string name;
+		float lastMs = 0.0f;
+		float avgMs = 0.0f;
+	};
+
+	explicit GpuProfiler(lvk::IContext& ctx)
+		: ctx_(ctx)
+		// LVK lets the CPU run at most one frame per swapchain image ahead of the GPU
+		, latency_(std::clamp(ctx.getNumSwapchainImages() + 1, 2u, kMaxLatency))
+	{
+		lvk::Result result;
+		queryPool_ = ctx_.createQueryPool(kMaxLatency * kMaxZones * 2, "Query pool: GPU profiler", &result);
+
+		if (!result.isOk() || queryPool_.empty())
+		{
+			LLOGW("GPU timestamps are not available: %s\n", result.message);
+			queryPool_ = nullptr;
+		}
+
+		timestampToMs_ = ctx_.getTimestampPeriodToMs();
+	}
+
+	bool isEnabled() const { return queryPool_.valid(); }
+
+	/// Must be called outside of cmdBeginRendering()/cmdEndRendering()
+	void beginFrame(lvk::ICommandBuffer& buf)
+	{
+		if (!isEnabled())
+			return;
+
+		Frame& frame = frames_[frameIndex_ % latency_];
+
+		if (frameIndex_ >= latency_)
+			readback(frame);
+
+		frame.zones.clear();
+		frame.submitHandle = {};
+		stack_.clear();
+
+		buf.cmdResetQueryPool(queryPool_, getFirstQuery(), kMaxZones * 2);
+	}
+
+	/// Opens a debug group and starts timing it
+	void pushDebugGroup(lvk::ICommandBuffer& buf, const char* label, uint32_t colorRGBA = 0xffffffff)
+	{
+		buf.cmdPushDebugGroupLabel(label, colorRGBA);
+
+		if (!isEnabled())
+			return;
+
+		Frame& frame = frames_[frameIndex_ % latency_];
+
+		if (frame.zones.size() == kMaxZones)
+		{
+			LLOGW("GpuProfiler: too many zones, '%s' is not timed\n", label);
+			stack_.push_back(~0u);
+			return;
+		}
+
+		const uint32_t zone = (uint32_t)frame.zones.size();
+		frame.zones.push_back(label);
+		stack_.push_back(zone);
+
+		buf.cmdWriteTimestamp(queryPool_, getFirstQuery() + 2 * zone);
+	}
+
+	void popDebugGroup(lvk::ICommandBuffer& buf)
+	{
+		if (isEnabled())
+		{
+			assert(!stack_.empty());
+			const uint32_t zone = stack_.back();
+			stack_.pop_back();
+			if (zone != ~0u)
+				buf.cmdWriteTimestamp(queryPool_, getFirstQuery() + 2 * zone + 1);
+		}
+
+		buf.cmdPopDebugGroupLabel();
+	}
+
+	/// Pass the handle returned by IContext::submit() for this frame's command buffer
+	void endFrame(lvk::SubmitHandle handle)
+	{
+		if (!isEnabled())
+			return;
+
+		assert(stack_.empty());
+		frames_[frameIndex_ % latency_].submitHandle = handle;
+		frameIndex_++;
+	}
+
+	const std::vector<ZoneTiming>& getTimings() const { return timings_; }
+
+	/// Draws into the current ImGui window
+	void drawOverlay() const
+	{
+		if (!isEnabled())
+		{
+			ImGui::TextUnformatted("GPU timestamps are not supported");
+			return;
+		}
+
+		if (ImGui::BeginTable("##GpuTimings", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit))
+		{
+			for (const char* header : { "GPU pass", "last", "avg" })
+				ImGui::TableSetupColumn(header);
+			ImGui::TableHeadersRow();
+
+			for (const ZoneTiming& t : timings_)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(t.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", t.lastMs);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", t.avgMs);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+private:
+	struct Frame
+	{
+		std::vector<std::string> zones;
+		lvk::SubmitHandle submitHandle;
+	};
+
+	uint32_t getFirstQuery() const { return (frameIndex_ % latency_) * kMaxZones * 2; }
+
+	void readback(const Frame& frame)
+	{
+		if (frame.zones.empty())
+			return;
+
+		// a no-op unless the GPU is more than `latency_` frames behind
+		if (!frame.submitHandle.empty())
+			ctx_.wait(frame.submitHandle);
+
+		uint64_t timestamps[kMaxZones * 2] = {};
+
+		const uint32_t numQueries = (uint32_t)frame.zones.size() * 2;
+
+		if (!ctx_.getQueryPoolResults(queryPool_, getFirstQuery(), numQueries, sizeof(uint64_t) * numQueries, timestamps, sizeof(uint64_t)))
+			return;
+
+		for (size_t i = 0; i != frame.zones.size(); i++)
+		{
+			const float ms = float(double(timestamps[2 * i + 1] - timestamps[2 * i]) * timestampToMs_);
+
+			auto it = std::find_if(timings_.begin(), timings_.end(), [&name = frame.zones[i]](const ZoneTiming& t) { return t.name == name; });
+			if (it == timings_.end())
+			{
+				timings_.push_back({ .name = frame.zones[i], .lastMs = ms, .avgMs = ms });
+				continue;
+			}
+			it->lastMs = ms;
+			it->avgMs = it->avgMs * 0.95f + ms * 0.05f;
+		}
+	}
+
+	lvk::IContext& ctx_;
+	lvk::Holder<lvk::QueryPoolHandle> queryPool_;
+
+	const uint32_t latency_;
+	double timestampToMs_ = 0.0;
+
+	Frame frames_[kMaxLatency];
+	uint64_t frameIndex_ = 0;
+	std::vector<uint32_t> stack_;
+
+	std::vector<ZoneTiming> timings_;
+};
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <lvk/LVK.h>
+#include <minilog/minilog.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "Bitmap.h"
+#include "UtilsCubemap.h"
+#include "shader_processor.h"
+
+#include "stb_image_resize2.h"
+
+enum eIblBackend
+{
+	// the functions from UtilsCubemap.h; the reference for the other backends
+	eIblBackend_CPU,
+	// equirect_to_cross.comp and convolve_env.comp through LVK compute pipelines
+	eIblBackend_GPU,
+	eIblBackend_Count
+};
+
+inline const char* getIblBackendName(uint32_t backend)
+{
+	static const char* kNames[] = { "CPU", "GPU" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eIblBackend_Count);
+	return backend < eIblBackend_Count ? kNames[backend] : "Unknown";
+}
+
+/// Environment map baking with a selectable backend. The interface mirrors UtilsCubemap.h, so callers only pick the backend.
+/// The GPU backend submits and waits for every bake; it is meant for load time and offline baking, not for the frame loop.
+class IblBaker
+{
+public:
+	/// Without a context every bake runs on the CPU
+	IblBaker(const std::unique_ptr<lvk::IContext>& ctx, eIblBackend backend)
+		: ctx_(ctx.get())
+		, backend_(ctx ? backend : eIblBackend_CPU)
+	{
+		if (backend_ != eIblBackend_GPU)
+			return;
+
+		compCross_ = loadShaderModule(ctx, "../../../shaders/03-ImGui/equirect_to_cross.comp");
+		compConvolve_ = loadShaderModule(ctx, "../../../shaders/03-ImGui/convolve_env.comp");
+		pipelineCross_ = ctx_->createComputePipeline({ .smComp = compCross_, .debugName = "Pipeline: equirect to cross" });
+		pipelineConvolve_ = ctx_->createComputePipeline({ .smComp = compConvolve_, .debugName = "Pipeline: convolve environment" });
+	}
+
+	eIblBackend getBackend() const { return backend_; }
+
+	Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& b)
+	{
+		if (backend_ == eIblBackend_CPU || b.type_ != eBitmapType_2D)
+			return ::convertEquirectangularMapToVerticalCross(b);
+
+		const uint32_t faceSize = b.w_ / 4;
+
+		Bitmap result(faceSize * 3, faceSize * 4, b.comp_, b.fmt_);
+
+		std::vector<glm::vec4> texels = toTexels(b);
+		// the texels outside of the cross stay black, as on the CPU
+		std::vector<glm::vec4> out(size_t(result.w_) * result.h_, glm::vec4(0.0f));
+
+		const struct
+		{
+			uint64_t src;
+			uint64_t dst;
+			uint32_t srcWidth;
+			uint32_t srcHeight;
+			uint32_t faceSize;
+		} pc = {
+			.srcWidth = (uint32_t)b.w_,
+			.srcHeight = (uint32_t)b.h_,
+			.faceSize = faceSize,
+		};
+
+		dispatch(pipelineCross_, pc, texels, out, { .width = (faceSize + 7) / 8, .height = (faceSize + 7) / 8, .depth = 6 });
+
+		for (int y = 0; y != result.h_; y++)
+			for (int x = 0; x != result.w_; x++)
+				result.setPixel(x, y, out[y * result.w_ + x]);
+
+		return result;
+	}
+
+	Bitmap convertEquirectangularMapToCubeMapFaces(const Bitmap& b)
+	{
+		return convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCross(b));
+	}
+
+	void convolveLambertian(const glm::vec3* data, int srcW, int srcH, int dstW, int dstH, glm::vec3* output, int numMonteCarloSamples)
+	{
+		if (backend_ == eIblBackend_CPU)
+			::convolveLambertian(data, srcW, srcH, dstW, dstH, output, numMonteCarloSamples);
+		else
+			convolveGPU(data, srcW, srcH, dstW, dstH, output, numMonteCarloSamples);
+	}
+
+	void convolveGGX(const glm::vec3* data, int srcW, int srcH, int dstW, int dstH, glm::vec3* output, int numMonteCarloSamples)
+	{
+		if (backend_ == eIblBackend_CPU)
+			::convolveGGX(data, srcW, srcH, dstW, dstH, output, numMonteCarloSamples);
+		else
+			convolveGPU(data, srcW, srcH, dstW, dstH, output, numMonteCarloSamples);
+	}
+
+private:
+	static std::vector<glm::vec4> toTexels(const Bitmap& b)
+	{
+		std::vector<glm::vec4> texels(size_t(b.w_) * b.h_);
+		for (int y = 0; y != b.h_; y++)
+			for (int x = 0; x != b.w_; x++)
+				texels[y * b.w_ + x] = b.getPixel(x, y);
+		return texels;
+	}
+
+	/// `pc` starts with the addresses of the source and the destination buffers, which are filled in here
+	template <typename PushConstants>
+	void dispatch(lvk::ComputePipelineHandle pipeline, PushConstants pc, const std::vector<glm::vec4>& src, std::vector<glm::vec4>& dst, const lvk::Dimensions& groups)
+	{
+		lvk::Holder<lvk::BufferHandle> bufferSrc = ctx_->createBuffer({
+			.usage = lvk::BufferUsageBits_Storage,
+			.storage = lvk::StorageType_Device,
+			.size = sizeof(glm::vec4) * src.size(),
+			.data = src.data(),
+			.debugName = "Buffer: IBL source",
+			});
+		lvk::Holder<lvk::BufferHandle> bufferDst = ctx_->createBuffer({
+			.usage = lvk::BufferUsageBits_Storage,
+			.storage = lvk::StorageType_HostVisible,
+			.size = sizeof(glm::vec4) * dst.size(),
+			.data = dst.data(),
+			.debugName = "Buffer: IBL result",
+			});
+
+		pc.src = ctx_->gpuAddress(bufferSrc);
+		pc.dst = ctx_->gpuAddress(bufferDst);
+
+		lvk::ICommandBuffer& buf = ctx_->acquireCommandBuffer();
+		buf.cmdBindComputePipeline(pipeline);
+		buf.cmdPushConstants(pc);
+		buf.cmdDispatchThreadGroups(groups);
+		ctx_->wait(ctx_->submit(buf));
+
+		ctx_->download(bufferDst, dst.data(), sizeof(glm::vec4) * dst.size(), 0);
+	}
+
+	void convolveGPU(const glm::vec3* data, int srcW, int srcH, int dstW, int dstH, glm::vec3* output, int numMonteCarloSamples)
+	{
+		// only equirectangular maps are supported
+		if (srcW != 2 * srcH)
+			return;
+
+		// the downsampling stays on the CPU, so both backends convolve exactly the same texels
+		std::vector<glm::vec3> tmp(dstW * dstH);
+		stbir_resize(reinterpret_cast<const float*>(data), srcW, srcH, 0, reinterpret_cast<float*>(tmp.data()), dstW, dstH, 0, STBIR_RGB,
+			STBIR_TYPE_FLOAT, STBIR_EDGE_WRAP, STBIR_FILTER_CUBICBSPLINE);
+
+		std::vector<glm::vec4> texels(tmp.size());
+		for (size_t i = 0; i != tmp.size(); i++)
+			texels[i] = glm::vec4(tmp[i], 1.0f);
+
+		std::vector<glm::vec4> out(texels.size());
+
+		const struct
+		{
+			uint64_t src;
+			uint64_t dst;
+			uint32_t width;
+			uint32_t height;
+			uint32_t numSamples;
+		} pc = {
+			.width = (uint32_t)dstW,
+			.height = (uint32_t)dstH,
+			.numSamples = (uint32_t)numMonteCarloSamples,
+		};
+
+		dispatch(pipelineConvolve_, pc, texels, out, { .width = uint32_t(dstW + 15) / 16, .height = uint32_t(dstH + 15) / 16 });
+
+		for (size_t i = 0; i != out.size(); i++)
+			output[i] = glm::vec3(out[i]);
+	}
+
+	lvk::IContext* ctx_ = nullptr;
+	const eIblBackend backend_;
+
+	lvk::Holder<lvk::ShaderModuleHandle> compCross_;
+	lvk::Holder<lvk::ShaderModuleHandle> compConvolve_;
+	lvk::Holder<lvk::ComputePipelineHandle> pipelineCross_;
+	lvk::Holder<lvk::ComputePipelineHandle> pipelineConvolve_;
+};
+
+struct IblComparison
+{
+	const char* name = "";
+	float maxError = 0.0f;
+	float meanError = 0.0f;
+	double cpuMs = 0.0;
+	double gpuMs = 0.0;
+	bool passed = false;
+};
+
+/// Errors are relative to the reference value, but absolute below 1, so black texels do not blow them up.
+/// The mean error catches systematic differences; the max error allows for the odd Monte Carlo sample which falls on
+/// the other side of the cosine lobe cut-off on the two backends.
+constexpr float kIblMeanErrorTolerance = 1e-3f;
+constexpr float kIblMaxErrorTolerance = 5e-2f;
+
+inline IblComparison compareIblTexels(const char* name, const float* reference, const float* result, size_t numFloats)
+{
+	IblComparison c = { .name = name };
+
+	double sum = 0.0;
+
+	for (size_t i = 0; i != numFloats; i++)
+	{
+		const float error = std::abs(result[i] - reference[i]) / std::max(1.0f, std::abs(reference[i]));
+		// NaN fails the check
+		c.maxError = std::isnan(error) ? INFINITY : std::max(c.maxError, error);
+		sum += error;
+	}
+
+	c.meanError = numFloats ? float(sum / double(numFloats)) : 0.0f;
+	c.passed = c.maxError <= kIblMaxErrorTolerance && c.meanError <= kIblMeanErrorTolerance;
+
+	return c;
+}
+
+/// Bakes `equirect` (float, 2:1) with both backends and compares the GPU results with the CPU reference.
+/// The convolutions run at `convolutionWidth` x `convolutionWidth/2` to keep the CPU side short.
+inline std::vector<IblComparison> compareIblBackends(
+	const std::unique_ptr<lvk::IContext>& ctx, const Bitmap& equirect, int convolutionWidth = 64, int numMonteCarloSamples = 256)
+{
+	using Clock = std::chrono::steady_clock;
+
+	auto ms = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+	IblBaker cpu(ctx, eIblBackend_CPU);
+	IblBaker gpu(ctx, eIblBackend_GPU);
+
+	std::vector<IblComparison> results;
+
+	{
+		Clock::time_point start = Clock::now();
+		const Bitmap ref = cpu.convertEquirectangularMapToVerticalCross(equirect);
+		const double cpuMs = ms(start);
+		start = Clock::now();
+		const Bitmap res = gpu.convertEquirectangularMapToVerticalCross(equirect);
+		const double gpuMs = ms(start);
+
+		const bool sameSize = ref.data_.size() == res.data_.size() && equirect.fmt_ == eBitmapFormat_Float;
+		results.push_back(sameSize ? compareIblTexels("equirect to cross", reinterpret_cast<const float*>(ref.data_.data()),
+										 reinterpret_cast<const float*>(res.data_.data()), ref.data_.size() / sizeof(float))
+								   : IblComparison{ .name = "equirect to cross", .maxError = INFINITY, .meanError = INFINITY });
+		results.back().cpuMs = cpuMs;
+		results.back().gpuMs = gpuMs;
+	}
+
+	std::vector<glm::vec3> src(size_t(equirect.w_) * equirect.h_);
+	for (int y = 0; y != equirect.h_; y++)
+		for (int x = 0; x != equirect.w_; x++)
+			src[y * equirect.w_ + x] = glm::vec3(equirect.getPixel(x, y));
+
+	const int dstW = convolutionWidth;
+	const int dstH = convolutionWidth / 2;
+
+	using ConvolveFunc = void (IblBaker::*)(const glm::vec3*, int, int, int, int, glm::vec3*, int);
+
+	const struct
+	{
+		const char* name;
+		ConvolveFunc func;
+	} kConvolutions[] = {
+		{ "Lambertian convolution", &IblBaker::convolveLambertian },
+		{ "GGX convolution", &IblBaker::convolveGGX },
+	};
+
+	for (const auto& conv : kConvolutions)
+	{
+		std::vector<glm::vec3> ref(size_t(dstW) * dstH);
+		std::vector<glm::vec3> res(ref.size());
+
+		Clock::time_point start = Clock::now();
+		(cpu.*conv.func)(src.data(), equirect.w_, equirect.h_, dstW, dstH, ref.data(), numMonteCarloSamples);
+		const double cpuMs = ms(start);
+		start = Clock::now();
+		(gpu.*conv.func)(src.data(), equirect.w_, equirect.h_, dstW, dstH, res.data(), numMonteCarloSamples);
+		const double gpuMs = ms(start);
+
+		results.push_back(compareIblTexels(conv.name, &ref[0].x, &res[0].x, ref.size() * 3));
+		results.back().cpuMs = cpuMs;
+		results.back().gpuMs = gpuMs;
+	}
+
+	return results;
+}
+
+inline bool printIblComparison(const char* name, const std::vector<IblComparison>& results)
+{
+	bool passed = true;
+
+	for (const IblComparison& c : results)
+	{
+		printf("[%s] IBL %s: CPU %.1f ms, GPU %.1f ms, max error %.2e, mean error %.2e, %s\n", name, c.name, c.cpuMs, c.gpuMs, c.maxError,
+			c.meanError, c.passed ? "passed" : "FAILED");
+		passed &= c.passed;
+	}
+
+	return passed;
+}
@@ -3,6 +3,7 @@
 #include <lvk/LVK.h>
 #include <lvk/HelpersImGui.h>
 #include <imgui/imgui.h>
+#include <implot/implot.h>
 
 #include <GLFW/glfw3.h>
 
@@ -14,13 +15,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include <chrono>
 
 #include "shader_processor.h"
+#include "pipeline_library.h"
+#include "frame_profiler.h"
+#include "mapped_file.h"
 
 inline void imGuiExample()
 {
 	minilog::initialize(nullptr, { .threadNames = false });
 
+	const auto startupStart = std::chrono::steady_clock::now();
+
+	const std::vector<uint8_t> pipelineCacheData = loadPipelineCacheData();
+	const char* pipelineCacheState = pipelineCacheData.empty() ? "cold" : "warm";
+
 	GLFWwindow* window = nullptr;
 	std::unique_ptr<lvk::IContext> ctx;
 	{
@@ -29,12 +39,18 @@ inline void imGuiExample()
 		int height = -90;
 
 		window = lvk::initWindow("Imgui", width, height);
-		ctx = lvk::createVulkanContextWithSwapchain(window, width, height, {});
+		ctx = lvk::createVulkanContextWithSwapchain(window, width, height, makeContextConfig(pipelineCacheData));
 		LVK_PROFILER_ZONE_END();
 	}
 
-	lvk::Holder<lvk::ShaderModuleHandle> vert = loadShaderModule(ctx, "../../../shaders/03-ImGui/main.vert");
-	lvk::Holder<lvk::ShaderModuleHandle> frag = loadShaderModule(ctx, "../../../shaders/03-ImGui/main.frag");
+	std::unique_ptr<PipelineLibrary> pipelines = std::make_unique<PipelineLibrary>(*ctx);
+
+	const std::vector<lvk::ShaderModuleHandle> shaders = pipelines->loadShaderModules({
+		"../../../shaders/03-ImGui/main.vert",
+		"../../../shaders/03-ImGui/main.frag",
+		});
+	const lvk::ShaderModuleHandle vert = shaders[0];
+	const lvk::ShaderModuleHandle frag = shaders[1];
 
 	// Imgui
 	std::unique_ptr<lvk::ImGuiRenderer> imgui = std::make_unique<lvk::ImGuiRenderer>(*ctx, "../../../fonts/OpenSans-Light.ttf", 30.0f);
@@ -54,7 +70,7 @@ inline void imGuiExample()
 
 	// Texture loading
 	int w, h, comp;
-	const uint8_t* img = stbi_load("../../../models/rubber_duck/textures/Duck_baseColor.png", &w, &h, &comp, 4);
+	const uint8_t* img = stbiLoadMapped("../../../models/rubber_duck/textures/Duck_baseColor.png", &w, &h, &comp, 4);
 
 	assert(img);
 
@@ -69,14 +85,14 @@ inline void imGuiExample()
 		});
 
 	// pipelines
-	lvk::Holder<lvk::RenderPipelineHandle> pipelineSoild = ctx->createRenderPipeline({
+	const lvk::RenderPipelineHandle pipelineSoild = pipelines->getRenderPipeline({
 			.smVert = vert,
 			.smFrag = frag,
 			.color = { {.format = ctx->getSwapchainFormat() }},
 			.cullMode = lvk::CullMode_Back
 		});
 
-	lvk::Holder<lvk::RenderPipelineHandle> pipelineWireframe = ctx->createRenderPipeline({
+	const lvk::RenderPipelineHandle pipelineWireframe = pipelines->getRenderPipeline({
 			.smVert = vert,
 			.smFrag = frag,
 			.color = { {.format = ctx->getSwapchainFormat() } },
@@ -87,31 +103,52 @@ inline void imGuiExample()
 	LVK_ASSERT(pipelineSoild.valid());
 	LVK_ASSERT(pipelineWireframe.valid());
 
+	ImPlotContext* implotCtx = ImPlot::CreateContext();
+
+	FrameProfiler profiler;
+
+	bool firstFrame = true;
+	// one draw with the edges computed in main.frag, instead of a second PolygonMode_Line draw
+	bool singlePassWireframe = true;
 
 	while (!glfwWindowShouldClose(window))
 	{
+		profiler.beginFrame();
+
+		FRAME_PROFILER_ZONE(profiler, eFrameZone_Poll, 0x00ff00);
 		glfwPollEvents();
+		FRAME_PROFILER_ZONE_END(profiler, eFrameZone_Poll);
+
 		int width, height;
 		glfwGetFramebufferSize(window, &width, &height);
 		if (!width || !height)
+		{
+			// minimized; the frame is still closed, so the next one starts clean
+			profiler.endFrame();
 			continue;
-		const float ratio = width / (float)height;
-
-		const glm::mat4 m = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.5f)), (float)glfwGetTime(), glm::vec3(1.0f, 1.0f, 1.0f));
-		const glm::mat4 p = glm::perspective(45.0f, ratio, 0.1f, 1000.0f);
+		}
 
 		struct PerFrameData
 		{
 			glm::mat4 mvp;
 			int isWireFrame;
-		} pc = {
+		} pc = {};
+
+		FRAME_PROFILER_ZONE(profiler, eFrameZone_Update, 0x0000ff);
+		const float ratio = width / (float)height;
+
+		const glm::mat4 m = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.5f)), (float)glfwGetTime(), glm::vec3(1.0f, 1.0f, 1.0f));
+		const glm::mat4 p = glm::perspective(45.0f, ratio, 0.1f, 1000.0f);
+
+		pc = {
 			.mvp = p * m,
 			.isWireFrame = false
 		};
+		FRAME_PROFILER_ZONE_END(profiler, eFrameZone_Update);
 
 		lvk::ICommandBuffer& buf = ctx->acquireCommandBuffer();
 		{
-			LVK_PROFILER_ZONE("Fill Command Buffer", 0xffffff);
+			FRAME_PROFILER_ZONE(profiler, eFrameZone_Record, 0xffffff);
 			const lvk::Framebuffer framebuffer = {
 			  .color = { {.texture = ctx->getCurrentSwapchainTexture() } },
 			};
@@ -122,19 +159,23 @@ inline void imGuiExample()
 			buf.cmdPushDebugGroupLabel("Soild Cube", 0xff0000ff);
 			{
 				buf.cmdBindRenderPipeline(pipelineSoild);
+				pc.isWireFrame = singlePassWireframe;
 				buf.cmdPushConstants(pc);
 				buf.cmdDraw(36);
 			}
 			buf.cmdPopDebugGroupLabel();
 
-			buf.cmdPushDebugGroupLabel("Wireframe cube", 0xff0000ff);
+			if (!singlePassWireframe)
 			{
-				buf.cmdBindRenderPipeline(pipelineWireframe);
-				pc.isWireFrame = true;
-				buf.cmdPushConstants(pc);
-				buf.cmdDraw(36);
+				buf.cmdPushDebugGroupLabel("Wireframe cube", 0xff0000ff);
+				{
+					buf.cmdBindRenderPipeline(pipelineWireframe);
+					pc.isWireFrame = true;
+					buf.cmdPushConstants(pc);
+					buf.cmdDraw(36);
+				}
+				buf.cmdPopDebugGroupLabel();
 			}
-			buf.cmdPopDebugGroupLabel();
 
 
 			imgui->beginFrame(framebuffer);
@@ -142,22 +183,40 @@ inline void imGuiExample()
 			ImGui::Image(texture.index(), ImVec2(512, 512));
 			ImGui::ShowDemoWindow();
 			ImGui::End();
+			ImGui::Begin("Render mode", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+			ImGui::Checkbox("Single-pass wireframe", &singlePassWireframe);
+			ImGui::End();
+			profiler.drawOverlay();
 			imgui->endFrame(buf);
 
-			LVK_PROFILER_ZONE_END();
+			FRAME_PROFILER_ZONE_END(profiler, eFrameZone_Record);
 
 			buf.cmdEndRendering();
 		}
-		ctx->submit(buf, ctx->getCurrentSwapchainTexture());
+		lvk::SubmitHandle submitHandle;
+		FRAME_PROFILER_ZONE(profiler, eFrameZone_Submit, 0xff0000);
+		submitHandle = ctx->submit(buf, ctx->getCurrentSwapchainTexture());
+		FRAME_PROFILER_ZONE_END(profiler, eFrameZone_Submit);
+
+		if (firstFrame)
+		{
+			ctx->wait(submitHandle);
+			printf("[Imgui] time to first frame: %.1f ms (%s pipeline cache)\n",
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count(), pipelineCacheState);
+			firstFrame = false;
+		}
+
+		profiler.endFrame();
 	}
 
+	ImPlot::DestroyContext(implotCtx);
+
 	imgui = nullptr;
 	texture = nullptr;
 
-	vert.reset();
-	frag.reset();
-	pipelineSoild.reset();
-	pipelineWireframe.reset();
+	pipelines->printStats("Imgui");
+	savePipelineCacheData(*ctx);
+	pipelines = nullptr;
 	ctx.reset();
 
 	glfwDestroyWindow(window);
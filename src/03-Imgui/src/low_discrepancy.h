@@ -0,0 +1,219 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// SSE2 is part of every x86-64 target, so it needs no compiler flags
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define LOW_DISCREPANCY_SSE2 1
+#endif
+
+enum eSequence
+{
+	/// (i / N, radical inverse of i); every prefix is only well distributed for the whole N
+	eSequence_Hammersley,
+	/// The first two dimensions of Sobol: the radical inverse of i and its x + 1 polynomial companion. Any prefix of
+	/// 2^k points is well distributed, so it does not depend on N.
+	eSequence_Sobol,
+	/// Sobol with a random digital shift (an XOR of every coordinate) derived from the seed: a different, equally well
+	/// distributed point set per seed, e.g. to decorrelate the samples of neighbouring texels
+	eSequence_SobolScrambled,
+	eSequence_Count
+};
+
+inline const char* getSequenceName(uint32_t sequence)
+{
+	static const char* kNames[] = { "Hammersley", "Sobol", "Sobol scrambled" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eSequence_Count);
+	return sequence < eSequence_Count ? kNames[sequence] : "Unknown";
+}
+
+/// 2D points in [0, 1)^2 as separate arrays of the two coordinates, which is what SIMD loops over the samples read
+struct SampleSequence
+{
+	eSequence type = eSequence_Hammersley;
+	uint32_t seed = 0;
+	std::vector<float> u;
+	std::vector<float> v;
+
+	uint32_t size() const { return (uint32_t)u.size(); }
+	glm::vec2 operator[](uint32_t i) const { return glm::vec2(u[i], v[i]); }
+};
+
+namespace detail
+{
+
+/// The direction numbers of the second Sobol dimension, x + 1: v[0] = 1/2, v[k] = v[k - 1] ^ (v[k - 1] >> 1)
+inline const uint32_t* getSobolDirections()
+{
+	static const struct Directions
+	{
+		uint32_t v[32];
+		Directions()
+		{
+			v[0] = 1u << 31;
+			for (int k = 1; k != 32; k++)
+				v[k] = v[k - 1] ^ (v[k - 1] >> 1);
+		}
+	} directions;
+	return directions.v;
+}
+
+// PCG hash
+inline uint32_t hashSeed(uint32_t x)
+{
+	const uint32_t state = x * 747796405u + 2891336453u;
+	const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+inline uint32_t reverseBits(uint32_t bits)
+{
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return bits;
+}
+
+inline uint32_t sobolBits(uint32_t i)
+{
+	const uint32_t* v = getSobolDirections();
+	uint32_t bits = 0;
+	for (int k = 0; i; i >>= 1, k++)
+		bits ^= v[k] & (0u - (i & 1u));
+	return bits;
+}
+
+/// bits / 2^32, rounded exactly like radicalInverse_VdC()
+inline float toUnitFloat(uint32_t bits)
+{
+	return float(bits) * 2.3283064365386963e-10f;
+}
+
+#if defined(LOW_DISCREPANCY_SSE2)
+template <int Shift> inline __m128i swapBits4(__m128i x, int mask)
+{
+	const __m128i m = _mm_set1_epi32(mask);
+	return _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, Shift), m), _mm_slli_epi32(_mm_and_si128(x, m), Shift));
+}
+
+inline __m128i reverseBits4(__m128i b)
+{
+	b = _mm_or_si128(_mm_slli_epi32(b, 16), _mm_srli_epi32(b, 16));
+	b = swapBits4<1>(b, 0x55555555);
+	b = swapBits4<2>(b, 0x33333333);
+	b = swapBits4<4>(b, 0x0F0F0F0F);
+	return swapBits4<8>(b, 0x00FF00FF);
+}
+
+/// `numBits` covers the largest of the four indices
+inline __m128i sobolBits4(__m128i i, int numBits)
+{
+	const uint32_t* v = getSobolDirections();
+	const __m128i one = _mm_set1_epi32(1);
+	__m128i bits = _mm_setzero_si128();
+	for (int k = 0; k != numBits; k++, i = _mm_srli_epi32(i, 1))
+	{
+		// all ones in the lanes where bit k of the index is set
+		const __m128i set = _mm_cmpeq_epi32(_mm_and_si128(i, one), one);
+		bits = _mm_xor_si128(bits, _mm_and_si128(set, _mm_set1_epi32((int)v[k])));
+	}
+	return bits;
+}
+
+/// SSE2 converts signed integers only; both 16-bit halves convert exactly and their sum is rounded once, as in toUnitFloat()
+inline __m128 toUnitFloat4(__m128i bits)
+{
+	const __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(bits, 16));
+	const __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(bits, _mm_set1_epi32(0xFFFF)));
+	return _mm_mul_ps(_mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo), _mm_set1_ps(2.3283064365386963e-10f));
+}
+#endif // LOW_DISCREPANCY_SSE2
+
+} // namespace detail
+
+/// Points [first, first + count) of a sequence of `total` points; `total` matters for Hammersley only
+inline void generateSequence(eSequence type, uint32_t first, uint32_t count, uint32_t total, uint32_t seed, float* u, float* v)
+{
+	const uint32_t scrambleU = type == eSequence_SobolScrambled ? detail::hashSeed(2 * seed) : 0;
+	const uint32_t scrambleV = type == eSequence_SobolScrambled ? detail::hashSeed(2 * seed + 1) : 0;
+
+	uint32_t n = 0;
+
+#if defined(LOW_DISCREPANCY_SSE2)
+	// four points at a time
+	const __m128i step = _mm_set1_epi32(4);
+	const __m128i xorU = _mm_set1_epi32((int)scrambleU);
+	const __m128i xorV = _mm_set1_epi32((int)scrambleV);
+	const __m128 simdTotal = _mm_set1_ps(float(total));
+	// the Sobol matrix is applied to the bits the indices actually have
+	int numBits = 0;
+	while (numBits != 32 && (uint64_t(first) + count - 1) >> numBits)
+		numBits++;
+	__m128i index = _mm_add_epi32(_mm_set1_epi32((int)first), _mm_setr_epi32(0, 1, 2, 3));
+	for (; n + 4 <= count; n += 4, index = _mm_add_epi32(index, step))
+	{
+		const __m128i vdc = detail::reverseBits4(index);
+		if (type == eSequence_Hammersley)
+		{
+			// the same division as float(i) / float(N); indices stay far below 2^31
+			_mm_storeu_ps(u + n, _mm_div_ps(_mm_cvtepi32_ps(index), simdTotal));
+			_mm_storeu_ps(v + n, detail::toUnitFloat4(vdc));
+		}
+		else
+		{
+			_mm_storeu_ps(u + n, detail::toUnitFloat4(_mm_xor_si128(vdc, xorU)));
+			_mm_storeu_ps(v + n, detail::toUnitFloat4(_mm_xor_si128(detail::sobolBits4(index, numBits), xorV)));
+		}
+	}
+#endif
+
+	for (; n != count; n++)
+	{
+		const uint32_t i = first + n;
+		if (type == eSequence_Hammersley)
+		{
+			u[n] = float(i) / float(total);
+			v[n] = detail::toUnitFloat(detail::reverseBits(i));
+		}
+		else
+		{
+			u[n] = detail::toUnitFloat(detail::reverseBits(i) ^ scrambleU);
+			v[n] = detail::toUnitFloat(detail::sobolBits(i) ^ scrambleV);
+		}
+	}
+}
+
+/// The whole sequence of `count` points. Sequences are generated once per type, count and seed, and shared by every
+/// convolution which asks for the same one; they are never freed, there are only ever a few sample counts.
+inline std::shared_ptr<const SampleSequence> getSampleSequence(eSequence type, uint32_t count, uint32_t seed = 0)
+{
+	static std::mutex mutex;
+	static std::map<std::tuple<uint32_t, uint32_t, uint32_t>, std::shared_ptr<const SampleSequence>> cache;
+
+	const auto key = std::make_tuple(uint32_t(type), count, type == eSequence_SobolScrambled ? seed : 0u);
+
+	std::lock_guard lock(mutex);
+
+	std::shared_ptr<const SampleSequence>& entry = cache[key];
+	if (!entry)
+	{
+		auto s = std::make_shared<SampleSequence>();
+		s->type = type;
+		s->seed = std::get<2>(key);
+		s->u.resize(count);
+		s->v.resize(count);
+		generateSequence(type, 0, count, count, s->seed, s->u.data(), s->v.data());
+		entry = std::move(s);
+	}
+	return entry;
+}
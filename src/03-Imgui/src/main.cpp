@@ -1,13 +1,44 @@
 #include <iostream>
+#include <cstring>
 
 #include "imgui_chap.h"
 #include "fps.h"
 #include "cubemap.h"
+#include "asset_archive.h"
 
-int main()
+int main(int argc, char** argv)
 {
 	//imGuiExample();
 	//fps_example();
-	cubemap();
-	return 0;
+	// --instances=N draws N copies of the model to stress the culling
+	// --ibl=gpu bakes the environment with compute shaders instead of the CPU
+	// --target-ms=N sets the frame time kept by dynamic resolution, which also turns it on in headless runs
+	// --archive=FILE reads the assets from an archive built by asset_packer (src/Tools) before the loose files
+	uint32_t numInstances = 1;
+	eIblBackend iblBackend = eIblBackend_CPU;
+	float targetFrameMs = 0.0f;
+	const char* archiveFile = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--instances=", 12))
+			numInstances = (uint32_t)std::max(1, atoi(argv[i] + 12));
+		else if (!strcmp(argv[i], "--ibl=gpu"))
+			iblBackend = eIblBackend_GPU;
+		else if (!strncmp(argv[i], "--target-ms=", 12))
+			targetFrameMs = std::max(0.0f, (float)atof(argv[i] + 12));
+		else if (!strncmp(argv[i], "--archive=", 10))
+			archiveFile = argv[i] + 10;
+	}
+
+	// the names in the archive are relative to the root the chapters reach with "../../../"
+	if (archiveFile)
+	{
+		if (std::shared_ptr<AssetArchive> archive = AssetArchive::load(archiveFile, "../../.."))
+		{
+			printf("Mounted %s: %u entries\n", archiveFile, archive->getNumEntries());
+			setFileSource(std::move(archive));
+		}
+	}
+
+	return cubemap(parseHeadlessOptions(argc, argv), numInstances, iblBackend, targetFrameMs);
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <lvk/LVK.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+enum eDepthMode
+{
+	// the skybox covers the screen first, then the mesh shades its pixels again
+	eDepthMode_SkyboxFirst,
+	// the mesh first, then the skybox at depth 1.0 only where the depth buffer is still clear
+	eDepthMode_SkyboxLast,
+	// a depth-only pass for the mesh, then the mesh shades only its visible fragments and the skybox fills the rest
+	eDepthMode_Prepass,
+	eDepthMode_Count
+};
+
+inline const char* getDepthModeName(uint32_t mode)
+{
+	static const char* kNames[] = { "Skybox first", "Skybox last", "Depth prepass" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eDepthMode_Count);
+	return mode < eDepthMode_Count ? kNames[mode] : "Unknown";
+}
+
+struct OverdrawStats
+{
+	uint32_t numPixels = 0;
+	/// Fragment shader invocations which wrote color; depth-only fragments are not counted
+	uint64_t numFragments = 0;
+	uint32_t numPixelsShadedMoreThanOnce = 0;
+	uint32_t maxPerPixel = 0;
+
+	float getAvgPerPixel() const { return numPixels ? float(numFragments) / float(numPixels) : 0.0f; }
+};
+
+/// One counter per pixel, incremented by countOverdraw() in the fragment shaders (see common.sp).
+/// Fragment shaders with side effects lose early depth testing unless they request it with `early_fragment_tests`,
+/// which the shaders of the scene do, so the counters see the same fragments the depth test lets through.
+class OverdrawCounter
+{
+public:
+	explicit OverdrawCounter(const std::unique_ptr<lvk::IContext>& ctx, bool readable = false)
+		: ctx_(*ctx)
+		, readable_(readable)
+	{
+	}
+
+	/// Must be called outside of cmdBeginRendering()/cmdEndRendering(); the buffer grows with the frame size
+	void beginFrame(lvk::ICommandBuffer& buf, uint32_t width, uint32_t height)
+	{
+		width_ = width;
+		height_ = height;
+
+		const size_t size = sizeof(uint32_t) * width * height;
+
+		if (size > capacity_)
+		{
+			capacity_ = size;
+			buffer_ = ctx_.createBuffer({
+				.usage = lvk::BufferUsageBits_Storage,
+				.storage = readable_ ? lvk::StorageType_HostVisible : lvk::StorageType_Device,
+				.size = capacity_,
+				.debugName = "Buffer: overdraw",
+				});
+		}
+
+		buf.cmdFillBuffer(buffer_, 0, size, 0);
+	}
+
+	lvk::BufferHandle getBuffer() const { return buffer_; }
+	uint64_t getAddress() const { return ctx_.gpuAddress(buffer_); }
+	uint32_t getWidth() const { return width_; }
+
+	/// Reads back the counters of the last completed frame (the buffer must be readable); only the top-left
+	/// `width` x `height` pixels are considered, e.g. the region rendered at a reduced resolution
+	OverdrawStats readback(uint32_t width, uint32_t height) const
+	{
+		OverdrawStats s;
+
+		width = std::min(width, width_);
+		height = std::min(height, height_);
+
+		std::vector<uint32_t> counts(size_t(width_) * height_);
+		if (counts.empty())
+			return s;
+		ctx_.download(buffer_, counts.data(), sizeof(uint32_t) * counts.size(), 0);
+
+		for (uint32_t y = 0; y != height; y++)
+		{
+			for (uint32_t x = 0; x != width; x++)
+			{
+				const uint32_t c = counts[size_t(y) * width_ + x];
+				s.numFragments += c;
+				s.numPixelsShadedMoreThanOnce += c > 1;
+				s.maxPerPixel = std::max(s.maxPerPixel, c);
+			}
+		}
+		s.numPixels = width * height;
+
+		return s;
+	}
+
+private:
+	lvk::IContext& ctx_;
+	bool readable_ = false;
+
+	lvk::Holder<lvk::BufferHandle> buffer_;
+	size_t capacity_ = 0;
+	uint32_t width_ = 0;
+	uint32_t height_ = 0;
+};
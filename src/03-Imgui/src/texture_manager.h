@@ -0,0 +1,215 @@
+#pragma once
+
+#include <lvk/LVK.h>
+#include <imgui/imgui.h>
+#include <minilog/minilog.h>
+
+#include <stb/stb_image.h>
+#include "stb_image_resize2.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "texture_residency.h"
+#include "job_system.h"
+#include "mapped_file.h"
+
+/// RGBA8 textures with a full mip chain under a memory budget; the policy lives in TextureResidencyPolicy.
+/// Evictions and reloads both decode the file again in a job and replace the texture once the decode is done,
+/// so the bindless index of a texture changes: fetch it with get() every frame instead of keeping it.
+class TextureManager
+{
+public:
+	TextureManager(const std::unique_ptr<lvk::IContext>& ctx, uint64_t budgetBytes)
+		: ctx_(*ctx)
+		, policy_(budgetBytes)
+	{
+	}
+
+	~TextureManager()
+	{
+		for (Texture& t : textures_)
+		{
+			if (t.job)
+				getJobSystem().wait(t.job->counter);
+		}
+	}
+
+	/// Mips [firstMip, numMips) back to back; `width` and `height` are the size of level 0
+	struct MipChain
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t numLevels = 0;
+		std::vector<uint8_t> data;
+	};
+
+	/// Decodes the file and builds the mips; runs on any thread, so the decode can happen in a job ahead of add()
+	static MipChain decode(std::filesystem::path file, uint32_t firstMip = 0)
+	{
+		MipChain mips;
+
+		int w = 0;
+		int h = 0;
+		int comp = 0;
+		uint8_t* image = stbiLoadMapped(file, &w, &h, &comp, kBytesPerTexel);
+		if (!image)
+			return mips;
+
+		mips.width = (uint32_t)w;
+		mips.height = (uint32_t)h;
+
+		std::vector<uint8_t> level(image, image + size_t(w) * h * kBytesPerTexel);
+		stbi_image_free(image);
+
+		for (uint32_t i = 0;; i++)
+		{
+			if (i >= firstMip)
+			{
+				mips.data.insert(mips.data.end(), level.begin(), level.end());
+				mips.numLevels++;
+			}
+
+			if (w == 1 && h == 1)
+				break;
+
+			const int nextW = std::max(1, w / 2);
+			const int nextH = std::max(1, h / 2);
+			std::vector<uint8_t> next(size_t(nextW) * nextH * kBytesPerTexel);
+			stbir_resize_uint8_linear(level.data(), w, h, 0, next.data(), nextW, nextH, 0, STBIR_RGBA);
+			level = std::move(next);
+			w = nextW;
+			h = nextH;
+		}
+
+		return mips;
+	}
+
+	/// Loads all mips right away; returns ~0u when the file cannot be read
+	uint32_t load(const std::filesystem::path& file)
+	{
+		return add(file, decode(file));
+	}
+
+	/// Creates the texture from the result of decode(file) with all mips; returns ~0u when the decode failed
+	uint32_t add(const std::filesystem::path& file, const MipChain& mips)
+	{
+		if (mips.data.empty())
+		{
+			LLOGW("Failed to load texture %s\n", file.string().c_str());
+			return ~0u;
+		}
+
+		const uint32_t id = policy_.addTexture(getMipSizes(mips.width, mips.height, kBytesPerTexel));
+
+		textures_.push_back({ .file = file });
+		textures_.back().texture = createTexture(mips, 0, file.filename().string());
+
+		return id;
+	}
+
+	/// Marks the texture as used in this frame; an unknown id, e.g. ~0u from a failed add(), gives an empty handle
+	lvk::TextureHandle get(uint32_t id)
+	{
+		if (id >= textures_.size())
+			return {};
+
+		policy_.touch(id);
+		return textures_[id].texture;
+	}
+
+	void setBudget(uint64_t budgetBytes)
+	{
+		policy_.setBudget(budgetBytes);
+	}
+
+	/// Call once per frame after the get() calls of the frame: swaps in finished loads and starts new ones
+	void update()
+	{
+		for (uint32_t id = 0; id != textures_.size(); id++)
+		{
+			Texture& t = textures_[id];
+
+			if (!t.job || !t.job->counter.isDone())
+				continue;
+
+			if (!t.job->mips.data.empty())
+			{
+				// LVK defers the destruction of the old texture until the GPU is done with it
+				t.texture = createTexture(t.job->mips, t.job->firstMip, t.file.filename().string());
+				policy_.onLoaded(id);
+			}
+			else
+			{
+				// the old texture stays, so does its accounting; a later update() requests it again
+				LLOGW("Failed to reload texture %s\n", t.file.string().c_str());
+				policy_.onLoadFailed(id);
+			}
+			t.job = nullptr;
+		}
+
+		for (const TextureResidencyRequest& r : policy_.update())
+		{
+			Texture& t = textures_[r.id];
+			t.job = std::make_unique<Job>();
+			t.job->firstMip = r.firstMip;
+			getJobSystem().run(t.job->counter, [job = t.job.get(), file = t.file]() { job->mips = decode(file, job->firstMip); });
+		}
+	}
+
+	TextureResidencyStats getStats() const { return policy_.getStats(); }
+
+	void drawOverlay()
+	{
+		const TextureResidencyStats s = policy_.getStats();
+
+		constexpr double kMB = 1024.0 * 1024.0;
+
+		ImGui::Text("Textures: %u, %u degraded, %u loading", s.numTextures, s.numDegraded, s.numPending);
+		ImGui::Text("Resident: %.1f of %.1f MB (%.1f MB with all mips)", s.residentBytes / kMB, s.budgetBytes / kMB, s.fullBytes / kMB);
+		ImGui::Text("Mips evicted: %u, reloads: %u, failed loads: %u", s.numEvictions, s.numReloads, s.numLoadFailures);
+
+		int budgetMB = int(s.budgetBytes / (1024 * 1024));
+		if (ImGui::SliderInt("Texture budget, MB", &budgetMB, 0, 512))
+			policy_.setBudget(uint64_t(budgetMB) * 1024 * 1024);
+	}
+
+private:
+	static constexpr uint32_t kBytesPerTexel = 4;
+
+	/// Lives on the heap, so the job can write to it while `textures_` grows
+	struct Job
+	{
+		JobCounter counter;
+		uint32_t firstMip = 0;
+		MipChain mips;
+	};
+
+	struct Texture
+	{
+		std::filesystem::path file;
+		lvk::Holder<lvk::TextureHandle> texture;
+		std::unique_ptr<Job> job;
+	};
+
+	lvk::Holder<lvk::TextureHandle> createTexture(const MipChain& mips, uint32_t firstMip, const std::string& name)
+	{
+		return ctx_.createTexture({
+			.type = lvk::TextureType_2D,
+			.format = lvk::Format_RGBA_UN8,
+			.dimensions = { std::max(1u, mips.width >> firstMip), std::max(1u, mips.height >> firstMip) },
+			.usage = lvk::TextureUsageBits_Sampled,
+			.numMipLevels = mips.numLevels,
+			.data = mips.data.data(),
+			.dataNumMipLevels = mips.numLevels,
+			.debugName = name.c_str(),
+			});
+	}
+
+	lvk::IContext& ctx_;
+	TextureResidencyPolicy policy_;
+	std::vector<Texture> textures_;
+};
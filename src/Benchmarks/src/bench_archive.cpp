@@ -0,0 +1,146 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "asset_archive.h"
+#include "bench_utils.h"
+
+// Startup I/O of 03-ImGui with loose files against one archive, with the page cache warm and cold. Every file is opened
+// and every page of it touched, which is what the loaders do before they parse anything; the decoding is measured in
+// bench_assets.cpp. Cold runs drop the files from the page cache first, so they read from the storage device, where
+// the archive saves an open and a seek per file; the difference grows with the latency of the storage, e.g. network mounts.
+
+enum eLayout
+{
+	eLayout_Loose,
+	eLayout_Archive,
+	eLayout_ArchiveZstd,
+};
+
+static const char* kLayoutNames[] = { "loose", "archive", "archive zstd" };
+
+struct ArchiveFixture
+{
+	std::filesystem::path root = getAssetPath("");
+	std::vector<ArchiveBuildEntry> entries = collectArchiveEntries(root, { "shaders/03-ImGui", "models/rubber_duck", "HDR", "fonts" });
+	std::filesystem::path archives[3];
+	bool built[3] = { true, false, false };
+
+	ArchiveFixture()
+	{
+		std::error_code ec;
+		const std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+		if (ec)
+			return;
+		archives[eLayout_Archive] = dir / "bench_assets.pak";
+		archives[eLayout_ArchiveZstd] = dir / "bench_assets_zstd.pak";
+
+		built[eLayout_Archive] = buildAssetArchive(archives[eLayout_Archive], entries);
+		if (isArchiveCompressionSupported(eArchiveCompression_Zstd))
+			built[eLayout_ArchiveZstd] = buildAssetArchive(archives[eLayout_ArchiveZstd], entries, { .compression = eArchiveCompression_Zstd });
+	}
+
+	// the fixture lives until the process exits, after the last benchmark
+	~ArchiveFixture()
+	{
+		std::error_code ec;
+		std::filesystem::remove(archives[eLayout_Archive], ec);
+		std::filesystem::remove(archives[eLayout_ArchiveZstd], ec);
+	}
+};
+
+static const ArchiveFixture& getArchiveFixture()
+{
+	static const ArchiveFixture fixture;
+	return fixture;
+}
+
+#if !defined(_WIN32)
+static void dropFromPageCache(const std::filesystem::path& file)
+{
+	const int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+#endif
+
+static void BM_StartupIO(benchmark::State& state)
+{
+	const ArchiveFixture& fixture = getArchiveFixture();
+
+	const eLayout layout = (eLayout)state.range(0);
+	const bool cold = state.range(1) != 0;
+
+	state.SetLabel(std::string(kLayoutNames[layout]) + (cold ? ", cold" : ", warm"));
+
+	if (layout == eLayout_ArchiveZstd && !isArchiveCompressionSupported(eArchiveCompression_Zstd))
+	{
+		state.SkipWithError("Built without zstd");
+		return;
+	}
+
+	if (!fixture.built[layout])
+	{
+		state.SkipWithError("Failed to build the archive");
+		return;
+	}
+
+#if defined(_WIN32)
+	if (cold)
+	{
+		state.SkipWithError("Cold runs drop files from the page cache with posix_fadvise()");
+		return;
+	}
+#endif
+
+	uint64_t numBytes = 0;
+
+	for (auto _ : state)
+	{
+#if !defined(_WIN32)
+		if (cold)
+		{
+			state.PauseTiming();
+			if (layout == eLayout_Loose)
+			{
+				for (const ArchiveBuildEntry& e : fixture.entries)
+					dropFromPageCache(e.file);
+			}
+			else
+				dropFromPageCache(fixture.archives[layout]);
+			state.ResumeTiming();
+		}
+#endif
+
+		// mounting is part of the startup
+		if (layout != eLayout_Loose)
+			setFileSource(AssetArchive::load(fixture.archives[layout], fixture.root));
+
+		uint64_t sum = 0;
+		numBytes = 0;
+		for (const ArchiveBuildEntry& e : fixture.entries)
+		{
+			const MappedFile f(e.file, getAssetClassFromPath(e.file));
+			for (size_t i = 0; i < f.size(); i += 4096)
+				sum += f.data()[i];
+			numBytes += f.size();
+		}
+		benchmark::DoNotOptimize(sum);
+
+		setFileSource(nullptr);
+	}
+
+	state.SetBytesProcessed(state.iterations() * numBytes);
+	state.counters["files"] = (double)fixture.entries.size();
+}
+BENCHMARK(BM_StartupIO)->ArgsProduct({ { eLayout_Loose, eLayout_Archive, eLayout_ArchiveZstd }, { 0, 1 } })->ArgNames({ "layout", "cold" })->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,150 @@
+#include <benchmark/benchmark.h>
+
+#include "shader_processor.h"
+#include "model_loader.h"
+#include "mapped_file.h"
+#include "bench_utils.h"
+
+#include <fstream>
+#include <vector>
+
+static void BM_ReadShaderFile(benchmark::State& state)
+{
+	// main_v2.vert pulls in common.sp through #include
+	const fs::path file = getAssetPath("shaders/03-ImGui/main_v2.vert");
+
+	for (auto _ : state)
+	{
+		std::string code = readShaderFile(file);
+		benchmark::DoNotOptimize(code.data());
+	}
+}
+BENCHMARK(BM_ReadShaderFile);
+
+// Only shaders with their own #version: lvk::compileShaderGlslang() compiles the source as it is, while the ones without it,
+// e.g. main_v2.vert, rely on the preamble which only ctx.createShaderModule() adds and cannot be compiled here
+static void BM_CompileShader(benchmark::State& state)
+{
+	static const char* kShaders[] = {
+		"shaders/02-Model/main.vert",
+		"shaders/02-Model/main.frag",
+		"shaders/02-Model/meshlet_cull.comp",
+		"shaders/03-ImGui/main.vert",
+		"shaders/03-ImGui/main.frag",
+	};
+
+	const fs::path file = getAssetPath(kShaders[state.range(0)]);
+	const std::string code = readShaderFile(file);
+	const lvk::ShaderStage stage = shaderStageFromPath(file);
+
+	state.SetLabel(kShaders[state.range(0)]);
+
+	for (auto _ : state)
+	{
+		std::vector<uint8_t> spirv;
+		const lvk::Result result = lvk::compileShaderGlslang(stage, code.c_str(), &spirv, glslang_default_resource());
+		if (!result.isOk())
+		{
+			state.SkipWithError(result.message);
+			break;
+		}
+		benchmark::DoNotOptimize(spirv.data());
+	}
+}
+BENCHMARK(BM_CompileShader)->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
+
+static void BM_LoadModelData(benchmark::State& state)
+{
+	const fs::path file = getAssetPath("models/rubber_duck/scene.gltf");
+
+	for (auto _ : state)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		loadModelData(file, vertices, indices);
+		benchmark::DoNotOptimize(vertices.data());
+		benchmark::DoNotOptimize(indices.data());
+	}
+}
+BENCHMARK(BM_LoadModelData)->Unit(benchmark::kMillisecond);
+
+// Reading a whole file: std::ifstream into a vector, as before, against a mapping of the same file touched page by page
+static void BM_ReadFile(benchmark::State& state)
+{
+	const fs::path file = getAssetPath("HDR/piazza_bologni_1k.hdr");
+	const bool mapped = state.range(0) != 0;
+
+	state.SetLabel(mapped ? "mmap" : "ifstream");
+
+	size_t size = 0;
+
+	for (auto _ : state)
+	{
+		uint64_t sum = 0;
+		if (mapped)
+		{
+			const MappedFile f(file, eAssetClass_Image);
+			size = f.size();
+			for (size_t i = 0; i < size; i += 4096)
+				sum += f.data()[i];
+		}
+		else
+		{
+			std::ifstream in(file, std::ios::binary);
+			const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			size = data.size();
+			for (size_t i = 0; i < size; i += 4096)
+				sum += data[i];
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+
+	state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_ReadFile)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// The decoding half of loadTexture(), without the GPU upload; stb reading through stdio, then from a mapping
+static void BM_DecodeTexture(benchmark::State& state)
+{
+	const fs::path file = getAssetPath("models/rubber_duck/textures/Duck_baseColor.png");
+	const bool mapped = state.range(0) != 0;
+
+	state.SetLabel(mapped ? "mmap" : "stdio");
+
+	int w = 0, h = 0, comp = 0;
+
+	for (auto _ : state)
+	{
+		stbi_uc* image = mapped ? stbiLoadMapped(file, &w, &h, &comp, 4) : stbi_load(file.string().c_str(), &w, &h, &comp, 4);
+		if (!image)
+		{
+			state.SkipWithError("Failed to decode Duck_baseColor.png");
+			break;
+		}
+		stbi_image_free(image);
+	}
+
+	state.SetBytesProcessed(state.iterations() * w * h * 4);
+}
+BENCHMARK(BM_DecodeTexture)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+static void BM_DecodeHDR(benchmark::State& state)
+{
+	const fs::path file = getAssetPath("HDR/piazza_bologni_1k.hdr");
+	const bool mapped = state.range(0) != 0;
+
+	state.SetLabel(mapped ? "mmap" : "stdio");
+
+	for (auto _ : state)
+	{
+		int w, h;
+		float* image = mapped ? stbiLoadfMapped(file, &w, &h, nullptr, 4) : stbi_loadf(file.string().c_str(), &w, &h, nullptr, 4);
+		if (!image)
+		{
+			state.SkipWithError("Failed to decode piazza_bologni_1k.hdr");
+			break;
+		}
+		stbi_image_free(image);
+	}
+}
+BENCHMARK(BM_DecodeHDR)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,329 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+#include "UtilsCubemap.h"
+#include "brdf_lut.h"
+#include "bench_utils.h"
+
+// Equirectangular maps are 2:1, the argument is the width in pixels
+static void BM_EquirectangularToVerticalCross(benchmark::State& state)
+{
+	const int w = (int)state.range(0);
+	const Bitmap in = makeRandomBitmap(w, w / 2, 4, eBitmapFormat_Float);
+
+	for (auto _ : state)
+	{
+		Bitmap out = convertEquirectangularMapToVerticalCross(in);
+		benchmark::DoNotOptimize(out.data_.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * (w / 4) * (w / 4) * 6);
+}
+BENCHMARK(BM_EquirectangularToVerticalCross)->RangeMultiplier(2)->Range(256, 2048)->Unit(benchmark::kMillisecond);
+
+// The argument is the face size in pixels
+static void BM_VerticalCrossToCubeMapFaces(benchmark::State& state)
+{
+	const int faceSize = (int)state.range(0);
+	const Bitmap in = makeRandomBitmap(faceSize * 3, faceSize * 4, 4, eBitmapFormat_Float);
+
+	for (auto _ : state)
+	{
+		Bitmap out = convertVerticalCrossToCubeMapFaces(in);
+		benchmark::DoNotOptimize(out.data_.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * faceSize * faceSize * 6);
+}
+BENCHMARK(BM_VerticalCrossToCubeMapFaces)->RangeMultiplier(2)->Range(64, 512)->Unit(benchmark::kMillisecond);
+
+// The argument is the face size in pixels
+static void BM_GenerateCubeMipChain(benchmark::State& state)
+{
+	const int faceSize = (int)state.range(0);
+	Bitmap in = makeRandomBitmap(faceSize, faceSize * 6, 4, eBitmapFormat_Float);
+	in.w_ = in.h_ = faceSize;
+	in.d_ = 6;
+	in.type_ = eBitmapType_Cube;
+
+	CubeMipChainStats stats;
+
+	for (auto _ : state)
+	{
+		std::vector<Bitmap> levels = generateCubeMipChain(in, &stats);
+		benchmark::DoNotOptimize(levels.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * faceSize * faceSize * 6);
+	state.counters["levels"] = stats.numLevels;
+	state.counters["memoryOverhead"] = double(stats.totalBytes - stats.baseBytes) / double(stats.baseBytes);
+}
+BENCHMARK(BM_GenerateCubeMipChain)->RangeMultiplier(2)->Range(64, 512)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+template <void (*Convolve)(const glm::vec3*, int, int, int, int, glm::vec3*, int)>
+static void BM_Convolve(benchmark::State& state)
+{
+	const int dstW = (int)state.range(0);
+	const int dstH = dstW / 2;
+	const int numSamples = (int)state.range(1);
+
+	const Bitmap in = makeRandomBitmap(1024, 512, 3, eBitmapFormat_Float);
+	std::vector<glm::vec3> out(dstW * dstH);
+
+	for (auto _ : state)
+	{
+		Convolve(reinterpret_cast<const glm::vec3*>(in.data_.data()), in.w_, in.h_, dstW, dstH, out.data(), numSamples);
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * dstW * dstH * numSamples);
+}
+BENCHMARK(BM_Convolve<convolveLambertian>)
+	->Name("BM_ConvolveLambertian")
+	->ArgsProduct({ { 64, 128, 256 }, { 64, 256, 1024 } })
+	->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Convolve<convolveGGX>)
+	->Name("BM_ConvolveGGX")
+	->ArgsProduct({ { 64, 128, 256 }, { 64, 256, 1024 } })
+	->Unit(benchmark::kMillisecond);
+
+// A dim sky over a dark ground with a small sun 50000 times brighter than the sky: the case uniform sampling handles worst
+static Bitmap makeSunBitmap(int w, int h)
+{
+	Bitmap b(w, h, 3, eBitmapFormat_Float);
+
+	const glm::vec3 sun = glm::normalize(glm::vec3(0.5f, 0.3f, 0.8f));
+
+	for (int y = 0; y != h; y++)
+	{
+		const float theta = (float(y) + 0.5f) / float(h) * 3.14159265f;
+		for (int x = 0; x != w; x++)
+		{
+			const float phi = (float(x) + 0.5f) / float(w) * 6.28318531f;
+			const glm::vec3 dir(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+			glm::vec3 c = dir.z > 0.0f ? glm::vec3(0.3f, 0.5f, 1.0f) * (0.5f + 0.5f * dir.z) : glm::vec3(0.05f);
+			if (glm::dot(dir, sun) > 0.9998f)
+				c = glm::vec3(50000.0f, 45000.0f, 40000.0f);
+			b.setPixel(x, y, glm::vec4(c, 1.0f));
+		}
+	}
+
+	return b;
+}
+
+// The exact cosine-weighted average around every output direction: a sum over all texels of the source
+static std::vector<glm::vec3> convolveLambertianExact(const Bitmap& src, int dstW, int dstH)
+{
+	std::vector<glm::vec3> out(size_t(dstW) * dstH);
+
+	const float texelSolidAngle = (6.28318531f / float(src.w_)) * (3.14159265f / float(src.h_));
+
+	for (int v = 0; v != dstH; v++)
+	{
+		for (int u = 0; u != dstW; u++)
+		{
+			const float theta1 = float(v) / float(dstH) * 3.14159265f;
+			const float phi1 = float(u) / float(dstW) * 6.28318531f;
+			const glm::vec3 n(sin(theta1) * cos(phi1), sin(theta1) * sin(phi1), cos(theta1));
+			double sum[3] = {};
+			for (int y = 0; y != src.h_; y++)
+			{
+				const float theta = (float(y) + 0.5f) / float(src.h_) * 3.14159265f;
+				for (int x = 0; x != src.w_; x++)
+				{
+					const float phi = (float(x) + 0.5f) / float(src.w_) * 6.28318531f;
+					const glm::vec3 dir(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+					const glm::vec3 c = glm::vec3(src.getPixel(x, y)) * (std::max(0.0f, glm::dot(n, dir)) * std::sin(theta) * texelSolidAngle);
+					for (int i = 0; i != 3; i++)
+						sum[i] += c[i];
+				}
+			}
+			out[size_t(v) * dstW + u] = glm::vec3(float(sum[0]), float(sum[1]), float(sum[2])) / 3.14159265f;
+		}
+	}
+
+	return out;
+}
+
+// Error against the exact convolution for a number of samples: uniform sampling by solid angle (uniformFraction = 1)
+// against luminance importance sampling. The CDF is built once, as a bake does, and reused by every iteration.
+// relError is the RMS error over the output texels divided by their mean value.
+static void BM_ConvolveLambertianImportance(benchmark::State& state)
+{
+	const bool importance = state.range(0) != 0;
+	const int numSamples = (int)state.range(1);
+
+	state.SetLabel(importance ? "luminance" : "uniform");
+
+	constexpr int kDstW = 32;
+	constexpr int kDstH = 16;
+
+	static const Bitmap in = makeSunBitmap(512, 256);
+	static const std::vector<glm::vec3> exact = convolveLambertianExact(in, kDstW, kDstH);
+
+	const glm::vec3* src = reinterpret_cast<const glm::vec3*>(in.data_.data());
+	const EnvironmentCdf cdf = buildEnvironmentCdf(src, in.w_, in.h_, importance ? 0.1f : 1.0f);
+
+	std::vector<glm::vec3> out(exact.size());
+
+	for (auto _ : state)
+	{
+		convolveLambertianImportance(src, cdf, kDstW, kDstH, out.data(), numSamples);
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	double sumSq = 0.0;
+	double sum = 0.0;
+	for (size_t i = 0; i != exact.size(); i++)
+	{
+		const glm::vec3 d = out[i] - exact[i];
+		sumSq += glm::dot(d, d) / 3.0;
+		sum += (exact[i].x + exact[i].y + exact[i].z) / 3.0;
+	}
+
+	state.SetItemsProcessed(state.iterations() * kDstW * kDstH * numSamples);
+	state.counters["relError"] = std::sqrt(sumSq / double(exact.size())) / (sum / double(exact.size()));
+}
+BENCHMARK(BM_ConvolveLambertianImportance)->ArgsProduct({ { 0, 1 }, { 16, 64, 256, 1024, 4096 } })->Unit(benchmark::kMicrosecond);
+
+// The argument is the width of the equirectangular map
+static void BM_BuildEnvironmentCdf(benchmark::State& state)
+{
+	const int w = (int)state.range(0);
+	const Bitmap in = makeRandomBitmap(w, w / 2, 3, eBitmapFormat_Float);
+
+	for (auto _ : state)
+	{
+		EnvironmentCdf cdf = buildEnvironmentCdf(reinterpret_cast<const glm::vec3*>(in.data_.data()), in.w_, in.h_);
+		benchmark::DoNotOptimize(cdf.conditional.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * w * (w / 2));
+}
+BENCHMARK(BM_BuildEnvironmentCdf)->RangeMultiplier(2)->Range(512, 4096)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The arguments are the size of the table and the number of samples; maxError is against kBrdfLutReference
+static void BM_GenerateBrdfLut(benchmark::State& state)
+{
+	const int size = (int)state.range(0);
+	const int numSamples = (int)state.range(1);
+
+	std::vector<glm::vec2> lut;
+
+	for (auto _ : state)
+	{
+		lut = generateBrdfLut(size, numSamples);
+		benchmark::DoNotOptimize(lut.data());
+	}
+
+	const float maxError = checkBrdfLut(packBrdfLut(lut), size);
+	if (maxError > kBrdfLutTolerance && numSamples >= kBrdfLutSamples)
+		state.SkipWithError("The BRDF LUT does not match the reference values");
+
+	state.SetItemsProcessed(state.iterations() * size * size * numSamples);
+	state.counters["maxError"] = maxError;
+}
+BENCHMARK(BM_GenerateBrdfLut)->ArgsProduct({ { 128, 256 }, { 256, 1024, 4096 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// What a bake pays for the table once it is cached
+static void BM_LoadBrdfLut(benchmark::State& state)
+{
+	const std::filesystem::path cacheFile = std::filesystem::temp_directory_path() / "bench_brdf_lut.ktx2";
+	std::filesystem::remove(cacheFile);
+
+	BrdfLutStats stats;
+	getBrdfLut(cacheFile, &stats);
+	state.counters["generateMs"] = stats.ms;
+
+	for (auto _ : state)
+	{
+		std::vector<uint32_t> texels = getBrdfLut(cacheFile, &stats);
+		benchmark::DoNotOptimize(texels.data());
+	}
+
+	if (!stats.fromCache || !stats.passed)
+		state.SkipWithError("The BRDF LUT was not loaded from the cache");
+
+	state.counters["loadMs"] = stats.ms;
+
+	std::filesystem::remove(cacheFile);
+}
+BENCHMARK(BM_LoadBrdfLut)->Unit(benchmark::kMillisecond);
+
+// One environment bake after another, as a batch bake does: cross, faces, mips and an irradiance map per iteration.
+// With the image pool caching freed buffers every bake after the first reuses the memory of the previous one; without
+// it every image comes from the heap and is page-faulted in again.
+static void BM_BakeEnvironments(benchmark::State& state)
+{
+	const bool cached = state.range(0) != 0;
+
+	state.SetLabel(cached ? "pooled" : "heap");
+
+	ImageBufferPool& pool = getImageBufferPool();
+	pool.setMaxCachedBytes(cached ? 1ull << 30 : 0);
+
+	const Bitmap in = makeRandomBitmap(1024, 512, 3, eBitmapFormat_Float);
+
+	pool.resetCounters();
+
+	for (auto _ : state)
+	{
+		const Bitmap cross = convertEquirectangularMapToVerticalCross(in);
+		const Bitmap faces = convertVerticalCrossToCubeMapFaces(cross);
+		const std::vector<Bitmap> levels = generateCubeMipChain(faces);
+
+		Bitmap irradiance(64, 32, 3, eBitmapFormat_Float);
+		convolveLambertian(reinterpret_cast<const glm::vec3*>(in.data_.data()), in.w_, in.h_, 64, 32,
+			reinterpret_cast<glm::vec3*>(irradiance.data_.data()), 64);
+
+		benchmark::DoNotOptimize(levels.data());
+		benchmark::DoNotOptimize(irradiance.data_.data());
+	}
+
+	const ImageMemoryStats stats = pool.getStats();
+	state.counters["heapAllocsPerBake"] = double(stats.numHeapAllocations) / double(state.iterations());
+	state.counters["reusedPerBake"] = double(stats.numReused) / double(state.iterations());
+	state.counters["peakRssMB"] = double(stats.peakRssBytes) / 1048576.0;
+
+	pool.setMaxCachedBytes(1ull << 30);
+}
+BENCHMARK(BM_BakeEnvironments)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_BitmapGetPixel(benchmark::State& state)
+{
+	const eBitmapFormat fmt = (eBitmapFormat)state.range(1);
+	const int size = (int)state.range(0);
+	const Bitmap b = makeRandomBitmap(size, size, 4, fmt);
+
+	for (auto _ : state)
+	{
+		glm::vec4 sum(0.0f);
+		for (int y = 0; y != size; y++)
+			for (int x = 0; x != size; x++)
+				sum += b.getPixel(x, y);
+		benchmark::DoNotOptimize(sum);
+	}
+
+	state.SetItemsProcessed(state.iterations() * size * size);
+}
+BENCHMARK(BM_BitmapGetPixel)->ArgsProduct({ { 256, 1024 }, { eBitmapFormat_UnsignedByte, eBitmapFormat_Float } });
+
+static void BM_BitmapSetPixel(benchmark::State& state)
+{
+	const eBitmapFormat fmt = (eBitmapFormat)state.range(1);
+	const int size = (int)state.range(0);
+	Bitmap b(size, size, 4, fmt);
+
+	for (auto _ : state)
+	{
+		for (int y = 0; y != size; y++)
+			for (int x = 0; x != size; x++)
+				b.setPixel(x, y, glm::vec4(0.25f, 0.5f, 0.75f, 1.0f));
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(state.iterations() * size * size);
+}
+BENCHMARK(BM_BitmapSetPixel)->ArgsProduct({ { 256, 1024 }, { eBitmapFormat_UnsignedByte, eBitmapFormat_Float } });
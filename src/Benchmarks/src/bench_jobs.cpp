@@ -0,0 +1,145 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+#include "UtilsCubemap.h"
+#include "bench_utils.h"
+#include "job_system.h"
+
+// Scaling runs replace the shared job system with one of `state.range(0)` threads, 1 to 64, so the utilities use it as they are.
+// Thread counts above the number of cores of the machine measure oversubscription, not scaling.
+struct ScopedJobSystem
+{
+	explicit ScopedJobSystem(benchmark::State& state)
+	{
+		resetJobSystem((uint32_t)state.range(0));
+		state.counters["threads"] = (double)state.range(0);
+	}
+	~ScopedJobSystem() { resetJobSystem(); }
+};
+
+// The cost of one job: run() and wait() for jobs which do nothing; the argument is the number of jobs
+static void BM_JobSystemOverhead(benchmark::State& state)
+{
+	const uint32_t numJobs = (uint32_t)state.range(0);
+
+	JobSystem& js = getJobSystem();
+
+	for (auto _ : state)
+	{
+		JobCounter counter;
+		for (uint32_t i = 0; i != numJobs; i++)
+			js.run(counter, []() {});
+		js.wait(counter);
+	}
+
+	state.SetItemsProcessed(state.iterations() * numJobs);
+	state.counters["threads"] = js.getNumThreads();
+}
+BENCHMARK(BM_JobSystemOverhead)->RangeMultiplier(8)->Range(64, 32768)->UseRealTime();
+
+// Jobs which start jobs and wait for them: one level of fan-out per face, then rows, as the bake of a cube map does
+static void BM_JobSystemNested(benchmark::State& state)
+{
+	const uint32_t numRows = (uint32_t)state.range(0);
+
+	JobSystem& js = getJobSystem();
+
+	std::vector<float> rows(6 * numRows);
+
+	for (auto _ : state)
+	{
+		js.parallelFor(6, [&](uint32_t face) {
+			js.parallelFor(numRows, [&](uint32_t row) {
+				float sum = 0.0f;
+				for (uint32_t i = 0; i != 256; i++)
+					sum += std::sqrt(float(face * numRows + row + i));
+				rows[face * numRows + row] = sum;
+			});
+		});
+		benchmark::DoNotOptimize(rows.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * 6 * numRows);
+}
+BENCHMARK(BM_JobSystemNested)->RangeMultiplier(4)->Range(64, 4096)->UseRealTime();
+
+// A compute-bound loop with uneven rows, like the poles and the equator of an equirectangular map
+static void BM_ScalingParallelFor(benchmark::State& state)
+{
+	const ScopedJobSystem scope(state);
+
+	constexpr uint32_t kNumRows = 2048;
+
+	std::vector<float> out(kNumRows);
+
+	for (auto _ : state)
+	{
+		getJobSystem().parallelFor(kNumRows, [&](uint32_t row) {
+			const uint32_t n = 512 + uint32_t(1536.0f * std::sin(float(row) / kNumRows * 3.14159265f));
+			float sum = 0.0f;
+			for (uint32_t i = 0; i != n; i++)
+				sum += std::sin(float(row + i)) * std::cos(float(i));
+			out[row] = sum;
+		});
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * kNumRows);
+}
+BENCHMARK(BM_ScalingParallelFor)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void BM_ScalingEquirectangularToVerticalCross(benchmark::State& state)
+{
+	const ScopedJobSystem scope(state);
+
+	const Bitmap in = makeRandomBitmap(2048, 1024, 4, eBitmapFormat_Float);
+
+	for (auto _ : state)
+	{
+		Bitmap out = convertEquirectangularMapToVerticalCross(in);
+		benchmark::DoNotOptimize(out.data_.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * 512 * 512 * 6);
+}
+BENCHMARK(BM_ScalingEquirectangularToVerticalCross)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void BM_ScalingConvolveLambertian(benchmark::State& state)
+{
+	const ScopedJobSystem scope(state);
+
+	const Bitmap in = makeRandomBitmap(1024, 512, 3, eBitmapFormat_Float);
+	std::vector<glm::vec3> out(256 * 128);
+
+	for (auto _ : state)
+	{
+		convolveLambertian(reinterpret_cast<const glm::vec3*>(in.data_.data()), in.w_, in.h_, 256, 128, out.data(), 256);
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * 256 * 128 * 256);
+}
+BENCHMARK(BM_ScalingConvolveLambertian)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void BM_ScalingGenerateCubeMipChain(benchmark::State& state)
+{
+	const ScopedJobSystem scope(state);
+
+	constexpr int kFaceSize = 256;
+
+	Bitmap in = makeRandomBitmap(kFaceSize, kFaceSize * 6, 4, eBitmapFormat_Float);
+	in.w_ = in.h_ = kFaceSize;
+	in.d_ = 6;
+	in.type_ = eBitmapType_Cube;
+
+	for (auto _ : state)
+	{
+		std::vector<Bitmap> levels = generateCubeMipChain(in);
+		benchmark::DoNotOptimize(levels.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * kFaceSize * kFaceSize * 6);
+}
+BENCHMARK(BM_ScalingGenerateCubeMipChain)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,348 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "UtilsMath.h"
+
+// Throughput and the largest error of the trigonometry kernels of UtilsMath.h, against the standard library in double
+// precision. Every kernel runs as the standard library in float, the scalar approximation and the SSE2 one; the error
+// bounds are the ones of the accuracy mode the benchmarks are built with. The argument is the number of values.
+
+static std::vector<float> makeUniform(size_t count, float lo, float hi, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> dist(lo, hi);
+
+	std::vector<float> v(count);
+	for (float& f : v)
+		f = dist(rng);
+	return v;
+}
+
+static void checkMaxError(benchmark::State& state, double maxError, double bound)
+{
+	if (!(maxError <= bound))
+		state.SkipWithError("The error is above the bound of the accuracy mode");
+
+	state.counters["maxError"] = maxError;
+}
+
+enum eKernel
+{
+	eKernel_Std,
+	eKernel_Scalar,
+	eKernel_SSE2,
+};
+
+static void atan2Std(const float* y, const float* x, float* out, size_t n)
+{
+	for (size_t i = 0; i != n; i++)
+		out[i] = std::atan2(y[i], x[i]);
+}
+
+static void atan2Scalar(const float* y, const float* x, float* out, size_t n)
+{
+	for (size_t i = 0; i != n; i++)
+		out[i] = Math::fastAtan2(y[i], x[i]);
+}
+
+static void atan2SSE2(const float* y, const float* x, float* out, size_t n)
+{
+	size_t i = 0;
+#if defined(UTILS_MATH_SSE2)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, Math::fastAtan2x4(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+#endif
+	atan2Scalar(y + i, x + i, out + i, n - i);
+}
+
+template <eKernel Kernel>
+static void BM_Atan2(benchmark::State& state)
+{
+	const size_t count = (size_t)state.range(0);
+
+	const std::vector<float> y = makeUniform(count, -1.0f, 1.0f, 1);
+	const std::vector<float> x = makeUniform(count, -1.0f, 1.0f, 2);
+	std::vector<float> out(count);
+
+	auto run = Kernel == eKernel_Std ? atan2Std : Kernel == eKernel_Scalar ? atan2Scalar : atan2SSE2;
+
+	for (auto _ : state)
+	{
+		run(y.data(), x.data(), out.data(), count);
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	double maxError = 0.0;
+	for (size_t i = 0; i != count; i++)
+		maxError = std::max(maxError, std::abs(double(out[i]) - std::atan2(double(y[i]), double(x[i]))));
+
+	state.SetItemsProcessed(state.iterations() * count);
+	checkMaxError(state, maxError, Kernel == eKernel_Std ? 1e-6 : Math::kMaxAtan2Error);
+}
+BENCHMARK(BM_Atan2<eKernel_Std>)->Name("BM_Atan2Std")->Arg(4096);
+BENCHMARK(BM_Atan2<eKernel_Scalar>)->Name("BM_FastAtan2")->Arg(4096);
+BENCHMARK(BM_Atan2<eKernel_SSE2>)->Name("BM_FastAtan2x4")->Arg(4096);
+
+static void sinCosStd(const float* x, float* s, float* c, size_t n)
+{
+	for (size_t i = 0; i != n; i++)
+	{
+		s[i] = std::sin(x[i]);
+		c[i] = std::cos(x[i]);
+	}
+}
+
+static void sinCosScalar(const float* x, float* s, float* c, size_t n)
+{
+	for (size_t i = 0; i != n; i++)
+		Math::fastSinCos(x[i], s[i], c[i]);
+}
+
+static void sinCosSSE2(const float* x, float* s, float* c, size_t n)
+{
+	size_t i = 0;
+#if defined(UTILS_MATH_SSE2)
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 vs, vc;
+		Math::fastSinCosx4(_mm_loadu_ps(x + i), vs, vc);
+		_mm_storeu_ps(s + i, vs);
+		_mm_storeu_ps(c + i, vc);
+	}
+#endif
+	sinCosScalar(x + i, s + i, c + i, n - i);
+}
+
+// The angles of an equirectangular map, theta and phi
+template <eKernel Kernel>
+static void BM_SinCos(benchmark::State& state)
+{
+	const size_t count = (size_t)state.range(0);
+
+	const std::vector<float> x = makeUniform(count, -Math::TWOPI, Math::TWOPI, 3);
+	std::vector<float> s(count);
+	std::vector<float> c(count);
+
+	auto run = Kernel == eKernel_Std ? sinCosStd : Kernel == eKernel_Scalar ? sinCosScalar : sinCosSSE2;
+
+	for (auto _ : state)
+	{
+		run(x.data(), s.data(), c.data(), count);
+		benchmark::DoNotOptimize(s.data());
+		benchmark::DoNotOptimize(c.data());
+	}
+
+	double maxError = 0.0;
+	for (size_t i = 0; i != count; i++)
+	{
+		maxError = std::max(maxError, std::abs(double(s[i]) - std::sin(double(x[i]))));
+		maxError = std::max(maxError, std::abs(double(c[i]) - std::cos(double(x[i]))));
+	}
+
+	state.SetItemsProcessed(state.iterations() * count);
+	checkMaxError(state, maxError, Kernel == eKernel_Std ? 1e-6 : Math::kMaxSinCosError);
+}
+BENCHMARK(BM_SinCos<eKernel_Std>)->Name("BM_SinCosStd")->Arg(4096);
+BENCHMARK(BM_SinCos<eKernel_Scalar>)->Name("BM_FastSinCos")->Arg(4096);
+BENCHMARK(BM_SinCos<eKernel_SSE2>)->Name("BM_FastSinCosx4")->Arg(4096);
+
+struct Directions
+{
+	std::vector<float> x, y, z;
+};
+
+/// Uniform over the sphere
+static Directions makeDirections(size_t count)
+{
+	const std::vector<float> u = makeUniform(count, 0.0f, 1.0f, 4);
+	const std::vector<float> v = makeUniform(count, -1.0f, 1.0f, 5);
+
+	Directions d;
+	d.x.resize(count);
+	d.y.resize(count);
+	d.z.resize(count);
+	for (size_t i = 0; i != count; i++)
+	{
+		const double r = std::sqrt(std::max(0.0, 1.0 - double(v[i]) * v[i]));
+		d.x[i] = float(r * std::cos(2.0 * M_PI * u[i]));
+		d.y[i] = float(r * std::sin(2.0 * M_PI * u[i]));
+		d.z[i] = v[i];
+	}
+	return d;
+}
+
+// What the conversions did before UtilsMath.h had the kernels
+static void directionToEquirectStd(const Directions& d, float* u, float* v, size_t n)
+{
+	for (size_t i = 0; i != n; i++)
+	{
+		const float phi = std::atan2(d.y[i], d.x[i]) / Math::TWOPI;
+		u[i] = phi < 0.0f ? phi + 1.0f : phi;
+		v[i] = (Math::HALFPI - std::atan2(d.z[i], std::hypot(d.x[i], d.y[i]))) / Math::PI;
+	}
+}
+
+static void directionToEquirectScalar(const Directions& d, float* u, float* v, size_t n)
+{
+	for (size_t i = 0; i != n; i++)
+	{
+		const glm::vec2 uv = Math::directionToEquirect(glm::vec3(d.x[i], d.y[i], d.z[i]));
+		u[i] = uv.x;
+		v[i] = uv.y;
+	}
+}
+
+static void directionToEquirectSSE2(const Directions& d, float* u, float* v, size_t n)
+{
+	size_t i = 0;
+#if defined(UTILS_MATH_SSE2)
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 vu, vv;
+		Math::directionToEquirectx4(_mm_loadu_ps(&d.x[i]), _mm_loadu_ps(&d.y[i]), _mm_loadu_ps(&d.z[i]), vu, vv);
+		_mm_storeu_ps(u + i, vu);
+		_mm_storeu_ps(v + i, vv);
+	}
+#endif
+	for (; i != n; i++)
+	{
+		const glm::vec2 uv = Math::directionToEquirect(glm::vec3(d.x[i], d.y[i], d.z[i]));
+		u[i] = uv.x;
+		v[i] = uv.y;
+	}
+}
+
+// The error is in units of the width of the map, so 1e-6 is a thousandth of a texel of a 1024 x 512 map
+template <eKernel Kernel>
+static void BM_DirectionToEquirect(benchmark::State& state)
+{
+	const size_t count = (size_t)state.range(0);
+
+	const Directions d = makeDirections(count);
+	std::vector<float> u(count);
+	std::vector<float> v(count);
+
+	auto run = Kernel == eKernel_Std ? directionToEquirectStd : Kernel == eKernel_Scalar ? directionToEquirectScalar : directionToEquirectSSE2;
+
+	for (auto _ : state)
+	{
+		run(d, u.data(), v.data(), count);
+		benchmark::DoNotOptimize(u.data());
+		benchmark::DoNotOptimize(v.data());
+	}
+
+	double maxError = 0.0;
+	for (size_t i = 0; i != count; i++)
+	{
+		double phi = std::atan2(double(d.y[i]), double(d.x[i])) / (2.0 * M_PI);
+		phi = phi < 0.0 ? phi + 1.0 : phi;
+		const double theta = std::atan2(std::hypot(double(d.x[i]), double(d.y[i])), double(d.z[i])) / M_PI;
+		// the seam at u = 0 and u = 1 is the same place
+		const double du = std::abs(double(u[i]) - phi);
+		maxError = std::max(maxError, std::min(du, 1.0 - du));
+		maxError = std::max(maxError, std::abs(double(v[i]) - theta) / 2.0);
+	}
+
+	state.SetItemsProcessed(state.iterations() * count);
+	checkMaxError(state, maxError, (Kernel == eKernel_Std ? 1e-6 : Math::kMaxAtan2Error) / Math::PI);
+}
+BENCHMARK(BM_DirectionToEquirect<eKernel_Std>)->Name("BM_DirectionToEquirectStd")->Arg(4096);
+BENCHMARK(BM_DirectionToEquirect<eKernel_Scalar>)->Name("BM_DirectionToEquirect")->Arg(4096);
+BENCHMARK(BM_DirectionToEquirect<eKernel_SSE2>)->Name("BM_DirectionToEquirectx4")->Arg(4096);
+
+static void equirectToDirectionScalar(const float* u, const float* v, Directions& d, size_t first, size_t n)
+{
+	for (size_t i = first; i != n; i++)
+	{
+		const glm::vec3 dir = Math::equirectToDirection(glm::vec2(u[i], v[i]));
+		d.x[i] = dir.x;
+		d.y[i] = dir.y;
+		d.z[i] = dir.z;
+	}
+}
+
+static void equirectToDirectionSSE2(const float* u, const float* v, Directions& d, size_t n)
+{
+	size_t i = 0;
+#if defined(UTILS_MATH_SSE2)
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 x, y, z;
+		Math::equirectToDirectionx4(_mm_loadu_ps(u + i), _mm_loadu_ps(v + i), x, y, z);
+		_mm_storeu_ps(&d.x[i], x);
+		_mm_storeu_ps(&d.y[i], y);
+		_mm_storeu_ps(&d.z[i], z);
+	}
+#endif
+	equirectToDirectionScalar(u, v, d, i, n);
+}
+
+template <eKernel Kernel>
+static void BM_EquirectToDirection(benchmark::State& state)
+{
+	const size_t count = (size_t)state.range(0);
+
+	const std::vector<float> u = makeUniform(count, 0.0f, 1.0f, 6);
+	const std::vector<float> v = makeUniform(count, 0.0f, 1.0f, 7);
+	Directions d;
+	d.x.resize(count);
+	d.y.resize(count);
+	d.z.resize(count);
+
+	for (auto _ : state)
+	{
+		if (Kernel == eKernel_SSE2)
+			equirectToDirectionSSE2(u.data(), v.data(), d, count);
+		else
+			equirectToDirectionScalar(u.data(), v.data(), d, 0, count);
+		benchmark::DoNotOptimize(d.x.data());
+	}
+
+	double maxError = 0.0;
+	for (size_t i = 0; i != count; i++)
+	{
+		const double theta = double(v[i]) * M_PI;
+		const double phi = double(u[i]) * 2.0 * M_PI;
+		maxError = std::max(maxError, std::abs(double(d.x[i]) - std::sin(theta) * std::cos(phi)));
+		maxError = std::max(maxError, std::abs(double(d.y[i]) - std::sin(theta) * std::sin(phi)));
+		maxError = std::max(maxError, std::abs(double(d.z[i]) - std::cos(theta)));
+	}
+
+	state.SetItemsProcessed(state.iterations() * count);
+	// two sines multiplied, and the rounding of the angles
+	checkMaxError(state, maxError, 2.0 * Math::kMaxSinCosError + 1e-6);
+}
+BENCHMARK(BM_EquirectToDirection<eKernel_Scalar>)->Name("BM_EquirectToDirection")->Arg(4096);
+BENCHMARK(BM_EquirectToDirection<eKernel_SSE2>)->Name("BM_EquirectToDirectionx4")->Arg(4096);
+
+// A direction to its face and back; the error is the distance between the normalized directions
+static void BM_DirectionToCubeFace(benchmark::State& state)
+{
+	const size_t count = (size_t)state.range(0);
+
+	const Directions d = makeDirections(count);
+	std::vector<glm::vec2> st(count);
+	std::vector<int> faces(count);
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i != count; i++)
+			faces[i] = Math::directionToCubeFace(glm::vec3(d.x[i], d.y[i], d.z[i]), st[i]);
+		benchmark::DoNotOptimize(st.data());
+	}
+
+	double maxError = 0.0;
+	for (size_t i = 0; i != count; i++)
+	{
+		const glm::vec3 dir = glm::normalize(Math::cubeFaceToDirection(faces[i], st[i]));
+		maxError = std::max(maxError, (double)glm::length(dir - glm::vec3(d.x[i], d.y[i], d.z[i])));
+	}
+
+	state.SetItemsProcessed(state.iterations() * count);
+	checkMaxError(state, maxError, 1e-6);
+}
+BENCHMARK(BM_DirectionToCubeFace)->Arg(4096);
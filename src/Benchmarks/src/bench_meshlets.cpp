@@ -0,0 +1,113 @@
+#include <benchmark/benchmark.h>
+
+#include <glm/ext.hpp>
+
+#include "model_loader.h"
+#include "meshlet_builder.h"
+#include "bench_utils.h"
+
+static void loadDuck(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	static std::vector<Vertex> cachedVertices;
+	static std::vector<uint32_t> cachedIndices;
+
+	if (cachedIndices.empty())
+		loadModelData(getAssetPath("models/rubber_duck/scene.gltf"), cachedVertices, cachedIndices);
+
+	vertices = cachedVertices;
+	indices = cachedIndices;
+}
+
+/// Every meshlet must respect the limits and reference valid vertices, and together they must cover every triangle
+static const char* validateMeshlets(const MeshletData& data, size_t numVertices, const std::vector<uint32_t>& indices)
+{
+	for (const Meshlet& m : data.meshlets)
+	{
+		if (m.vertexCount > kMaxMeshletVertices || m.triangleCount > kMaxMeshletTriangles)
+			return "meshlet exceeds the limits";
+		for (uint32_t i = 0; i != m.triangleCount * 3; i++)
+		{
+			if (data.triangles[m.triangleOffset * 3 + i] >= m.vertexCount)
+				return "local index out of range";
+		}
+		for (uint32_t i = 0; i != m.vertexCount; i++)
+		{
+			if (data.vertices[m.vertexOffset + i] >= numVertices)
+				return "vertex index out of range";
+		}
+	}
+
+	if (getMeshletIndices(data) != indices)
+		return "meshlet triangles differ from the source triangles";
+
+	return nullptr;
+}
+
+static void BM_BuildMeshlets(benchmark::State& state)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	loadDuck(vertices, indices);
+
+	MeshletData data;
+
+	for (auto _ : state)
+	{
+		data = buildMeshlets(&vertices[0].position.x, sizeof(Vertex), vertices.size(), indices);
+		benchmark::DoNotOptimize(data.meshlets.data());
+	}
+
+	if (const char* error = validateMeshlets(data, vertices.size(), indices))
+	{
+		state.SkipWithError(error);
+		return;
+	}
+
+	const MeshletStats stats = getMeshletStats(data, vertices.size());
+
+	state.counters["meshlets"] = stats.numMeshlets;
+	state.counters["vertexFill"] = stats.vertexFill;
+	state.counters["triangleFill"] = stats.triangleFill;
+	state.counters["vertexDuplication"] = stats.vertexDuplication;
+	state.counters["coneCullable"] = stats.numConeCullable;
+	state.SetItemsProcessed(state.iterations() * indices.size() / 3);
+}
+BENCHMARK(BM_BuildMeshlets)->Unit(benchmark::kMillisecond);
+
+// The CPU reference of meshlet_cull.comp, orbiting the camera around the duck like 02-Model does
+static void BM_CullMeshlets(benchmark::State& state)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	loadDuck(vertices, indices);
+
+	const MeshletData data = buildMeshlets(&vertices[0].position.x, sizeof(Vertex), vertices.size(), indices);
+
+	const glm::mat4 m = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1, 0, 0));
+	const glm::mat4 p = glm::perspective(45.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+
+	MeshletCullStats total;
+	uint32_t frame = 0;
+
+	for (auto _ : state)
+	{
+		const float angle = glm::radians(float(frame++ % 64) * 360.0f / 64.0f);
+		const glm::mat4 v = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, -1.5f)), angle, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		const MeshletCullStats stats = cullMeshlets(data, p * v * m, glm::vec3(glm::inverse(v * m) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+
+		total.numVisible += stats.numVisible;
+		total.numFrustumCulled += stats.numFrustumCulled;
+		total.numConeCulled += stats.numConeCulled;
+		total.numVisibleTriangles += stats.numVisibleTriangles;
+	}
+
+	const double numMeshlets = double(state.iterations()) * data.meshlets.size();
+
+	state.counters["visible"] = total.numVisible / numMeshlets;
+	state.counters["frustumCulled"] = total.numFrustumCulled / numMeshlets;
+	state.counters["coneCulled"] = total.numConeCulled / numMeshlets;
+	state.counters["visibleTriangles"] = total.numVisibleTriangles / (double(state.iterations()) * indices.size() / 3);
+	state.SetItemsProcessed(int64_t(numMeshlets));
+}
+BENCHMARK(BM_CullMeshlets);
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+#include "texture_residency.h"
+
+/// The invariants of the policy after every update(), with all requests completed
+static const char* validateResidency(const TextureResidencyPolicy& policy, const std::vector<std::vector<uint64_t>>& mipSizes, bool canFit)
+{
+	uint64_t resident = 0;
+
+	for (uint32_t id = 0; id != mipSizes.size(); id++)
+	{
+		if (policy.getFirstMip(id) >= mipSizes[id].size())
+			return "the smallest mip was evicted";
+		for (size_t i = policy.getFirstMip(id); i != mipSizes[id].size(); i++)
+			resident += mipSizes[id][i];
+	}
+
+	if (resident != policy.getResidentBytes())
+		return "resident bytes do not add up";
+
+	if (canFit && resident > policy.getBudget())
+		return "over budget";
+
+	return nullptr;
+}
+
+// A sliding window of textures is used every frame, like a camera moving through a scene with many materials.
+// The arguments are the number of textures and the budget in percent of what all textures take with every mip.
+static void BM_TextureResidencyUpdate(benchmark::State& state)
+{
+	const uint32_t numTextures = (uint32_t)state.range(0);
+	const uint32_t windowSize = std::max(1u, numTextures / 8);
+
+	std::mt19937 rng(12345);
+
+	std::vector<std::vector<uint64_t>> mipSizes(numTextures);
+	uint64_t fullBytes = 0;
+	for (std::vector<uint64_t>& sizes : mipSizes)
+	{
+		const uint32_t size = 256u << (rng() % 4);
+		sizes = getMipSizes(size, size, 4);
+		for (uint64_t s : sizes)
+			fullBytes += s;
+	}
+
+	TextureResidencyPolicy policy(fullBytes * state.range(1) / 100);
+	for (const std::vector<uint64_t>& sizes : mipSizes)
+		policy.addTexture(sizes);
+
+	uint64_t minBytes = 0;
+	for (const std::vector<uint64_t>& sizes : mipSizes)
+		minBytes += sizes.back();
+
+	uint32_t frame = 0;
+	size_t numRequests = 0;
+
+	for (auto _ : state)
+	{
+		for (uint32_t i = 0; i != windowSize; i++)
+			policy.touch((frame / 4 + i) % numTextures);
+
+		const std::vector<TextureResidencyRequest> requests = policy.update();
+		for (const TextureResidencyRequest& r : requests)
+			policy.onLoaded(r.id);
+
+		numRequests += requests.size();
+		frame++;
+
+		if (const char* error = validateResidency(policy, mipSizes, minBytes <= policy.getBudget()))
+		{
+			state.SkipWithError(error);
+			return;
+		}
+	}
+
+	const TextureResidencyStats stats = policy.getStats();
+
+	state.counters["requestsPerFrame"] = benchmark::Counter(double(numRequests) / double(frame));
+	state.counters["evictionsPerFrame"] = benchmark::Counter(double(stats.numEvictions) / double(frame));
+	state.counters["reloadsPerFrame"] = benchmark::Counter(double(stats.numReloads) / double(frame));
+	state.counters["degraded"] = stats.numDegraded;
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TextureResidencyUpdate)->ArgsProduct({ { 64, 512, 4096 }, { 25, 50, 100 } });
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "UtilsCubemap.h"
+#include "low_discrepancy.h"
+
+// Per-sample cost of the sequences. The argument is the number of points.
+
+static void BM_Hammersley2dScalar(benchmark::State& state)
+{
+	const uint32_t count = (uint32_t)state.range(0);
+
+	std::vector<glm::vec2> points(count);
+
+	for (auto _ : state)
+	{
+		for (uint32_t i = 0; i != count; i++)
+			points[i] = hammersley2d(i, count);
+		benchmark::DoNotOptimize(points.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_Hammersley2dScalar)->RangeMultiplier(16)->Range(1024, 1 << 20);
+
+template <eSequence Type>
+static void BM_GenerateSequence(benchmark::State& state)
+{
+	const uint32_t count = (uint32_t)state.range(0);
+
+	std::vector<float> u(count);
+	std::vector<float> v(count);
+
+	for (auto _ : state)
+	{
+		generateSequence(Type, 0, count, count, 1, u.data(), v.data());
+		benchmark::DoNotOptimize(u.data());
+		benchmark::DoNotOptimize(v.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * count);
+	state.SetLabel(getSequenceName(Type));
+}
+BENCHMARK(BM_GenerateSequence<eSequence_Hammersley>)->Name("BM_GenerateHammersley")->RangeMultiplier(16)->Range(1024, 1 << 20);
+BENCHMARK(BM_GenerateSequence<eSequence_Sobol>)->Name("BM_GenerateSobol")->RangeMultiplier(16)->Range(1024, 1 << 20);
+BENCHMARK(BM_GenerateSequence<eSequence_SobolScrambled>)->Name("BM_GenerateSobolScrambled")->RangeMultiplier(16)->Range(1024, 1 << 20);
+
+// What a convolution pays for its samples once the sequence is cached
+static void BM_GetSampleSequence(benchmark::State& state)
+{
+	const uint32_t count = (uint32_t)state.range(0);
+
+	getSampleSequence(eSequence_Hammersley, count);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(getSampleSequence(eSequence_Hammersley, count).get());
+}
+BENCHMARK(BM_GetSampleSequence)->Arg(1024);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <filesystem>
+#include <random>
+
+#include "Bitmap.h"
+
+inline std::filesystem::path getAssetPath(const char* relativePath)
+{
+	return std::filesystem::path(ASSETS_DIR) / relativePath;
+}
+
+/// Deterministic noise, so every run and every commit benchmarks the same data
+inline Bitmap makeRandomBitmap(int w, int h, int comp, eBitmapFormat fmt)
+{
+	Bitmap b(w, h, comp, fmt);
+
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+	for (int y = 0; y != h; y++)
+		for (int x = 0; x != w; x++)
+			b.setPixel(x, y, glm::vec4(dist(rng), dist(rng), dist(rng), 1.0f));
+
+	return b;
+}
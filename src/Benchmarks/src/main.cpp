@@ -0,0 +1,19 @@
+#include <benchmark/benchmark.h>
+
+#include <glslang/Include/glslang_c_interface.h>
+
+int main(int argc, char** argv)
+{
+	// normally done by the Vulkan context, shader compilation benchmarks run without one
+	glslang_initialize_process();
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	glslang_finalize_process();
+
+	return 0;
+}
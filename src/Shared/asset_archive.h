@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#if defined(ASSET_ARCHIVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "mapped_file.h"
+
+enum eArchiveCompression
+{
+	eArchiveCompression_None,
+	eArchiveCompression_Zstd,
+	eArchiveCompression_Count
+};
+
+inline const char* getArchiveCompressionName(uint32_t compression)
+{
+	static const char* kNames[] = { "None", "Zstd" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eArchiveCompression_Count);
+	return compression < eArchiveCompression_Count ? kNames[compression] : "Unknown";
+}
+
+/// Whether this build can read and write compressed entries; zstd is optional (see the top-level CMakeLists.txt)
+inline bool isArchiveCompressionSupported(eArchiveCompression compression)
+{
+#if defined(ASSET_ARCHIVE_ZSTD)
+	return compression < eArchiveCompression_Count;
+#else
+	return compression == eArchiveCompression_None;
+#endif
+}
+
+constexpr uint32_t kArchiveMagic = 0x4b415056; // "VPAK"
+constexpr uint32_t kArchiveVersion = 1;
+
+/// An archive is this header, the data of the entries, each at a multiple of `alignment`, the table of contents sorted
+/// by the hash of the names, and the names. Everything is little-endian and read in place from a mapping.
+struct ArchiveHeader
+{
+	uint32_t magic = kArchiveMagic;
+	uint32_t version = kArchiveVersion;
+	uint32_t numEntries = 0;
+	uint32_t alignment = 0;
+	uint64_t tocOffset = 0;
+	uint64_t namesOffset = 0;
+	uint64_t namesSize = 0;
+};
+static_assert(sizeof(ArchiveHeader) == 40);
+
+struct ArchiveEntry
+{
+	uint64_t hash = 0;
+	uint64_t offset = 0;
+	/// The size in the archive; equal to `size` for uncompressed entries
+	uint64_t storedSize = 0;
+	uint64_t size = 0;
+	uint32_t nameOffset = 0;
+	uint32_t nameLength = 0;
+	uint32_t compression = eArchiveCompression_None;
+	uint32_t assetClass = eAssetClass_Count;
+};
+static_assert(sizeof(ArchiveEntry) == 48);
+
+/// FNV-1a
+inline uint64_t hashArchiveName(std::string_view name)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : name)
+	{
+		hash ^= (uint8_t)c;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/// Names are relative to the root of the assets, with forward slashes, e.g. "models/rubber_duck/scene.gltf", so the
+/// relative paths of the chapters find the same entries from any working directory. Empty for files outside of `root`.
+inline std::string getArchiveName(const std::filesystem::path& file, const std::filesystem::path& root)
+{
+	std::error_code ec;
+	const std::filesystem::path abs = std::filesystem::absolute(file, ec).lexically_normal();
+	const std::filesystem::path absRoot = std::filesystem::absolute(root, ec).lexically_normal();
+
+	const std::filesystem::path rel = abs.lexically_relative(absRoot);
+	if (rel.empty() || *rel.begin() == "..")
+		return {};
+
+	return rel.generic_string();
+}
+
+/// Picks the read-ahead of an entry and groups the build statistics
+inline eAssetClass getAssetClassFromPath(const std::filesystem::path& file)
+{
+	std::string ext = file.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+
+	for (const char* e : { ".vert", ".frag", ".geom", ".comp", ".tesc", ".tese", ".sp", ".glsl" })
+		if (ext == e)
+			return eAssetClass_Shader;
+	for (const char* e : { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".hdr", ".ktx", ".ktx2" })
+		if (ext == e)
+			return eAssetClass_Image;
+	for (const char* e : { ".gltf", ".glb", ".bin", ".obj", ".fbx" })
+		if (ext == e)
+			return eAssetClass_Mesh;
+	for (const char* e : { ".ttf", ".otf" })
+		if (ext == e)
+			return eAssetClass_Font;
+
+	return eAssetClass_Cache;
+}
+
+/// A mounted archive: setFileSource(AssetArchive::load(...)) makes every MappedFile, and so the shader, image and mesh
+/// loaders, find the packed files first. Uncompressed entries are views into the mapping of the archive; compressed ones
+/// are decompressed into memory of their own on every open.
+class AssetArchive final : public FileSource
+{
+public:
+	/// `root` is the directory the names are relative to. Returns nullptr when the file is missing or not a valid archive.
+	static std::shared_ptr<AssetArchive> load(const std::filesystem::path& file, const std::filesystem::path& root)
+	{
+		std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>(file, eAssetClass_Archive);
+
+		const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(mapped->data());
+
+		if (mapped->size() < sizeof(ArchiveHeader) || header->magic != kArchiveMagic || header->version != kArchiveVersion)
+		{
+			printf("Not an asset archive: %s\n", file.string().c_str());
+			return nullptr;
+		}
+
+		const uint64_t tocSize = uint64_t(header->numEntries) * sizeof(ArchiveEntry);
+
+		if (header->tocOffset % alignof(ArchiveEntry) || header->tocOffset + tocSize > mapped->size() ||
+			header->namesOffset + header->namesSize > mapped->size())
+		{
+			printf("Corrupted asset archive: %s\n", file.string().c_str());
+			return nullptr;
+		}
+
+		std::shared_ptr<AssetArchive> archive(new AssetArchive());
+		archive->file_ = std::move(mapped);
+		archive->root_ = std::filesystem::absolute(root).lexically_normal();
+		archive->entries_ = { reinterpret_cast<const ArchiveEntry*>(archive->file_->data() + header->tocOffset), header->numEntries };
+		archive->names_ = { reinterpret_cast<const char*>(archive->file_->data() + header->namesOffset), header->namesSize };
+
+		for (const ArchiveEntry& e : archive->entries_)
+		{
+			if (e.offset + e.storedSize > archive->file_->size() || uint64_t(e.nameOffset) + e.nameLength > header->namesSize)
+			{
+				printf("Corrupted asset archive: %s\n", file.string().c_str());
+				return nullptr;
+			}
+		}
+
+		return archive;
+	}
+
+	uint32_t getNumEntries() const { return (uint32_t)entries_.size(); }
+	const ArchiveEntry& getEntry(uint32_t i) const { return entries_[i]; }
+	std::string_view getName(const ArchiveEntry& e) const { return names_.substr(e.nameOffset, e.nameLength); }
+
+	const ArchiveEntry* find(std::string_view name) const
+	{
+		const uint64_t hash = hashArchiveName(name);
+
+		auto it = std::lower_bound(entries_.begin(), entries_.end(), hash, [](const ArchiveEntry& e, uint64_t h) { return e.hash < h; });
+
+		for (; it != entries_.end() && it->hash == hash; ++it)
+		{
+			if (getName(*it) == name)
+				return &*it;
+		}
+
+		return nullptr;
+	}
+
+	bool contains(const std::filesystem::path& file) const override
+	{
+		const std::string name = getArchiveName(file, root_);
+		return !name.empty() && find(name);
+	}
+
+	bool open(const std::filesystem::path& file, eAssetClass assetClass, MappedFile& out) const override
+	{
+		const std::string name = getArchiveName(file, root_);
+		const ArchiveEntry* e = name.empty() ? nullptr : find(name);
+		if (!e)
+			return false;
+
+		const std::span<const uint8_t> stored = { file_->data() + e->offset, e->storedSize };
+
+		if (e->compression == eArchiveCompression_None)
+		{
+			file_->advise(e->offset, e->storedSize, getDefaultFileAccess(assetClass));
+			out = MappedFile(file_, stored);
+			return true;
+		}
+
+#if defined(ASSET_ARCHIVE_ZSTD)
+		if (e->compression == eArchiveCompression_Zstd)
+		{
+			// the whole entry goes through the decompressor right away
+			file_->advise(e->offset, e->storedSize, eFileAccess_WillNeed);
+
+			std::shared_ptr<std::vector<uint8_t>> data = std::make_shared<std::vector<uint8_t>>(e->size);
+			const size_t size = ZSTD_decompress(data->data(), data->size(), stored.data(), stored.size());
+			if (ZSTD_isError(size) || size != e->size)
+			{
+				printf("Failed to decompress %s from the asset archive\n", name.c_str());
+				return false;
+			}
+
+			const std::span<const uint8_t> bytes = *data;
+			out = MappedFile(std::move(data), bytes);
+			return true;
+		}
+#endif
+
+		// the loose file, if there is one, is used instead
+		printf("%s is compressed with %s, which this build cannot read\n", name.c_str(), getArchiveCompressionName(e->compression));
+		return false;
+	}
+
+private:
+	AssetArchive() = default;
+
+	std::shared_ptr<MappedFile> file_;
+	std::filesystem::path root_;
+	std::span<const ArchiveEntry> entries_;
+	std::string_view names_;
+};
+
+struct ArchiveBuildEntry
+{
+	std::filesystem::path file;
+	/// See getArchiveName()
+	std::string name;
+};
+
+struct ArchiveBuildSettings
+{
+	/// Entries start at multiples of this; a power of two
+	uint32_t alignment = 64;
+	eArchiveCompression compression = eArchiveCompression_None;
+	int compressionLevel = 19;
+	/// Entries which do not shrink below this fraction of their size are stored uncompressed, and read without a copy
+	float maxCompressedRatio = 0.9f;
+};
+
+struct ArchiveBuildStats
+{
+	uint32_t numEntries = 0;
+	uint32_t numCompressed = 0;
+	uint64_t inputBytes = 0;
+	uint64_t storedBytes = 0;
+	uint64_t archiveBytes = 0;
+	/// Per asset class, indexed by eAssetClass
+	uint32_t numEntriesPerClass[eAssetClass_Count] = {};
+	uint64_t inputBytesPerClass[eAssetClass_Count] = {};
+	uint64_t storedBytesPerClass[eAssetClass_Count] = {};
+	double ms = 0.0;
+};
+
+/// Packs `entries` into `archiveFile`; false when an input cannot be read, a name repeats, or the output cannot be written
+inline bool buildAssetArchive(const std::filesystem::path& archiveFile, const std::vector<ArchiveBuildEntry>& entries,
+	const ArchiveBuildSettings& settings = {}, ArchiveBuildStats* outStats = nullptr)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	if (!isArchiveCompressionSupported(settings.compression))
+	{
+		printf("%s compression is not available in this build\n", getArchiveCompressionName(settings.compression));
+		return false;
+	}
+
+	const uint64_t alignment = std::max(settings.alignment, (uint32_t)alignof(ArchiveEntry));
+	if (alignment & (alignment - 1))
+	{
+		printf("The alignment of an asset archive must be a power of two, not %llu\n", (unsigned long long)alignment);
+		return false;
+	}
+
+	std::ofstream out(archiveFile, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		printf("Cannot write %s\n", archiveFile.string().c_str());
+		return false;
+	}
+
+	ArchiveBuildStats stats;
+
+	std::vector<ArchiveEntry> toc;
+	toc.reserve(entries.size());
+	std::string names;
+	std::unordered_set<std::string> seen;
+
+	uint64_t offset = 0;
+	auto write = [&](const void* data, size_t size) {
+		out.write(reinterpret_cast<const char*>(data), (std::streamsize)size);
+		offset += size;
+	};
+	auto pad = [&](uint64_t align) {
+		static const char kZeros[4096] = {};
+		while (offset % align)
+			write(kZeros, std::min<uint64_t>(sizeof(kZeros), align - offset % align));
+	};
+
+	// the header is rewritten at the end, when the offsets are known
+	ArchiveHeader header = { .alignment = (uint32_t)alignment };
+	write(&header, sizeof(header));
+
+	std::vector<uint8_t> compressed;
+
+	for (const ArchiveBuildEntry& in : entries)
+	{
+		if (!seen.insert(in.name).second)
+		{
+			printf("Duplicate asset archive entry: %s\n", in.name.c_str());
+			return false;
+		}
+
+		const eAssetClass assetClass = getAssetClassFromPath(in.file);
+		const MappedFile file(in.file, assetClass, eFileAccess_Sequential);
+		if (!file.isValid())
+		{
+			printf("Cannot read %s\n", in.file.string().c_str());
+			return false;
+		}
+
+		std::span<const uint8_t> stored = file.bytes();
+		eArchiveCompression compression = eArchiveCompression_None;
+
+#if defined(ASSET_ARCHIVE_ZSTD)
+		if (settings.compression == eArchiveCompression_Zstd && file.size())
+		{
+			compressed.resize(ZSTD_compressBound(file.size()));
+			const size_t size = ZSTD_compress(compressed.data(), compressed.size(), file.data(), file.size(), settings.compressionLevel);
+			if (!ZSTD_isError(size) && size < file.size() * settings.maxCompressedRatio)
+			{
+				stored = { compressed.data(), size };
+				compression = eArchiveCompression_Zstd;
+			}
+		}
+#endif
+
+		pad(alignment);
+
+		toc.push_back({
+			.hash = hashArchiveName(in.name),
+			.offset = offset,
+			.storedSize = stored.size(),
+			.size = file.size(),
+			.nameOffset = (uint32_t)names.size(),
+			.nameLength = (uint32_t)in.name.size(),
+			.compression = compression,
+			.assetClass = assetClass,
+		});
+		names += in.name;
+
+		write(stored.data(), stored.size());
+
+		stats.numEntries++;
+		stats.numCompressed += compression != eArchiveCompression_None;
+		stats.inputBytes += file.size();
+		stats.storedBytes += stored.size();
+		stats.numEntriesPerClass[assetClass]++;
+		stats.inputBytesPerClass[assetClass] += file.size();
+		stats.storedBytesPerClass[assetClass] += stored.size();
+	}
+
+	std::sort(toc.begin(), toc.end(), [](const ArchiveEntry& a, const ArchiveEntry& b) { return a.hash < b.hash; });
+
+	pad(alignof(ArchiveEntry));
+	header.numEntries = (uint32_t)toc.size();
+	header.tocOffset = offset;
+	write(toc.data(), toc.size() * sizeof(ArchiveEntry));
+
+	header.namesOffset = offset;
+	header.namesSize = names.size();
+	write(names.data(), names.size());
+
+	stats.archiveBytes = offset;
+
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	if (!out)
+	{
+		printf("Cannot write %s\n", archiveFile.string().c_str());
+		return false;
+	}
+
+	stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (outStats)
+		*outStats = stats;
+
+	return true;
+}
+
+/// Every regular file under `dirs`, named relative to `root`; `dirs` are relative to `root` as well
+inline std::vector<ArchiveBuildEntry> collectArchiveEntries(const std::filesystem::path& root, const std::vector<std::filesystem::path>& dirs)
+{
+	std::vector<ArchiveBuildEntry> entries;
+
+	auto addFile = [&](const std::filesystem::path& file) {
+		const std::string name = getArchiveName(file, root);
+		if (!name.empty())
+			entries.push_back({ .file = file, .name = name });
+	};
+
+	for (const std::filesystem::path& dir : dirs)
+	{
+		const std::filesystem::path path = root / dir;
+
+		std::error_code ec;
+		if (std::filesystem::is_regular_file(path, ec))
+		{
+			addFile(path);
+			continue;
+		}
+
+		for (const auto& it : std::filesystem::recursive_directory_iterator(path, ec))
+		{
+			if (it.is_regular_file())
+				addFile(it.path());
+		}
+	}
+
+	// the same input gives the same archive
+	std::sort(entries.begin(), entries.end(), [](const ArchiveBuildEntry& a, const ArchiveBuildEntry& b) { return a.name < b.name; });
+
+	return entries;
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job_system.h"
+
+using AssetNode = uint32_t;
+
+struct AssetNodeTiming
+{
+	std::string name;
+	bool mainThread = false;
+	/// Milliseconds since AssetPipeline::run() started: all dependencies done, then the node itself
+	double readyMs = 0.0;
+	double startMs = 0.0;
+	double endMs = 0.0;
+	bool critical = false;
+};
+
+struct AssetPipelineTimeline
+{
+	std::vector<AssetNodeTiming> nodes;
+	double totalMs = 0.0;
+	/// The sum of the node durations; more than `totalMs` when nodes overlapped
+	double workMs = 0.0;
+	/// From the first node to the one which finished last; each node is the dependency which finished last of the next one
+	std::vector<AssetNode> criticalPath;
+	uint32_t numThreads = 0;
+};
+
+/// Startup work as a DAG of nodes. A node starts as soon as all of its dependencies are done: CPU nodes run as jobs, in
+/// parallel with each other, and main-thread nodes, i.e. everything which uses the context such as shader modules and
+/// GPU uploads, run on the thread which called run(), which helps with the jobs in between.
+class AssetPipeline
+{
+public:
+	/// `fn` runs in a job once all of `deps` are done
+	AssetNode add(const char* name, std::function<void()> fn, std::initializer_list<AssetNode> deps = {})
+	{
+		return addNode(name, std::move(fn), deps, false);
+	}
+
+	/// `fn` runs on the thread which calls run() once all of `deps` are done
+	AssetNode addMainThread(const char* name, std::function<void()> fn, std::initializer_list<AssetNode> deps = {})
+	{
+		return addNode(name, std::move(fn), deps, true);
+	}
+
+	/// Runs every node and returns when all of them are done
+	void run()
+	{
+		start_ = Clock::now();
+		numDone_ = 0;
+
+		for (Node& n : nodes_)
+			n.numPendingDeps = (uint32_t)n.deps.size();
+
+		for (AssetNode i = 0; i != nodes_.size(); i++)
+		{
+			if (nodes_[i].deps.empty())
+				schedule(i);
+		}
+
+		JobSystem& js = getJobSystem();
+
+		while (numDone_.load(std::memory_order_acquire) != nodes_.size())
+		{
+			AssetNode node = ~0u;
+			{
+				std::lock_guard lock(mainThreadMutex_);
+				if (!mainThreadReady_.empty())
+				{
+					node = mainThreadReady_.back();
+					mainThreadReady_.pop_back();
+				}
+			}
+
+			if (node != ~0u)
+				execute(node);
+			else if (!js.tryRunJob())
+				std::this_thread::yield();
+		}
+
+		js.wait(jobs_);
+
+		buildTimeline(js.getNumThreads());
+	}
+
+	/// Valid after run()
+	const AssetPipelineTimeline& getTimeline() const { return timeline_; }
+
+	void printTimeline(const char* prefix) const
+	{
+		const AssetPipelineTimeline& t = timeline_;
+
+		std::string path;
+		for (AssetNode i : t.criticalPath)
+			path += (path.empty() ? "" : " > ") + t.nodes[i].name;
+
+		printf("[%s] Startup: %.1f ms, %.1f ms of work on %u threads (%.1fx overlap); critical path: %s\n", prefix, t.totalMs, t.workMs,
+			t.numThreads, t.totalMs > 0.0 ? t.workMs / t.totalMs : 0.0, path.c_str());
+
+		constexpr int kBarWidth = 40;
+		const double msPerColumn = std::max(t.totalMs, 1e-3) / kBarWidth;
+
+		for (const AssetNodeTiming& n : t.nodes)
+		{
+			char bar[kBarWidth + 1] = {};
+			for (int c = 0; c != kBarWidth; c++)
+			{
+				const double ms = (c + 0.5) * msPerColumn;
+				bar[c] = ms >= n.startMs && ms < n.endMs ? '#' : (ms >= n.readyMs && ms < n.startMs ? '.' : ' ');
+			}
+			// '.' is the time a node was ready but waited for a thread
+			printf("[%s] %c %-24s %-4s %8.1f %8.1f ms |%s|\n", prefix, n.critical ? '*' : ' ', n.name.c_str(), n.mainThread ? "main" : "job",
+				n.startMs, n.endMs - n.startMs, bar);
+		}
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Node
+	{
+		std::string name;
+		std::function<void()> fn;
+		std::vector<AssetNode> deps;
+		std::vector<AssetNode> dependents;
+		bool mainThread = false;
+		std::atomic<uint32_t> numPendingDeps = 0;
+		AssetNodeTiming timing;
+	};
+
+	AssetNode addNode(const char* name, std::function<void()>&& fn, std::initializer_list<AssetNode> deps, bool mainThread)
+	{
+		const AssetNode id = (AssetNode)nodes_.size();
+
+		// std::atomic is not movable, so the nodes are not stored by value
+		nodes_.emplace_back();
+		Node& n = nodes_.back();
+		n.name = name;
+		n.fn = std::move(fn);
+		n.deps = deps;
+		n.mainThread = mainThread;
+
+		for (AssetNode d : deps)
+			nodes_[d].dependents.push_back(id);
+
+		return id;
+	}
+
+	double getMs() const
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start_).count();
+	}
+
+	void schedule(AssetNode node)
+	{
+		nodes_[node].timing.readyMs = getMs();
+
+		if (nodes_[node].mainThread)
+		{
+			std::lock_guard lock(mainThreadMutex_);
+			mainThreadReady_.push_back(node);
+			return;
+		}
+
+		getJobSystem().run(jobs_, [this, node]() { execute(node); });
+	}
+
+	void execute(AssetNode node)
+	{
+		Node& n = nodes_[node];
+
+		n.timing.startMs = getMs();
+		if (n.fn)
+			n.fn();
+		n.timing.endMs = getMs();
+
+		for (AssetNode d : n.dependents)
+		{
+			if (nodes_[d].numPendingDeps.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				schedule(d);
+		}
+
+		numDone_.fetch_add(1, std::memory_order_release);
+	}
+
+	void buildTimeline(uint32_t numThreads)
+	{
+		timeline_ = { .totalMs = getMs(), .numThreads = numThreads };
+
+		for (const Node& n : nodes_)
+		{
+			timeline_.nodes.push_back(n.timing);
+			timeline_.nodes.back().name = n.name;
+			timeline_.nodes.back().mainThread = n.mainThread;
+			timeline_.workMs += n.timing.endMs - n.timing.startMs;
+		}
+
+		if (nodes_.empty())
+			return;
+
+		auto lastToFinish = [this](const std::vector<AssetNode>& candidates) {
+			return *std::max_element(candidates.begin(), candidates.end(),
+				[this](AssetNode a, AssetNode b) { return timeline_.nodes[a].endMs < timeline_.nodes[b].endMs; });
+		};
+
+		std::vector<AssetNode> all(nodes_.size());
+		for (AssetNode i = 0; i != all.size(); i++)
+			all[i] = i;
+
+		for (AssetNode node = lastToFinish(all);; node = lastToFinish(nodes_[node].deps))
+		{
+			timeline_.criticalPath.push_back(node);
+			timeline_.nodes[node].critical = true;
+			if (nodes_[node].deps.empty())
+				break;
+		}
+
+		std::reverse(timeline_.criticalPath.begin(), timeline_.criticalPath.end());
+	}
+
+	std::deque<Node> nodes_;
+
+	Clock::time_point start_;
+	std::atomic<uint32_t> numDone_ = 0;
+	JobCounter jobs_;
+
+	std::mutex mainThreadMutex_;
+	std::vector<AssetNode> mainThreadReady_;
+
+	AssetPipelineTimeline timeline_;
+};
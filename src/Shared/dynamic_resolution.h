@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct DynamicResolutionSettings
+{
+	float targetFrameMs = 1000.0f / 60.0f;
+	/// The scale is left alone while the frame time stays within [target - jitter, target]
+	float jitterMs = 1.0f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	/// Scales are multiples of this, so noise in the frame times does not change the scale every frame
+	float scaleStep = 0.05f;
+	/// Frame times averaged for one decision
+	uint32_t windowFrames = 8;
+	/// Frames ignored after a change, while the frames in flight still have the cost of the old scale
+	uint32_t settleFrames = 4;
+};
+
+struct DynamicResolutionStats
+{
+	float scale = 1.0f;
+	float avgFrameMs = 0.0f;
+	uint32_t numFrames = 0;
+	/// Frames with a frame time inside [target - jitter, target]
+	uint32_t numFramesInRange = 0;
+	uint32_t numFramesOverBudget = 0;
+	uint32_t numChanges = 0;
+};
+
+/// Picks the render scale (per axis) from recent frame times. The GPU cost of the frame is assumed to be proportional to
+/// the number of pixels, so the scale moves by sqrt(target / measured); a larger scale is only taken when the predicted
+/// frame time stays within the budget, which keeps the controller from oscillating between two steps.
+class DynamicResolutionController
+{
+public:
+	explicit DynamicResolutionController(const DynamicResolutionSettings& settings = {})
+		: settings_(settings)
+		, scale_(settings.maxScale)
+	{
+		history_.reserve(settings_.windowFrames);
+	}
+
+	/// Returns true when the scale changed
+	bool update(float frameMs)
+	{
+		const DynamicResolutionSettings& s = settings_;
+
+		stats_.numFrames++;
+		stats_.numFramesInRange += frameMs >= s.targetFrameMs - s.jitterMs && frameMs <= s.targetFrameMs;
+		stats_.numFramesOverBudget += frameMs > s.targetFrameMs;
+
+		if (settle_)
+		{
+			settle_--;
+			return false;
+		}
+
+		history_.push_back(frameMs);
+		if (history_.size() < s.windowFrames)
+			return false;
+
+		float avg = 0.0f;
+		for (float ms : history_)
+			avg += ms;
+		avg /= float(history_.size());
+		history_.clear();
+
+		stats_.avgFrameMs = avg;
+
+		if (avg <= 0.0f || (avg >= s.targetFrameMs - s.jitterMs && avg <= s.targetFrameMs))
+			return false;
+
+		// aim at the middle of the range
+		const float aimMs = s.targetFrameMs - 0.5f * s.jitterMs;
+		const float desired = scale_ * std::sqrt(aimMs / avg);
+
+		float next = std::clamp(std::floor(desired / s.scaleStep + 1e-3f) * s.scaleStep, s.minScale, s.maxScale);
+
+		if (avg > s.targetFrameMs)
+		{
+			// always go down by at least one step when over budget
+			if (next >= scale_)
+				next = std::max(s.minScale, scale_ - s.scaleStep);
+		}
+		else
+		{
+			const float predictedMs = avg * (next * next) / (scale_ * scale_);
+			if (next <= scale_ || predictedMs > s.targetFrameMs)
+				return false;
+		}
+
+		if (std::abs(next - scale_) < 1e-4f)
+			return false;
+
+		scale_ = next;
+		settle_ = s.settleFrames;
+		stats_.numChanges++;
+
+		return true;
+	}
+
+	float getScale() const { return scale_; }
+
+	DynamicResolutionStats getStats() const
+	{
+		DynamicResolutionStats s = stats_;
+		s.scale = scale_;
+		return s;
+	}
+
+	const DynamicResolutionSettings& getSettings() const { return settings_; }
+
+private:
+	DynamicResolutionSettings settings_;
+
+	float scale_ = 1.0f;
+	uint32_t settle_ = 0;
+	std::vector<float> history_;
+
+	DynamicResolutionStats stats_;
+};
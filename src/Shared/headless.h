@@ -0,0 +1,178 @@
+#pragma once
+
+#include <lvk/LVK.h>
+#include <lvk/vulkan/VulkanClasses.h>
+#include <minilog/minilog.h>
+
+#include <stb/stb_image_write.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Offscreen rendering without a window or a swapchain: a fixed resolution, a fixed time step and a fixed number of frames
+struct HeadlessOptions
+{
+	bool enabled = false;
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	uint32_t numFrames = 100;
+	float deltaSeconds = 1.0f / 60.0f;
+	lvk::HWDeviceType deviceType = lvk::HWDeviceType_Discrete;
+	std::string outputImage = ".cache/headless.png";
+};
+
+/// --headless [--width=N] [--height=N] [--frames=N] [--dt=seconds] [--software] [--output=file.png]
+inline HeadlessOptions parseHeadlessOptions(int argc, char** argv)
+{
+	HeadlessOptions opts;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string_view arg = argv[i];
+
+		auto value = [&arg](std::string_view name) -> const char* {
+			return arg.starts_with(name) && arg.size() > name.size() && arg[name.size()] == '=' ? arg.data() + name.size() + 1 : nullptr;
+		};
+
+		if (arg == "--headless")
+			opts.enabled = true;
+		else if (arg == "--software")
+			opts.deviceType = lvk::HWDeviceType_Software;
+		else if (const char* v = value("--width"))
+			opts.width = (uint32_t)std::max(1, atoi(v));
+		else if (const char* v = value("--height"))
+			opts.height = (uint32_t)std::max(1, atoi(v));
+		else if (const char* v = value("--frames"))
+			opts.numFrames = (uint32_t)std::max(1, atoi(v));
+		else if (const char* v = value("--dt"))
+			opts.deltaSeconds = (float)atof(v);
+		else if (const char* v = value("--output"))
+			opts.outputImage = v;
+	}
+
+	return opts;
+}
+
+/// The color format of the offscreen target which replaces the swapchain image
+constexpr lvk::Format kHeadlessColorFormat = lvk::Format_RGBA_UN8;
+
+/// Vulkan context without a surface. Falls back to any other device type when the preferred one is not present.
+inline std::unique_ptr<lvk::IContext> createHeadlessContext(lvk::HWDeviceType preferredDeviceType, const lvk::ContextConfig& cfg = {})
+{
+	std::unique_ptr<lvk::VulkanContext> ctx = std::make_unique<lvk::VulkanContext>(cfg, nullptr);
+
+	lvk::HWDeviceDesc device;
+
+	uint32_t numDevices = ctx->queryDevices(preferredDeviceType, &device);
+
+	for (lvk::HWDeviceType type : { lvk::HWDeviceType_Discrete, lvk::HWDeviceType_Integrated, lvk::HWDeviceType_Software })
+	{
+		if (!numDevices)
+			numDevices = ctx->queryDevices(type, &device);
+	}
+
+	if (!numDevices)
+	{
+		LLOGW("No Vulkan device found\n");
+		return nullptr;
+	}
+
+	if (!ctx->initContext(device).isOk())
+	{
+		LLOGW("Failed to initialize Vulkan device %s\n", device.name);
+		return nullptr;
+	}
+
+	LLOGL("Headless device: %s\n", device.name);
+
+	return ctx;
+}
+
+struct HeadlessStats
+{
+	uint32_t numFrames = 0;
+	double totalMs = 0.0;
+	float avgMs = 0.0f;
+	float p50Ms = 0.0f;
+	float p95Ms = 0.0f;
+	float p99Ms = 0.0f;
+	float worstMs = 0.0f;
+	/// Includes the lazy pipeline creation done by LVK on first bind
+	float firstFrameMs = 0.0f;
+	uint64_t imageHash = 0;
+};
+
+inline void printHeadlessStats(const char* name, const HeadlessStats& s)
+{
+	printf("[%s] %u frames in %.1f ms: avg %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, worst %.3f ms, image hash %016llx\n", name, s.numFrames,
+		s.totalMs, s.avgMs, s.p50Ms, s.p95Ms, s.p99Ms, s.worstMs, (unsigned long long)s.imageHash);
+}
+
+/// Records one frame into `colorTarget` of the given size; `time` is the fixed simulation time of the frame
+using HeadlessRenderFunc = std::function<void(lvk::ICommandBuffer& buf, lvk::TextureHandle colorTarget, uint32_t width, uint32_t height, double time)>;
+
+/// Renders `opts.numFrames` frames into an offscreen target, waiting for each one to complete, so every frame time includes
+/// the GPU work. The final image is read back, hashed and written to `opts.outputImage`.
+inline HeadlessStats runHeadless(lvk::IContext& ctx, const HeadlessOptions& opts, const HeadlessRenderFunc& renderFrame)
+{
+	lvk::Holder<lvk::TextureHandle> colorTarget = ctx.createTexture({
+		.type = lvk::TextureType_2D,
+		.format = kHeadlessColorFormat,
+		.dimensions = {opts.width, opts.height},
+		.usage = lvk::TextureUsageBits_Attachment | lvk::TextureUsageBits_Sampled,
+		.debugName = "Headless color target"
+		});
+
+	std::vector<float> frameMs;
+	frameMs.reserve(opts.numFrames);
+
+	using Clock = std::chrono::steady_clock;
+
+	const Clock::time_point start = Clock::now();
+
+	for (uint32_t i = 0; i != opts.numFrames; i++)
+	{
+		const Clock::time_point frameStart = Clock::now();
+
+		lvk::ICommandBuffer& buf = ctx.acquireCommandBuffer();
+		renderFrame(buf, colorTarget, opts.width, opts.height, double(i) * opts.deltaSeconds);
+		ctx.wait(ctx.submit(buf));
+
+		frameMs.push_back(std::chrono::duration<float, std::milli>(Clock::now() - frameStart).count());
+	}
+
+	HeadlessStats stats = {
+		.numFrames = opts.numFrames,
+		.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count(),
+	};
+
+	stats.firstFrameMs = frameMs.front();
+
+	std::sort(frameMs.begin(), frameMs.end());
+
+	auto percentile = [&frameMs](float p) { return frameMs[std::min(size_t(p * frameMs.size()), frameMs.size() - 1)]; };
+
+	stats.avgMs = float(stats.totalMs / opts.numFrames);
+	stats.p50Ms = percentile(0.50f);
+	stats.p95Ms = percentile(0.95f);
+	stats.p99Ms = percentile(0.99f);
+	stats.worstMs = frameMs.back();
+
+	std::vector<uint8_t> pixels(size_t(opts.width) * opts.height * 4);
+	ctx.download(colorTarget, { .dimensions = {opts.width, opts.height} }, pixels.data());
+
+	// FNV-1a
+	stats.imageHash = 14695981039346656037ull;
+	for (uint8_t p : pixels)
+		stats.imageHash = (stats.imageHash ^ p) * 1099511628211ull;
+
+	if (!opts.outputImage.empty() && !stbi_write_png(opts.outputImage.c_str(), (int)opts.width, (int)opts.height, 4, pixels.data(), (int)opts.width * 4))
+		LLOGW("Failed to write %s\n", opts.outputImage.c_str());
+
+	return stats;
+}
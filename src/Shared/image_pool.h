@@ -0,0 +1,392 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+struct ImageMemoryStats
+{
+	/// Buffers handed out, and how many of them came from the cache instead of the heap
+	uint64_t numAllocations = 0;
+	uint64_t numReused = 0;
+	uint64_t numHeapAllocations = 0;
+	uint64_t bytesInUse = 0;
+	uint64_t peakBytesInUse = 0;
+	/// Freed buffers kept for the next image of the same size
+	uint64_t bytesCached = 0;
+	/// The resident set of the whole process
+	uint64_t rssBytes = 0;
+	uint64_t peakRssBytes = 0;
+};
+
+inline uint64_t getRssBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters = {};
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+	long size = 0;
+	long pages = 0;
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f)
+	{
+		if (fscanf(f, "%ld %ld", &size, &pages) != 2)
+			pages = 0;
+		fclose(f);
+	}
+	return uint64_t(pages) * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+inline uint64_t getPeakRssBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters = {};
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+	struct rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+	// kilobytes on Linux
+	return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/// Memory for image data. Freed buffers are kept by size and handed to the next image of the same size, which is what
+/// baking one environment after another asks for: the same chain of sizes every time, without returning the memory to
+/// the heap in between, and without page faults on memory which was already touched by the previous bake.
+class ImageBufferPool
+{
+public:
+	static constexpr size_t kAlignment = 64;
+	/// Sizes are rounded up to this, so images of nearly the same size share buffers
+	static constexpr size_t kGranularity = 4096;
+
+	explicit ImageBufferPool(uint64_t maxCachedBytes = 1ull << 30)
+		: maxCachedBytes_(maxCachedBytes)
+	{
+	}
+
+	~ImageBufferPool() { trim(); }
+
+	ImageBufferPool(const ImageBufferPool&) = delete;
+	ImageBufferPool& operator=(const ImageBufferPool&) = delete;
+
+	/// Uninitialized memory of at least `size` bytes; `size` has to be passed back to release()
+	void* allocate(size_t size)
+	{
+		const size_t bucket = getBucketSize(size);
+
+		std::lock_guard lock(mutex_);
+
+		stats_.numAllocations++;
+		stats_.bytesInUse += bucket;
+		stats_.peakBytesInUse = std::max(stats_.peakBytesInUse, stats_.bytesInUse);
+
+		auto it = free_.find(bucket);
+		if (it != free_.end() && !it->second.empty())
+		{
+			void* ptr = it->second.back();
+			it->second.pop_back();
+			stats_.numReused++;
+			stats_.bytesCached -= bucket;
+			return ptr;
+		}
+
+		stats_.numHeapAllocations++;
+		return ::operator new(bucket, std::align_val_t(kAlignment));
+	}
+
+	void release(void* ptr, size_t size)
+	{
+		if (!ptr)
+			return;
+
+		const size_t bucket = getBucketSize(size);
+
+		std::lock_guard lock(mutex_);
+
+		stats_.bytesInUse -= bucket;
+
+		if (stats_.bytesCached + bucket > maxCachedBytes_)
+		{
+			::operator delete(ptr, std::align_val_t(kAlignment));
+			return;
+		}
+
+		free_[bucket].push_back(ptr);
+		stats_.bytesCached += bucket;
+	}
+
+	/// Returns every cached buffer to the heap, e.g. after a batch of bakes
+	void trim()
+	{
+		std::lock_guard lock(mutex_);
+
+		for (auto& [bucket, ptrs] : free_)
+		{
+			for (void* ptr : ptrs)
+				::operator delete(ptr, std::align_val_t(kAlignment));
+		}
+		free_.clear();
+		stats_.bytesCached = 0;
+	}
+
+	/// 0 turns the cache off: every buffer goes back to the heap when it is released
+	void setMaxCachedBytes(uint64_t maxCachedBytes)
+	{
+		{
+			std::lock_guard lock(mutex_);
+			maxCachedBytes_ = maxCachedBytes;
+		}
+		trim();
+	}
+
+	ImageMemoryStats getStats() const
+	{
+		ImageMemoryStats s;
+		{
+			std::lock_guard lock(mutex_);
+			s = stats_;
+		}
+		s.rssBytes = getRssBytes();
+		s.peakRssBytes = getPeakRssBytes();
+		return s;
+	}
+
+	void resetCounters()
+	{
+		std::lock_guard lock(mutex_);
+		stats_.numAllocations = 0;
+		stats_.numReused = 0;
+		stats_.numHeapAllocations = 0;
+		stats_.peakBytesInUse = stats_.bytesInUse;
+	}
+
+private:
+	static size_t getBucketSize(size_t size) { return (std::max<size_t>(size, 1) + kGranularity - 1) & ~(kGranularity - 1); }
+
+	mutable std::mutex mutex_;
+	std::unordered_map<size_t, std::vector<void*>> free_;
+	uint64_t maxCachedBytes_ = 0;
+	ImageMemoryStats stats_;
+};
+
+/// The pool shared by every Bitmap and scratch arena. It is never destroyed: the arenas of the job system threads
+/// release their memory when those threads exit, which may be after static destructors have run.
+inline ImageBufferPool& getImageBufferPool()
+{
+	static ImageBufferPool* pool = new ImageBufferPool();
+	return *pool;
+}
+
+inline void printImageMemoryStats(const char* prefix)
+{
+	const ImageMemoryStats s = getImageBufferPool().getStats();
+	printf("[%s] Image memory: %llu buffers (%llu reused, %llu from the heap), %.1f MB in use, %.1f MB peak, %.1f MB cached; RSS %.1f MB, peak %.1f MB\n",
+		prefix, (unsigned long long)s.numAllocations, (unsigned long long)s.numReused, (unsigned long long)s.numHeapAllocations,
+		s.bytesInUse / 1048576.0, s.peakBytesInUse / 1048576.0, s.bytesCached / 1048576.0, s.rssBytes / 1048576.0, s.peakRssBytes / 1048576.0);
+}
+
+/// Image data from the pool, or a view of memory which something else owns, e.g. the output of stbi_loadf().
+/// Copies always own their memory, so a copy of a view can outlive what it was viewing; moves keep views as views.
+class ImageBuffer
+{
+public:
+	ImageBuffer() = default;
+
+	/// Zero-filled, as a std::vector would be
+	explicit ImageBuffer(size_t size)
+		: ImageBuffer(size, nullptr)
+	{
+		if (size_)
+			memset(data_, 0, size_);
+	}
+
+	/// No copy of `data`; `owner`, if there is one, is released with the last view, e.g. std::shared_ptr<void>(data, stbi_image_free)
+	static ImageBuffer wrap(void* data, size_t size, std::shared_ptr<void> owner = {})
+	{
+		ImageBuffer b;
+		b.data_ = static_cast<uint8_t*>(data);
+		b.size_ = size;
+		b.isView_ = true;
+		b.owner_ = std::move(owner);
+		return b;
+	}
+
+	ImageBuffer(const ImageBuffer& other)
+		: ImageBuffer(other.size_, nullptr)
+	{
+		if (size_)
+			memcpy(data_, other.data_, size_);
+	}
+
+	ImageBuffer(ImageBuffer&& other) noexcept
+		: data_(std::exchange(other.data_, nullptr))
+		, size_(std::exchange(other.size_, 0))
+		, isView_(std::exchange(other.isView_, false))
+		, owner_(std::move(other.owner_))
+	{
+	}
+
+	ImageBuffer& operator=(ImageBuffer other) noexcept
+	{
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		std::swap(isView_, other.isView_);
+		std::swap(owner_, other.owner_);
+		return *this;
+	}
+
+	~ImageBuffer()
+	{
+		if (!isView_)
+			getImageBufferPool().release(data_, size_);
+	}
+
+	uint8_t* data() { return data_; }
+	const uint8_t* data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	bool isView() const { return isView_; }
+
+	uint8_t* begin() { return data_; }
+	uint8_t* end() { return data_ + size_; }
+	const uint8_t* begin() const { return data_; }
+	const uint8_t* end() const { return data_ + size_; }
+
+	uint8_t& operator[](size_t i) { return data_[i]; }
+	const uint8_t& operator[](size_t i) const { return data_[i]; }
+
+private:
+	/// Uninitialized
+	ImageBuffer(size_t size, std::nullptr_t)
+		: data_(size ? static_cast<uint8_t*>(getImageBufferPool().allocate(size)) : nullptr)
+		, size_(size)
+	{
+	}
+
+	uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+	bool isView_ = false;
+	std::shared_ptr<void> owner_;
+};
+
+/// Bump allocation for the temporary buffers of one operation, e.g. the downsampled source of convolveLambertian().
+/// The blocks come from the image pool and stay with the arena, so repeated bakes reuse the same memory. A Scope rewinds
+/// the arena to where it was when the scope began; scopes nest, like the jobs a waiting thread runs.
+class ScratchArena
+{
+public:
+	explicit ScratchArena(size_t blockSize = 4 * 1024 * 1024)
+		: blockSize_(blockSize)
+	{
+	}
+
+	~ScratchArena()
+	{
+		for (const Block& b : blocks_)
+			getImageBufferPool().release(b.data, b.size);
+	}
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	class Scope
+	{
+	public:
+		explicit Scope(ScratchArena& arena)
+			: arena_(arena)
+			, block_(arena.current_)
+			, offset_(arena.offset_)
+		{
+		}
+		~Scope()
+		{
+			arena_.current_ = block_;
+			arena_.offset_ = offset_;
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		ScratchArena& arena_;
+		size_t block_ = 0;
+		size_t offset_ = 0;
+	};
+
+	/// Uninitialized memory for `count` values, valid until the enclosing scope ends
+	template <typename T> T* allocate(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T>, "Scratch memory is released without destructors");
+		static_assert(alignof(T) <= ImageBufferPool::kAlignment);
+
+		const size_t size = sizeof(T) * count;
+
+		for (;; current_++, offset_ = 0)
+		{
+			if (current_ == blocks_.size())
+			{
+				const size_t blockSize = std::max(blockSize_, size);
+				blocks_.push_back({ static_cast<uint8_t*>(getImageBufferPool().allocate(blockSize)), blockSize });
+			}
+
+			const size_t offset = (offset_ + ImageBufferPool::kAlignment - 1) & ~(ImageBufferPool::kAlignment - 1);
+			if (offset + size <= blocks_[current_].size)
+			{
+				offset_ = offset + size;
+				return reinterpret_cast<T*>(blocks_[current_].data + offset);
+			}
+		}
+	}
+
+	size_t getReservedBytes() const
+	{
+		size_t size = 0;
+		for (const Block& b : blocks_)
+			size += b.size;
+		return size;
+	}
+
+private:
+	struct Block
+	{
+		uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
+	size_t blockSize_ = 0;
+	std::vector<Block> blocks_;
+	size_t current_ = 0;
+	size_t offset_ = 0;
+};
+
+/// One arena per thread, so jobs never share one
+inline ScratchArena& getScratchArena()
+{
+	thread_local ScratchArena arena;
+	return arena;
+}
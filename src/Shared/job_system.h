@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Counts the unfinished jobs started with it. A counter with a parent keeps the parent pending while it has jobs of
+/// its own, so waiting for the parent waits for the whole tree; e.g. a model counter with one child counter per texture.
+/// Jobs may be added to a counter from a job which runs under that counter or under one of its children, never after
+/// the counter has been seen done.
+class JobCounter
+{
+public:
+	explicit JobCounter(JobCounter* parent = nullptr)
+		: parent_(parent)
+	{
+	}
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool isDone() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+	void add(uint32_t numJobs)
+	{
+		if (numJobs && pending_.fetch_add(numJobs, std::memory_order_acq_rel) == 0 && parent_)
+			parent_->add(1);
+	}
+
+	void release()
+	{
+		// a waiter may destroy the counter as soon as it reaches zero
+		JobCounter* parent = parent_;
+		if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1 && parent)
+			parent->release();
+	}
+
+private:
+	JobCounter* parent_ = nullptr;
+	std::atomic<uint32_t> pending_ = 0;
+};
+
+struct JobSystemStats
+{
+	uint32_t numThreads = 0;
+	uint64_t numJobs = 0;
+	/// Jobs taken from the queue of another thread
+	uint64_t numSteals = 0;
+};
+
+/// Work stealing over one deque per worker thread, plus one deque shared by the threads which are not workers.
+/// A thread pushes and pops at the back of its own deque, so nested jobs run depth first while their data is still in
+/// the cache, and steals from the front of the other deques, which holds the oldest and usually the largest jobs.
+/// Waiting never blocks a thread: wait() runs jobs until the counter is done, so jobs may wait for jobs. Threads which must
+/// not run unrelated jobs, e.g. the main thread of a frame, use waitBlocking() instead.
+class JobSystem
+{
+public:
+	/// `numThreads` includes the thread calling wait(), which runs jobs as well. 0 means one per hardware thread, and at least
+	/// one worker, so jobs which nobody waits for, e.g. background texture loads, still make progress on a single core.
+	/// With 1 there are no workers and jobs only run inside wait().
+	explicit JobSystem(uint32_t numThreads = 0)
+		: numThreads_(numThreads ? numThreads : std::max(2u, std::thread::hardware_concurrency()))
+		, queues_(std::make_unique<Queue[]>(numThreads_))
+	{
+		workers_.reserve(numThreads_ - 1);
+		for (uint32_t i = 0; i + 1 < numThreads_; i++)
+			workers_.emplace_back([this, i]() { workerLoop(i); });
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard lock(sleepMutex_);
+			stop_ = true;
+		}
+		sleepCv_.notify_all();
+
+		for (std::thread& t : workers_)
+			t.join();
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void run(JobCounter& counter, std::function<void()> job)
+	{
+		counter.add(1);
+		push({ .fn = std::move(job), .counter = &counter });
+	}
+
+	/// Runs jobs, of this counter or any other, until every job of `counter` has finished. Any queued job may run on the
+	/// calling thread, including long ones such as texture decodes or jobs of unrelated work, so the call can take much
+	/// longer than the jobs of `counter`, and jobs which wait themselves nest on the caller's stack.
+	void wait(const JobCounter& counter)
+	{
+		while (!counter.isDone())
+		{
+			if (!tryRunJob())
+				std::this_thread::yield();
+		}
+	}
+
+	/// Sleeps until every job of `counter` has finished and runs no jobs. Needs a worker to run them, so with one thread it
+	/// falls back to wait(); called from a job, it keeps that worker idle for the whole wait.
+	void waitBlocking(const JobCounter& counter)
+	{
+		if (numThreads_ == 1)
+		{
+			wait(counter);
+			return;
+		}
+
+		numBlockedWaiters_.fetch_add(1);
+		// pairs with the fence in execute(): either the job which finishes the counter sees this waiter, or we see it done
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		{
+			std::unique_lock lock(doneMutex_);
+			doneCv_.wait(lock, [&counter]() { return counter.isDone(); });
+		}
+		numBlockedWaiters_.fetch_sub(1);
+	}
+
+	/// Runs one queued job on the calling thread; false when there was none. For loops which wait for something else
+	/// than a counter, e.g. work which has to run on the main thread.
+	bool tryRunJob()
+	{
+		Job job;
+		if (!tryPop(getQueueIndex(), job))
+			return false;
+		execute(job);
+		return true;
+	}
+
+	/// Calls f(i) for every i in [0, count) and returns when all calls are done. Every job covers `grainSize` indices;
+	/// 0 splits the range into about 4 jobs per thread, which leaves enough of them to balance uneven rows.
+	template <typename F> void parallelFor(uint32_t count, F&& f, uint32_t grainSize = 0)
+	{
+		if (!grainSize)
+			grainSize = std::max(1u, count / (numThreads_ * 4));
+
+		if (numThreads_ == 1 || count <= grainSize)
+		{
+			for (uint32_t i = 0; i != count; i++)
+				f(i);
+			return;
+		}
+
+		JobCounter counter;
+
+		for (uint32_t first = 0; first < count; first += grainSize)
+		{
+			const uint32_t last = std::min(count, first + grainSize);
+			run(counter, [&f, first, last]() {
+				for (uint32_t i = first; i != last; i++)
+					f(i);
+			});
+		}
+
+		wait(counter);
+	}
+
+	uint32_t getNumThreads() const { return numThreads_; }
+
+	JobSystemStats getStats() const
+	{
+		return {
+			.numThreads = numThreads_,
+			.numJobs = numJobs_.load(std::memory_order_relaxed),
+			.numSteals = numSteals_.load(std::memory_order_relaxed),
+		};
+	}
+
+private:
+	struct Job
+	{
+		std::function<void()> fn;
+		JobCounter* counter = nullptr;
+	};
+
+	struct alignas(64) Queue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	/// Workers own queues [0, numThreads - 1); the last one is shared by every other thread
+	uint32_t getQueueIndex() const
+	{
+		return tlsJobSystem_ == this ? tlsQueueIndex_ : numThreads_ - 1;
+	}
+
+	void push(Job&& job)
+	{
+		Queue& q = queues_[getQueueIndex()];
+		{
+			std::lock_guard lock(q.mutex);
+			q.jobs.push_back(std::move(job));
+		}
+
+		// a worker going to sleep registers itself before it checks for jobs, so either it sees this job or we see it
+		numQueued_.fetch_add(1);
+		if (numSleeping_.load() > 0)
+		{
+			std::lock_guard lock(sleepMutex_);
+			sleepCv_.notify_one();
+		}
+	}
+
+	bool tryPop(uint32_t index, Job& job)
+	{
+		{
+			Queue& q = queues_[index];
+			std::lock_guard lock(q.mutex);
+			if (!q.jobs.empty())
+			{
+				job = std::move(q.jobs.back());
+				q.jobs.pop_back();
+				numQueued_.fetch_sub(1);
+				return true;
+			}
+		}
+
+		for (uint32_t i = 1; i != numThreads_; i++)
+		{
+			Queue& q = queues_[(index + i) % numThreads_];
+			std::lock_guard lock(q.mutex);
+			if (!q.jobs.empty())
+			{
+				job = std::move(q.jobs.front());
+				q.jobs.pop_front();
+				numQueued_.fetch_sub(1);
+				numSteals_.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void execute(Job& job)
+	{
+		job.fn();
+		numJobs_.fetch_add(1, std::memory_order_relaxed);
+		job.counter->release();
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (numBlockedWaiters_.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard lock(doneMutex_);
+			doneCv_.notify_all();
+		}
+	}
+
+	void workerLoop(uint32_t index)
+	{
+		tlsJobSystem_ = this;
+		tlsQueueIndex_ = index;
+
+		for (;;)
+		{
+			Job job;
+			if (tryPop(index, job))
+			{
+				execute(job);
+				continue;
+			}
+
+			std::unique_lock lock(sleepMutex_);
+			numSleeping_.fetch_add(1);
+			sleepCv_.wait(lock, [this]() { return stop_ || numQueued_.load() > 0; });
+			numSleeping_.fetch_sub(1);
+
+			if (stop_ && numQueued_.load() == 0)
+				return;
+		}
+	}
+
+	static inline thread_local const JobSystem* tlsJobSystem_ = nullptr;
+	static inline thread_local uint32_t tlsQueueIndex_ = 0;
+
+	const uint32_t numThreads_;
+	std::unique_ptr<Queue[]> queues_;
+	std::vector<std::thread> workers_;
+
+	std::atomic<uint32_t> numQueued_ = 0;
+	std::atomic<uint32_t> numSleeping_ = 0;
+	std::mutex sleepMutex_;
+	std::condition_variable sleepCv_;
+	bool stop_ = false;
+
+	std::atomic<uint32_t> numBlockedWaiters_ = 0;
+	std::mutex doneMutex_;
+	std::condition_variable doneCv_;
+
+	std::atomic<uint64_t> numJobs_ = 0;
+	std::atomic<uint64_t> numSteals_ = 0;
+};
+
+namespace detail
+{
+inline std::unique_ptr<JobSystem>& getJobSystemInstance()
+{
+	static std::unique_ptr<JobSystem> instance = std::make_unique<JobSystem>();
+	return instance;
+}
+} // namespace detail
+
+/// The job system shared by the asset loading, the baking utilities and the chapters, with one thread per core
+inline JobSystem& getJobSystem()
+{
+	return *detail::getJobSystemInstance();
+}
+
+/// Replaces the shared job system, e.g. to measure the scaling with the number of threads; no job may be pending
+inline void resetJobSystem(uint32_t numThreads = 0)
+{
+	std::unique_ptr<JobSystem>& instance = detail::getJobSystemInstance();
+	instance = nullptr;
+	instance = std::make_unique<JobSystem>(numThreads);
+}
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stb/stb_image.h>
+
+enum eAssetClass
+{
+	eAssetClass_Shader,
+	eAssetClass_Image,
+	eAssetClass_Mesh,
+	eAssetClass_Font,
+	// SPIR-V and pipeline caches
+	eAssetClass_Cache,
+	// asset archives themselves (see asset_archive.h)
+	eAssetClass_Archive,
+	eAssetClass_Count
+};
+
+inline const char* getAssetClassName(uint32_t assetClass)
+{
+	static const char* kNames[] = { "Shader", "Image", "Mesh", "Font", "Cache", "Archive" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eAssetClass_Count);
+	return assetClass < eAssetClass_Count ? kNames[assetClass] : "Unknown";
+}
+
+/// How the pages of a mapping will be read, passed on to the OS read-ahead
+enum eFileAccess
+{
+	// front to back once, e.g. an image decoder: read ahead aggressively, pages behind may be dropped early
+	eFileAccess_Sequential,
+	// seeks all over the file: no read-ahead beyond the faulting page
+	eFileAccess_Random,
+	// the whole file is needed right away: start reading all of it in the background now
+	eFileAccess_WillNeed,
+	eFileAccess_Count
+};
+
+inline const char* getFileAccessName(uint32_t access)
+{
+	static const char* kNames[] = { "Sequential", "Random", "Will need" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eFileAccess_Count);
+	return access < eFileAccess_Count ? kNames[access] : "Unknown";
+}
+
+/// Shaders, meshes and caches are small and read whole by their parsers as soon as they are opened; images are streamed
+/// through a decoder, and archives are read one entry at a time
+inline eFileAccess getDefaultFileAccess(eAssetClass assetClass)
+{
+	if (assetClass == eAssetClass_Archive)
+		return eFileAccess_Random;
+	return assetClass == eAssetClass_Image ? eFileAccess_Sequential : eFileAccess_WillNeed;
+}
+
+struct FileIoStats
+{
+	uint64_t numFiles = 0;
+	/// Files which could not be opened or mapped
+	uint64_t numFailed = 0;
+	/// The size of the mapped files; the pages actually touched are up to the readers
+	uint64_t numBytes = 0;
+	/// Files served by the file source, e.g. an archive, instead of the file system
+	uint64_t numFromSource = 0;
+};
+
+namespace detail
+{
+struct FileIoCounters
+{
+	std::atomic<uint64_t> numFiles = 0;
+	std::atomic<uint64_t> numFailed = 0;
+	std::atomic<uint64_t> numBytes = 0;
+	std::atomic<uint64_t> numFromSource = 0;
+};
+
+inline FileIoCounters& getFileIoCounters(eAssetClass assetClass)
+{
+	static FileIoCounters counters[eAssetClass_Count];
+	return counters[assetClass];
+}
+} // namespace detail
+
+inline FileIoStats getFileIoStats(eAssetClass assetClass)
+{
+	const detail::FileIoCounters& c = detail::getFileIoCounters(assetClass);
+	return {
+		.numFiles = c.numFiles.load(std::memory_order_relaxed),
+		.numFailed = c.numFailed.load(std::memory_order_relaxed),
+		.numBytes = c.numBytes.load(std::memory_order_relaxed),
+		.numFromSource = c.numFromSource.load(std::memory_order_relaxed),
+	};
+}
+
+inline void resetFileIoStats()
+{
+	for (uint32_t i = 0; i != eAssetClass_Count; i++)
+	{
+		detail::FileIoCounters& c = detail::getFileIoCounters(eAssetClass(i));
+		c.numFiles = 0;
+		c.numFailed = 0;
+		c.numBytes = 0;
+		c.numFromSource = 0;
+	}
+}
+
+inline void printFileIoStats(const char* prefix)
+{
+	printf("[%s] File I/O:", prefix);
+	for (uint32_t i = 0; i != eAssetClass_Count; i++)
+	{
+		const FileIoStats s = getFileIoStats(eAssetClass(i));
+		if (!s.numFiles && !s.numFailed)
+			continue;
+		printf(" %s %llu files %.1f KB", getAssetClassName(i), (unsigned long long)s.numFiles, s.numBytes / 1024.0);
+		if (s.numFromSource)
+			printf(" (%llu packed)", (unsigned long long)s.numFromSource);
+		if (s.numFailed)
+			printf(" (%llu failed)", (unsigned long long)s.numFailed);
+	}
+	printf("\n");
+}
+
+class MappedFile;
+
+/// Somewhere to open files from before the file system, e.g. a mounted asset archive (see asset_archive.h)
+class FileSource
+{
+public:
+	virtual ~FileSource() = default;
+
+	/// False when the file is not in this source
+	virtual bool open(const std::filesystem::path& file, eAssetClass assetClass, MappedFile& out) const = 0;
+	virtual bool contains(const std::filesystem::path& file) const = 0;
+};
+
+namespace detail
+{
+inline std::shared_ptr<const FileSource>& getFileSource()
+{
+	static std::shared_ptr<const FileSource> source;
+	return source;
+}
+} // namespace detail
+
+/// Files found in `source` are opened from it instead of the file system; nullptr goes back to loose files only.
+/// Nothing synchronizes this with the loads, so set it before anything is loaded.
+inline void setFileSource(std::shared_ptr<const FileSource> source)
+{
+	detail::getFileSource() = std::move(source);
+}
+
+/// A read-only view of a whole file through the page cache: readers parse the mapped memory directly, with no read()
+/// into a buffer of our own. Empty files are valid and have no data.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	MappedFile(const std::filesystem::path& file, eAssetClass assetClass)
+		: MappedFile(file, assetClass, getDefaultFileAccess(assetClass))
+	{
+	}
+
+	/// The file source, when there is one, is asked first and decides on the read-ahead of its own files
+	MappedFile(const std::filesystem::path& file, eAssetClass assetClass, eFileAccess access)
+	{
+		detail::FileIoCounters& counters = detail::getFileIoCounters(assetClass);
+
+		const std::shared_ptr<const FileSource> source = detail::getFileSource();
+		const bool fromSource = source && source->open(file, assetClass, *this);
+
+		if (!fromSource && !map(file, access))
+		{
+			counters.numFailed.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		counters.numFiles.fetch_add(1, std::memory_order_relaxed);
+		counters.numBytes.fetch_add(size_, std::memory_order_relaxed);
+		counters.numFromSource.fetch_add(fromSource, std::memory_order_relaxed);
+	}
+
+	/// Memory which `owner` keeps alive instead of a mapping of its own, e.g. an entry of a mapped archive or a
+	/// decompressed copy of one; not counted as I/O
+	MappedFile(std::shared_ptr<const void> owner, std::span<const uint8_t> bytes)
+		: data_(bytes.data())
+		, size_(bytes.size())
+		, valid_(true)
+		, owner_(std::move(owner))
+	{
+	}
+
+	~MappedFile() { unmap(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept
+		: data_(std::exchange(other.data_, nullptr))
+		, size_(std::exchange(other.size_, 0))
+		, valid_(std::exchange(other.valid_, false))
+		, owner_(std::move(other.owner_))
+	{
+	}
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			unmap();
+			data_ = std::exchange(other.data_, nullptr);
+			size_ = std::exchange(other.size_, 0);
+			valid_ = std::exchange(other.valid_, false);
+			owner_ = std::move(other.owner_);
+		}
+		return *this;
+	}
+
+	bool isValid() const { return valid_; }
+	const uint8_t* data() const { return data_; }
+	size_t size() const { return size_; }
+
+	std::span<const uint8_t> bytes() const { return { data_, size_ }; }
+	std::string_view text() const { return { reinterpret_cast<const char*>(data_), size_ }; }
+
+	/// Read-ahead for a part of the file, e.g. one entry of an archive
+	void advise(size_t offset, size_t size, eFileAccess access) const
+	{
+		if (offset >= size_ || !size)
+			return;
+		adviseRange(data_ + offset, std::min(size, size_ - offset), access);
+	}
+
+private:
+	static size_t getPageSize()
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO info = {};
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+	/// The range is widened to whole pages
+	static void adviseRange(const uint8_t* ptr, size_t size, eFileAccess access)
+	{
+		static const size_t kPageSize = getPageSize();
+
+		const uintptr_t begin = uintptr_t(ptr) & ~uintptr_t(kPageSize - 1);
+		const uintptr_t end = uintptr_t(ptr) + size;
+
+#if defined(_WIN32)
+		// sequential and random access are hints for CreateFile(), which a part of a file cannot have
+		if (access == eFileAccess_WillNeed)
+		{
+			WIN32_MEMORY_RANGE_ENTRY range = { .VirtualAddress = (void*)begin, .NumberOfBytes = end - begin };
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+		}
+#else
+		const int advice = access == eFileAccess_Sequential ? MADV_SEQUENTIAL : access == eFileAccess_Random ? MADV_RANDOM : MADV_WILLNEED;
+		madvise((void*)begin, end - begin, advice);
+#endif
+	}
+
+#if defined(_WIN32)
+	bool map(const std::filesystem::path& file, eFileAccess access)
+	{
+		const DWORD flags = access == eFileAccess_Sequential ? FILE_FLAG_SEQUENTIAL_SCAN
+			: access == eFileAccess_Random ? FILE_FLAG_RANDOM_ACCESS
+			: FILE_ATTRIBUTE_NORMAL;
+
+		HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size = {};
+		if (!GetFileSizeEx(handle, &size))
+		{
+			CloseHandle(handle);
+			return false;
+		}
+
+		if (size.QuadPart == 0)
+		{
+			CloseHandle(handle);
+			valid_ = true;
+			return true;
+		}
+
+		// the view keeps the file and the mapping object alive
+		HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(handle);
+		if (!mapping)
+			return false;
+
+		void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!ptr)
+			return false;
+
+		data_ = static_cast<const uint8_t*>(ptr);
+		size_ = (size_t)size.QuadPart;
+		valid_ = true;
+
+		adviseRange(data_, size_, access);
+
+		return true;
+	}
+
+	void unmap()
+	{
+		if (data_ && !owner_)
+			UnmapViewOfFile(data_);
+		owner_.reset();
+		data_ = nullptr;
+		size_ = 0;
+		valid_ = false;
+	}
+#else
+	bool map(const std::filesystem::path& file, eFileAccess access)
+	{
+		const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+
+		struct stat st = {};
+		if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		{
+			close(fd);
+			return false;
+		}
+
+		if (st.st_size == 0)
+		{
+			close(fd);
+			valid_ = true;
+			return true;
+		}
+
+		// the mapping keeps its own reference to the file
+		void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (ptr == MAP_FAILED)
+			return false;
+
+		data_ = static_cast<const uint8_t*>(ptr);
+		size_ = (size_t)st.st_size;
+		valid_ = true;
+
+		adviseRange(data_, size_, access);
+
+		return true;
+	}
+
+	void unmap()
+	{
+		if (data_ && !owner_)
+			munmap(const_cast<uint8_t*>(data_), size_);
+		owner_.reset();
+		data_ = nullptr;
+		size_ = 0;
+		valid_ = false;
+	}
+#endif
+
+	const uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+	bool valid_ = false;
+	std::shared_ptr<const void> owner_;
+};
+
+/// A file in the file source or on disk
+inline bool fileExists(const std::filesystem::path& file)
+{
+	if (const std::shared_ptr<const FileSource> source = detail::getFileSource(); source && source->contains(file))
+		return true;
+
+	std::error_code ec;
+	return std::filesystem::is_regular_file(file, ec);
+}
+
+/// stbi_load() on a mapped file: the decoder reads the page cache instead of copying through a FILE* buffer
+inline stbi_uc* stbiLoadMapped(const std::filesystem::path& file, int* x, int* y, int* comp, int reqComp)
+{
+	const MappedFile f(file, eAssetClass_Image);
+	if (!f.size() || f.size() > INT_MAX)
+		return nullptr;
+
+	return stbi_load_from_memory(f.data(), (int)f.size(), x, y, comp, reqComp);
+}
+
+inline float* stbiLoadfMapped(const std::filesystem::path& file, int* x, int* y, int* comp, int reqComp)
+{
+	const MappedFile f(file, eAssetClass_Image);
+	if (!f.size() || f.size() > INT_MAX)
+		return nullptr;
+
+	return stbi_loadf_from_memory(f.data(), (int)f.size(), x, y, comp, reqComp);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <lvk/LVK.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/// Matches `Material` in shaders/03-ImGui/common.sp
+struct Material
+{
+	glm::vec4 baseColorFactor = glm::vec4(1.0f);
+	uint32_t baseColorTexture = 0;
+	uint32_t baseColorSampler = 0;
+	float reflectivity = 0.0f;
+	uint32_t padding = 0;
+};
+
+static_assert(sizeof(Material) == 32);
+
+struct MaterialTableStats
+{
+	uint32_t numMaterials = 0;
+	/// cmdUpdateBuffer() calls and bytes of the last flush()
+	uint32_t numUploads = 0;
+	uint64_t uploadedBytes = 0;
+	uint64_t totalUploadedBytes = 0;
+};
+
+/// All materials in one storage buffer, addressed by index from the shaders, so one draw can cover instances with
+/// different materials. Changes are tracked per material and uploaded by flush() as contiguous dirty ranges.
+class MaterialTable
+{
+public:
+	explicit MaterialTable(const std::unique_ptr<lvk::IContext>& ctx, uint32_t capacity = 256)
+		: ctx_(*ctx)
+	{
+		createBuffer(std::max(capacity, 1u));
+	}
+
+	uint32_t add(const Material& material)
+	{
+		const uint32_t index = (uint32_t)materials_.size();
+
+		materials_.push_back(material);
+		dirty_.push_back(false);
+		markDirty(index);
+
+		// the old buffer is destroyed once the GPU is done with it; everything is uploaded to the new one
+		if (materials_.size() > capacity_)
+		{
+			createBuffer(capacity_ * 2);
+			for (uint32_t i = 0; i != materials_.size(); i++)
+				markDirty(i);
+		}
+
+		return index;
+	}
+
+	/// Nothing is uploaded when the material did not change
+	void set(uint32_t index, const Material& material)
+	{
+		if (!memcmp(&materials_[index], &material, sizeof(Material)))
+			return;
+
+		materials_[index] = material;
+		markDirty(index);
+	}
+
+	const Material& get(uint32_t index) const { return materials_[index]; }
+
+	/// Records the uploads of the changed materials; must be called outside of rendering
+	void flush(lvk::ICommandBuffer& buf)
+	{
+		stats_.numUploads = 0;
+		stats_.uploadedBytes = 0;
+
+		if (dirtyList_.empty())
+			return;
+
+		std::sort(dirtyList_.begin(), dirtyList_.end());
+
+		// vkCmdUpdateBuffer() is limited to 64 KB
+		constexpr uint32_t kMaxMaterialsPerUpload = 65536 / sizeof(Material);
+
+		for (size_t i = 0; i != dirtyList_.size();)
+		{
+			const uint32_t first = dirtyList_[i];
+			uint32_t count = 1;
+			while (i + count != dirtyList_.size() && dirtyList_[i + count] == first + count && count != kMaxMaterialsPerUpload)
+				count++;
+
+			buf.cmdUpdateBuffer(buffer_, first * sizeof(Material), count * sizeof(Material), &materials_[first]);
+
+			stats_.numUploads++;
+			stats_.uploadedBytes += count * sizeof(Material);
+			i += count;
+		}
+
+		for (uint32_t index : dirtyList_)
+			dirty_[index] = false;
+		dirtyList_.clear();
+
+		stats_.totalUploadedBytes += stats_.uploadedBytes;
+	}
+
+	/// Changes when the table grows, so fetch it every frame
+	uint64_t getAddress() const { return ctx_.gpuAddress(buffer_); }
+
+	uint32_t getNumMaterials() const { return (uint32_t)materials_.size(); }
+
+	MaterialTableStats getStats() const
+	{
+		MaterialTableStats s = stats_;
+		s.numMaterials = (uint32_t)materials_.size();
+		return s;
+	}
+
+private:
+	void createBuffer(uint32_t capacity)
+	{
+		capacity_ = capacity;
+		buffer_ = ctx_.createBuffer({
+			.usage = lvk::BufferUsageBits_Storage,
+			.storage = lvk::StorageType_Device,
+			.size = sizeof(Material) * capacity_,
+			.debugName = "Buffer: materials",
+			});
+	}
+
+	void markDirty(uint32_t index)
+	{
+		if (dirty_[index])
+			return;
+		dirty_[index] = true;
+		dirtyList_.push_back(index);
+	}
+
+	lvk::IContext& ctx_;
+
+	lvk::Holder<lvk::BufferHandle> buffer_;
+	uint32_t capacity_ = 0;
+
+	std::vector<Material> materials_;
+	std::vector<bool> dirty_;
+	std::vector<uint32_t> dirtyList_;
+
+	MaterialTableStats stats_;
+};
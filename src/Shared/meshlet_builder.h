@@ -0,0 +1,269 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "frustum.h"
+
+constexpr uint32_t kMaxMeshletVertices = 64;
+constexpr uint32_t kMaxMeshletTriangles = 124;
+
+/// Offsets point into MeshletData::vertices and MeshletData::triangles
+struct Meshlet
+{
+	uint32_t vertexOffset = 0;
+	uint32_t triangleOffset = 0;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+};
+
+/// Matches `MeshletBounds` in shaders/02-Model/meshlet_cull.comp
+struct MeshletBounds
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+	glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	/// sin of the cone half-angle; 1 disables cone culling
+	float coneCutoff = 1.0f;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<MeshletBounds> bounds;
+	/// Indices into the original vertex buffer
+	std::vector<uint32_t> vertices;
+	/// 3 local indices per triangle, into the meshlet's range of `vertices`
+	std::vector<uint8_t> triangles;
+};
+
+struct MeshletStats
+{
+	uint32_t numMeshlets = 0;
+	uint32_t numTriangles = 0;
+	/// Average fraction of kMaxMeshletVertices/kMaxMeshletTriangles in use
+	float vertexFill = 0.0f;
+	float triangleFill = 0.0f;
+	/// Meshlet vertices per original vertex; the cost of duplicating vertices on meshlet borders
+	float vertexDuplication = 0.0f;
+	uint32_t numConeCullable = 0;
+};
+
+struct MeshletCullStats
+{
+	uint32_t numVisible = 0;
+	uint32_t numFrustumCulled = 0;
+	uint32_t numConeCulled = 0;
+	uint32_t numVisibleTriangles = 0;
+};
+
+namespace meshlet_detail
+{
+	inline glm::vec3 getPosition(const float* positions, size_t stride, uint32_t index)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + stride * index);
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	inline MeshletBounds computeBounds(const MeshletData& data, const Meshlet& m, const float* positions, size_t stride)
+	{
+		MeshletBounds b;
+
+		glm::vec3 minP(FLT_MAX);
+		glm::vec3 maxP(-FLT_MAX);
+
+		for (uint32_t i = 0; i != m.vertexCount; i++)
+		{
+			const glm::vec3 p = getPosition(positions, stride, data.vertices[m.vertexOffset + i]);
+			minP = glm::min(minP, p);
+			maxP = glm::max(maxP, p);
+		}
+
+		b.center = (minP + maxP) * 0.5f;
+
+		for (uint32_t i = 0; i != m.vertexCount; i++)
+			b.radius = std::max(b.radius, glm::length(getPosition(positions, stride, data.vertices[m.vertexOffset + i]) - b.center));
+
+		// Normal cone: the average triangle normal, widened until it contains every triangle normal
+		std::vector<glm::vec3> normals;
+		normals.reserve(m.triangleCount);
+
+		glm::vec3 axis(0.0f);
+
+		for (uint32_t t = 0; t != m.triangleCount; t++)
+		{
+			const uint8_t* tri = &data.triangles[(m.triangleOffset + t) * 3];
+			const glm::vec3 p0 = getPosition(positions, stride, data.vertices[m.vertexOffset + tri[0]]);
+			const glm::vec3 p1 = getPosition(positions, stride, data.vertices[m.vertexOffset + tri[1]]);
+			const glm::vec3 p2 = getPosition(positions, stride, data.vertices[m.vertexOffset + tri[2]]);
+			const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			const float len = glm::length(n);
+			if (len <= 0.0f)
+				continue;
+			normals.push_back(n / len);
+			axis += normals.back();
+		}
+
+		const float axisLength = glm::length(axis);
+
+		if (normals.empty() || axisLength <= 0.0f)
+			return b;
+
+		b.coneAxis = axis / axisLength;
+
+		float minDot = 1.0f;
+		for (const glm::vec3& n : normals)
+			minDot = std::min(minDot, glm::dot(b.coneAxis, n));
+
+		// a cone wider than ~85 degrees never culls anything
+		if (minDot > 0.1f)
+			b.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+
+		return b;
+	}
+} // namespace meshlet_detail
+
+/// Splits an indexed triangle list into meshlets of at most kMaxMeshletVertices vertices and kMaxMeshletTriangles triangles.
+/// Triangles are taken in index order, so the input should already be optimized for vertex locality.
+/// `positions` points at the first float3 position, `stride` is the size of one vertex in bytes.
+inline MeshletData buildMeshlets(const float* positions, size_t stride, size_t numVertices, std::span<const uint32_t> indices)
+{
+	MeshletData data;
+
+	data.meshlets.reserve(indices.size() / 3 / kMaxMeshletTriangles + 1);
+	data.vertices.reserve(indices.size() / 2);
+	data.triangles.reserve(indices.size());
+
+	// local index of each vertex in the current meshlet; 0xff when it is not there yet
+	std::vector<uint8_t> localIndex(numVertices, 0xff);
+
+	Meshlet current;
+
+	auto flush = [&]() {
+		if (!current.triangleCount)
+			return;
+		for (uint32_t i = 0; i != current.vertexCount; i++)
+			localIndex[data.vertices[current.vertexOffset + i]] = 0xff;
+		data.meshlets.push_back(current);
+		current = {
+			.vertexOffset = (uint32_t)data.vertices.size(),
+			.triangleOffset = (uint32_t)data.triangles.size() / 3,
+		};
+	};
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const uint32_t tri[3] = { indices[i + 0], indices[i + 1], indices[i + 2] };
+
+		uint32_t numNewVertices = 0;
+		for (uint32_t v : tri)
+			numNewVertices += localIndex[v] == 0xff;
+		// a degenerate triangle referencing the same new vertex twice is counted twice, which is harmless
+		if (current.vertexCount + numNewVertices > kMaxMeshletVertices || current.triangleCount == kMaxMeshletTriangles)
+			flush();
+
+		for (uint32_t v : tri)
+		{
+			if (localIndex[v] == 0xff)
+			{
+				localIndex[v] = (uint8_t)current.vertexCount++;
+				data.vertices.push_back(v);
+			}
+			data.triangles.push_back(localIndex[v]);
+		}
+
+		current.triangleCount++;
+	}
+
+	flush();
+
+	data.bounds.reserve(data.meshlets.size());
+	for (const Meshlet& m : data.meshlets)
+		data.bounds.push_back(meshlet_detail::computeBounds(data, m, positions, stride));
+
+	return data;
+}
+
+/// An index buffer with the triangles of every meshlet in order, for drawing meshlets with indexed draws:
+/// meshlet `i` is `triangleCount * 3` indices starting at `triangleOffset * 3`.
+inline std::vector<uint32_t> getMeshletIndices(const MeshletData& data)
+{
+	std::vector<uint32_t> indices;
+	indices.reserve(data.triangles.size());
+
+	for (const Meshlet& m : data.meshlets)
+	{
+		for (uint32_t i = 0; i != m.triangleCount * 3; i++)
+			indices.push_back(data.vertices[m.vertexOffset + data.triangles[m.triangleOffset * 3 + i]]);
+	}
+
+	return indices;
+}
+
+inline MeshletStats getMeshletStats(const MeshletData& data, size_t numVertices)
+{
+	MeshletStats stats = { .numMeshlets = (uint32_t)data.meshlets.size(), .numTriangles = (uint32_t)data.triangles.size() / 3 };
+
+	if (data.meshlets.empty())
+		return stats;
+
+	for (const MeshletBounds& b : data.bounds)
+		stats.numConeCullable += b.coneCutoff < 1.0f;
+
+	stats.vertexFill = float(data.vertices.size()) / float(data.meshlets.size() * kMaxMeshletVertices);
+	stats.triangleFill = float(stats.numTriangles) / float(data.meshlets.size() * kMaxMeshletTriangles);
+	stats.vertexDuplication = numVertices ? float(data.vertices.size()) / float(numVertices) : 0.0f;
+
+	return stats;
+}
+
+/// The same test as shaders/02-Model/meshlet_cull.comp. `cameraPos` is in the space of `planes`.
+inline bool isMeshletVisible(const MeshletBounds& b, const glm::vec4 planes[6], const glm::vec3& cameraPos, bool* coneCulled = nullptr)
+{
+	for (int i = 0; i != 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), b.center) + planes[i].w < -b.radius * glm::length(glm::vec3(planes[i])))
+			return false;
+	}
+
+	// every triangle faces away from the camera
+	const glm::vec3 v = b.center - cameraPos;
+	if (glm::dot(v, b.coneAxis) >= b.coneCutoff * glm::length(v) + b.radius)
+	{
+		if (coneCulled)
+			*coneCulled = true;
+		return false;
+	}
+
+	return true;
+}
+
+inline MeshletCullStats cullMeshlets(const MeshletData& data, const glm::mat4& mvp, const glm::vec3& cameraPos)
+{
+	glm::vec4 planes[6];
+	getFrustumPlanes(mvp, planes);
+
+	MeshletCullStats stats;
+
+	for (size_t i = 0; i != data.meshlets.size(); i++)
+	{
+		bool coneCulled = false;
+		if (isMeshletVisible(data.bounds[i], planes, cameraPos, &coneCulled))
+		{
+			stats.numVisible++;
+			stats.numVisibleTriangles += data.meshlets[i].triangleCount;
+		}
+		else
+		{
+			coneCulled ? stats.numConeCulled++ : stats.numFrustumCulled++;
+		}
+	}
+
+	return stats;
+}
@@ -1,9 +1,14 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <filesystem>
 #include <vector>
 
 #include <assimp/scene.h>
 #include <assimp/version.h>
+#include <assimp/cfileio.h>
 #include <assimp/cimport.h>
 #include <assimp/postprocess.h>
 
@@ -12,6 +17,121 @@
 
 #include <stb/stb_image.h>
 
+#include <lvk/LVK.h>
+
+#include "mapped_file.h"
+
+namespace detail
+{
+/// An Assimp file over a mapping. Assimp opens files only to test that they exist as well, so the mapping is made on
+/// the first access and those files are not counted as I/O.
+struct MappedAiFile
+{
+	std::filesystem::path path;
+	MappedFile file;
+	bool mapped = false;
+	size_t pos = 0;
+
+	const MappedFile& get()
+	{
+		if (!mapped)
+		{
+			file = MappedFile(path, eAssetClass_Mesh);
+			mapped = true;
+		}
+		return file;
+	}
+};
+
+inline MappedAiFile* getMappedAiFile(aiFile* f)
+{
+	return reinterpret_cast<MappedAiFile*>(f->UserData);
+}
+
+inline size_t mappedAiFileRead(aiFile* f, char* buffer, size_t size, size_t count)
+{
+	MappedAiFile* m = getMappedAiFile(f);
+	const MappedFile& file = m->get();
+
+	if (!size || m->pos >= file.size())
+		return 0;
+
+	const size_t n = std::min(count, (file.size() - m->pos) / size);
+	memcpy(buffer, file.data() + m->pos, n * size);
+	m->pos += n * size;
+
+	return n;
+}
+
+inline size_t mappedAiFileWrite(aiFile*, const char*, size_t, size_t)
+{
+	return 0;
+}
+
+inline size_t mappedAiFileTell(aiFile* f)
+{
+	return getMappedAiFile(f)->pos;
+}
+
+inline size_t mappedAiFileSize(aiFile* f)
+{
+	return getMappedAiFile(f)->get().size();
+}
+
+inline aiReturn mappedAiFileSeek(aiFile* f, size_t offset, aiOrigin origin)
+{
+	MappedAiFile* m = getMappedAiFile(f);
+	const size_t size = m->get().size();
+
+	const size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? m->pos : size;
+	if (base + offset > size)
+		return aiReturn_FAILURE;
+
+	m->pos = base + offset;
+	return aiReturn_SUCCESS;
+}
+
+inline void mappedAiFileFlush(aiFile*)
+{
+}
+
+inline aiFile* mappedAiFileOpen(aiFileIO*, const char* name, const char* mode)
+{
+	if (strchr(mode, 'w') || strchr(mode, 'a') || !fileExists(name))
+		return nullptr;
+
+	aiFile* f = new aiFile();
+	f->ReadProc = &mappedAiFileRead;
+	f->WriteProc = &mappedAiFileWrite;
+	f->TellProc = &mappedAiFileTell;
+	f->FileSizeProc = &mappedAiFileSize;
+	f->SeekProc = &mappedAiFileSeek;
+	f->FlushProc = &mappedAiFileFlush;
+	f->UserData = reinterpret_cast<aiUserData>(new MappedAiFile{ .path = name });
+
+	return f;
+}
+
+inline void mappedAiFileClose(aiFileIO*, aiFile* f)
+{
+	delete getMappedAiFile(f);
+	delete f;
+}
+} // namespace detail
+
+/// aiImportFile() with every file of the model, e.g. the .gltf and its .bin buffers, read from a mapping. Assimp still
+/// copies what it reads into its own buffers; the file is no longer read into a stdio buffer first.
+inline const aiScene* aiImportFileMapped(const std::filesystem::path& file, unsigned int flags)
+{
+	aiFileIO io = {
+		.OpenProc = &detail::mappedAiFileOpen,
+		.CloseProc = &detail::mappedAiFileClose,
+		.UserData = nullptr,
+	};
+
+	return aiImportFileEx(file.string().c_str(), flags, &io);
+}
+
 
 struct Vertex
 {
@@ -21,7 +141,7 @@ struct Vertex
 
 inline void loadModelData(const std::filesystem::path& file, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices)
 {
-	const aiScene* scene = aiImportFile(file.string().c_str(), aiProcess_Triangulate);
+	const aiScene* scene = aiImportFileMapped(file, aiProcess_Triangulate);
 
 	if (!scene || !scene->HasMeshes())
 	{
@@ -61,7 +181,7 @@ inline void loadModelData(const std::filesystem::path& file, std::vector<Vertex>
 inline lvk::Holder<lvk::TextureHandle> loadTexture(const std::filesystem::path& filePath, std::unique_ptr<lvk::IContext>& ctx)
 {
 	int w, h, comp;
-	const uint8_t* image = stbi_load(filePath.string().c_str(), &w, &h, &comp, 4);
+	const uint8_t* image = stbiLoadMapped(filePath, &w, &h, &comp, 4);
 	assert(image);
 
 	lvk::Holder<lvk::TextureHandle> texture = ctx->createTexture({
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <lvk/LVK.h>
+#include <lvk/vulkan/VulkanClasses.h>
+#include <minilog/minilog.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader_processor.h"
+#include "job_system.h"
+#include "mapped_file.h"
+
+#if __has_include(<glslang/build_info.h>)
+#include <glslang/build_info.h>
+#endif
+
+/// The LVK submodule revision, set by CMake; it salts the SPIR-V cache keys together with the glslang version
+#ifndef LVK_REVISION
+#define LVK_REVISION ""
+#endif
+
+/// The driver pipeline cache blob is saved here on exit and fed back into lvk::ContextConfig on the next launch
+constexpr const char* kPipelineCacheFile = ".cache/pipeline_cache.bin";
+
+/// Returns an empty vector when there is no cache yet. The data must stay alive until the context is initialized.
+inline std::vector<uint8_t> loadPipelineCacheData(const fs::path& file = kPipelineCacheFile)
+{
+	const MappedFile in(file, eAssetClass_Cache);
+
+	return std::vector<uint8_t>(in.bytes().begin(), in.bytes().end());
+}
+
+/// The driver validates the blob header (vendor, device, cache UUID) and ignores blobs which came from a different GPU or driver
+inline lvk::ContextConfig makeContextConfig(const std::vector<uint8_t>& pipelineCacheData)
+{
+	return lvk::ContextConfig{
+		.pipelineCacheData = pipelineCacheData.empty() ? nullptr : pipelineCacheData.data(),
+		.pipelineCacheDataSize = pipelineCacheData.size(),
+	};
+}
+
+/// Call before the context is destroyed, after the pipelines have been used: LVK creates VkPipelines lazily on first bind
+inline bool savePipelineCacheData(lvk::IContext& ctx, const fs::path& file = kPipelineCacheFile)
+{
+	lvk::VulkanContext& vkCtx = static_cast<lvk::VulkanContext&>(ctx);
+
+	if (vkCtx.pipelineCache_ == VK_NULL_HANDLE)
+		return false;
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(vkCtx.getVkDevice(), vkCtx.pipelineCache_, &size, nullptr) != VK_SUCCESS || !size)
+		return false;
+
+	std::vector<uint8_t> data(size);
+	if (vkGetPipelineCacheData(vkCtx.getVkDevice(), vkCtx.pipelineCache_, &size, data.data()) != VK_SUCCESS)
+		return false;
+
+	std::error_code ec;
+	fs::create_directories(file.parent_path(), ec);
+
+	std::ofstream out(file, std::ios::binary);
+	if (!out)
+	{
+		LLOGW("Failed to write pipeline cache %s\n", file.string().c_str());
+		return false;
+	}
+	out.write(reinterpret_cast<const char*>(data.data()), size);
+
+	LLOGL("Pipeline cache: saved %zu bytes to %s\n", size, file.string().c_str());
+	return true;
+}
+
+struct PipelineLibraryStats
+{
+	uint32_t numPipelineRequests = 0;
+	uint32_t numPipelinesCreated = 0;
+	uint32_t numShadersCompiled = 0;
+	uint32_t numShadersFromCache = 0;
+	/// Sources without #version, which the context compiles with its own preamble and which are not cached
+	uint32_t numShadersFromGlsl = 0;
+	double shaderLoadMs = 0.0;
+};
+
+/// Owns shader modules and render pipelines. Identical pipeline descriptions return the same pipeline;
+/// shaders are compiled to SPIR-V on worker threads, and the SPIR-V is cached on disk keyed by the preprocessed source.
+/// Sources without #version rely on the preamble LVK prepends to them (#version, extensions, the bindless arrays), which
+/// only ctx.createShaderModule() adds; they are handed to the context as GLSL on the calling thread instead.
+class PipelineLibrary
+{
+public:
+	explicit PipelineLibrary(lvk::IContext& ctx, const fs::path& spirvCacheDir = ".cache/spirv")
+		: ctx_(ctx)
+		, spirvCacheDir_(spirvCacheDir)
+	{
+		std::error_code ec;
+		fs::create_directories(spirvCacheDir_, ec);
+	}
+
+	/// Compiles all shaders in parallel on the job system. Files that were loaded before are not compiled again.
+	std::vector<lvk::ShaderModuleHandle> loadShaderModules(const std::vector<fs::path>& files)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		struct Compiled
+		{
+			std::vector<uint8_t> spirv;
+			/// Set instead of `spirv` for sources without #version
+			std::string glsl;
+			bool fromCache = false;
+		};
+
+		std::vector<Compiled> compiled(files.size());
+		std::vector<bool> started(files.size());
+
+		JobCounter counter;
+
+		for (size_t i = 0; i != files.size(); i++)
+		{
+			if (shaderModules_.contains(files[i].string()))
+				continue;
+
+			started[i] = true;
+
+			getJobSystem().run(counter, [this, file = files[i], &c = compiled[i]]() {
+				const std::string code = readShaderFile(file);
+				if (code.empty())
+					return;
+
+				if (!hasVersionDirective(code))
+				{
+					c.glsl = code;
+					return;
+				}
+
+				const lvk::ShaderStage stage = shaderStageFromPath(file);
+				const fs::path cacheFile = spirvCacheDir_ / (std::to_string(hashSource(code, stage)) + ".spv");
+
+				if (fileExists(cacheFile))
+				{
+					const MappedFile in(cacheFile, eAssetClass_Cache);
+					c.spirv.assign(in.bytes().begin(), in.bytes().end());
+					c.fromCache = !c.spirv.empty();
+				}
+
+				if (!c.fromCache)
+				{
+					const lvk::Result result = lvk::compileShaderGlslang(stage, code.c_str(), &c.spirv, glslang_default_resource());
+					if (!result.isOk())
+					{
+						LLOGW("Shader compilation failed: %s\n%s\n", file.string().c_str(), result.message);
+						c.spirv.clear();
+						return;
+					}
+					saveSPIRV(cacheFile, c.spirv);
+				}
+			});
+		}
+
+		getJobSystem().wait(counter);
+
+		std::vector<lvk::ShaderModuleHandle> handles(files.size());
+
+		// shader modules are created on this thread, the context is not thread-safe
+		for (size_t i = 0; i != files.size(); i++)
+		{
+			const std::string key = files[i].string();
+
+			if (started[i])
+			{
+				const Compiled& c = compiled[i];
+
+				if (c.spirv.empty() && c.glsl.empty())
+					continue;
+
+				const std::string debugName = "Shader module : " + key;
+				const lvk::ShaderStage stage = shaderStageFromPath(files[i]);
+
+				lvk::Result result;
+				lvk::Holder<lvk::ShaderModuleHandle> module =
+					c.glsl.empty() ? ctx_.createShaderModule({ c.spirv.data(), c.spirv.size(), stage, debugName.c_str() }, &result)
+								   : ctx_.createShaderModule({ c.glsl.c_str(), stage, debugName.c_str() }, &result);
+
+				if (!result.isOk())
+				{
+					LLOGW("Failed to create shader module %s: %s\n", key.c_str(), result.message);
+					continue;
+				}
+
+				!c.glsl.empty() ? stats_.numShadersFromGlsl++ : c.fromCache ? stats_.numShadersFromCache++ : stats_.numShadersCompiled++;
+
+				shaderModules_[key] = std::move(module);
+			}
+
+			auto it = shaderModules_.find(key);
+			if (it != shaderModules_.end())
+				handles[i] = it->second;
+		}
+
+		stats_.shaderLoadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		return handles;
+	}
+
+	lvk::ShaderModuleHandle loadShaderModule(const fs::path& file)
+	{
+		return loadShaderModules({ file })[0];
+	}
+
+	/// The debug name does not take part in the comparison
+	lvk::RenderPipelineHandle getRenderPipeline(const lvk::RenderPipelineDesc& desc)
+	{
+		stats_.numPipelineRequests++;
+
+		const std::string key = makeKey(desc);
+
+		auto it = pipelines_.find(key);
+		if (it != pipelines_.end())
+			return it->second;
+
+		lvk::Result result;
+		lvk::Holder<lvk::RenderPipelineHandle> pipeline = ctx_.createRenderPipeline(desc, &result);
+
+		if (!result.isOk())
+		{
+			LLOGW("Failed to create render pipeline %s: %s\n", desc.debugName, result.message);
+			return {};
+		}
+
+		stats_.numPipelinesCreated++;
+
+		const lvk::RenderPipelineHandle handle = pipeline;
+		pipelines_[key] = std::move(pipeline);
+		return handle;
+	}
+
+	const PipelineLibraryStats& getStats() const { return stats_; }
+
+	void printStats(const char* name) const
+	{
+		printf("[%s] pipelines: %u requested, %u created; shaders: %u compiled, %u from SPIR-V cache, %u by the context in %.1f ms\n", name,
+			stats_.numPipelineRequests, stats_.numPipelinesCreated, stats_.numShadersCompiled, stats_.numShadersFromCache, stats_.numShadersFromGlsl,
+			stats_.shaderLoadMs);
+	}
+
+	/// Destroys everything; must happen before the context goes away
+	void clear()
+	{
+		pipelines_.clear();
+		shaderModules_.clear();
+	}
+
+private:
+	/// A #version directive at the start of a line, outside of // comments
+	static bool hasVersionDirective(const std::string& code)
+	{
+		for (size_t pos = code.find("#version"); pos != std::string::npos; pos = code.find("#version", pos + 1))
+		{
+			const size_t lineStart = code.rfind('\n', pos) + 1;
+			if (code.find_first_not_of(" \t", lineStart) == pos)
+				return true;
+		}
+		return false;
+	}
+
+	/// Bump when the way sources are compiled changes, e.g. the options passed to lvk::compileShaderGlslang()
+	static constexpr uint32_t kSpirvCacheVersion = 1;
+
+	/// What else the SPIR-V depends on: a new glslang or LVK gets new cache entries
+	static std::string getCompilerSalt()
+	{
+		std::string salt = "v" + std::to_string(kSpirvCacheVersion) + " lvk " + LVK_REVISION;
+#if defined(GLSLANG_VERSION_MAJOR)
+		salt += " glslang " + std::to_string(GLSLANG_VERSION_MAJOR) + "." + std::to_string(GLSLANG_VERSION_MINOR) + "." +
+				std::to_string(GLSLANG_VERSION_PATCH) + GLSLANG_VERSION_FLAVOR;
+#endif
+		return salt;
+	}
+
+	// FNV-1a
+	static uint64_t hashSource(const std::string& code, lvk::ShaderStage stage)
+	{
+		static const std::string salt = getCompilerSalt();
+
+		uint64_t hash = 14695981039346656037ull ^ uint64_t(stage);
+		for (char c : salt)
+			hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+		for (char c : code)
+			hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+		return hash;
+	}
+
+	template <typename T> static void append(std::string& key, const T& value)
+	{
+		key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	/// Field by field, so padding bytes and pointers never end up in the key
+	static std::string makeKey(const lvk::RenderPipelineDesc& desc)
+	{
+		std::string key;
+		key.reserve(256);
+
+		append(key, desc.topology);
+
+		const lvk::VertexInput& vi = desc.vertexInput;
+		for (uint32_t i = 0; i != vi.getNumAttributes(); i++)
+		{
+			append(key, vi.attributes[i].location);
+			append(key, vi.attributes[i].binding);
+			append(key, vi.attributes[i].format);
+			append(key, vi.attributes[i].offset);
+		}
+		for (uint32_t i = 0; i != vi.getNumInputBindings(); i++)
+			append(key, vi.inputBindings[i].stride);
+
+		for (lvk::ShaderModuleHandle sm : { desc.smVert, desc.smTesc, desc.smTese, desc.smGeom, desc.smFrag })
+		{
+			append(key, sm.index());
+			append(key, sm.gen());
+		}
+
+		const lvk::SpecializationConstantDesc& spec = desc.specInfo;
+		for (uint32_t i = 0; i != spec.getNumSpecializationConstants(); i++)
+		{
+			append(key, spec.entries[i].constantId);
+			append(key, spec.entries[i].offset);
+			append(key, spec.entries[i].size);
+		}
+		if (spec.data && spec.dataSize)
+			key.append(static_cast<const char*>(spec.data), spec.dataSize);
+
+		for (uint32_t i = 0; i != desc.getNumColorAttachments(); i++)
+		{
+			const lvk::ColorAttachment& c = desc.color[i];
+			append(key, c.format);
+			append(key, c.blendEnabled);
+			append(key, c.rgbBlendOp);
+			append(key, c.alphaBlendOp);
+			append(key, c.srcRGBBlendFactor);
+			append(key, c.srcAlphaBlendFactor);
+			append(key, c.dstRGBBlendFactor);
+			append(key, c.dstAlphaBlendFactor);
+		}
+
+		append(key, desc.depthFormat);
+		append(key, desc.stencilFormat);
+		append(key, desc.cullMode);
+		append(key, desc.frontFaceWinding);
+		append(key, desc.polygonMode);
+
+		for (const lvk::StencilState& s : { desc.backFaceStencil, desc.frontFaceStencil })
+		{
+			append(key, s.stencilFailureOp);
+			append(key, s.depthFailureOp);
+			append(key, s.depthStencilPassOp);
+			append(key, s.stencilCompareOp);
+			append(key, s.readMask);
+			append(key, s.writeMask);
+		}
+
+		append(key, desc.samplesCount);
+		append(key, desc.patchControlPoints);
+		append(key, desc.minSampleShading);
+
+		return key;
+	}
+
+	lvk::IContext& ctx_;
+	const fs::path spirvCacheDir_;
+
+	std::unordered_map<std::string, lvk::Holder<lvk::ShaderModuleHandle>> shaderModules_;
+	std::unordered_map<std::string, lvk::Holder<lvk::RenderPipelineHandle>> pipelines_;
+
+	PipelineLibraryStats stats_;
+};
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <lvk/LVK.h>
+#include <minilog/minilog.h>
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <string>
+#include <vector>
+
+using RenderGraphResource = uint32_t;
+
+constexpr RenderGraphResource kInvalidRenderGraphResource = ~0u;
+
+/// Attachment whose lifetime is limited to one frame. The size is relative to the size passed to RenderGraph::beginFrame().
+struct RenderGraphTextureDesc
+{
+	lvk::Format format = lvk::Format_Invalid;
+	uint8_t usage = lvk::TextureUsageBits_Attachment;
+	float scale = 1.0f;
+};
+
+struct RenderGraphAttachment
+{
+	RenderGraphResource resource = kInvalidRenderGraphResource;
+	lvk::LoadOp loadOp = lvk::LoadOp_Clear;
+	lvk::StoreOp storeOp = lvk::StoreOp_Store;
+	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float clearDepth = 1.0f;
+};
+
+struct RenderGraphPassDesc
+{
+	const char* name = "";
+	std::vector<RenderGraphAttachment> color;
+	RenderGraphAttachment depth;
+	/// Textures sampled by this pass; they are transitioned before the pass begins
+	std::vector<RenderGraphResource> reads;
+	/// Buffers written earlier in the frame, e.g. indirect draw arguments generated by a compute shader
+	std::vector<lvk::BufferHandle> readBuffers;
+	std::function<void(lvk::ICommandBuffer& buf, const lvk::Framebuffer& framebuffer)> execute;
+};
+
+struct RenderGraphStats
+{
+	uint32_t numPasses = 0;
+	uint32_t numCulledPasses = 0;
+	uint32_t numTransients = 0;
+	uint32_t numPhysicalTextures = 0;
+};
+
+/// A frame graph on top of lvk::ICommandBuffer. Passes and resources are declared every frame, in execution order:
+///   - passes which do not contribute to an output are dropped;
+///   - transient attachments with equal descriptions and disjoint lifetimes share one texture;
+///   - transient textures follow the frame size and are recreated when it changes;
+///   - sampled inputs become lvk::Dependencies, so LVK emits the layout transitions before each pass.
+class RenderGraph
+{
+public:
+	explicit RenderGraph(lvk::IContext& ctx)
+		: ctx_(ctx)
+	{
+	}
+
+	void beginFrame(uint32_t width, uint32_t height)
+	{
+		if (width != width_ || height != height_)
+		{
+			// LVK defers the destruction until the GPU is done with the textures
+			physical_.clear();
+			width_ = width;
+			height_ = height;
+		}
+
+		resources_.clear();
+		passes_.clear();
+		stats_ = {};
+	}
+
+	RenderGraphResource importTexture(const char* name, lvk::TextureHandle texture)
+	{
+		resources_.push_back({ .name = name, .imported = true, .texture = texture });
+		return RenderGraphResource(resources_.size() - 1);
+	}
+
+	RenderGraphResource createTexture(const char* name, const RenderGraphTextureDesc& desc)
+	{
+		resources_.push_back({ .name = name, .desc = desc });
+		return RenderGraphResource(resources_.size() - 1);
+	}
+
+	/// Outputs and everything they depend on are never culled
+	void markOutput(RenderGraphResource resource)
+	{
+		resources_[resource].isOutput = true;
+	}
+
+	void addPass(RenderGraphPassDesc&& pass)
+	{
+		assert(pass.color.size() <= lvk::kMaxColorAttachments);
+		passes_.push_back({ .desc = std::move(pass) });
+	}
+
+	/// Culls passes and binds transient resources to textures
+	void compile()
+	{
+		cullPasses();
+
+		for (Resource& r : resources_)
+		{
+			r.firstPass = ~0u;
+			r.lastPass = 0;
+		}
+
+		for (uint32_t i = 0; i != passes_.size(); i++)
+		{
+			if (!passes_[i].alive)
+				continue;
+			forEachResource(passes_[i].desc, [this, i](RenderGraphResource res, bool) {
+				Resource& r = resources_[res];
+				r.firstPass = std::min(r.firstPass, i);
+				r.lastPass = std::max(r.lastPass, i);
+			});
+		}
+
+		// outputs must survive until the end of the frame
+		for (Resource& r : resources_)
+		{
+			if (r.isOutput)
+				r.lastPass = (uint32_t)passes_.size();
+		}
+
+		for (Physical& p : physical_)
+			p.busyUntilPass = kUnused;
+
+		for (Resource& r : resources_)
+		{
+			if (r.imported || r.firstPass == ~0u)
+				continue;
+			r.texture = acquirePhysical(r);
+			stats_.numTransients++;
+		}
+
+		// textures not needed anymore, e.g. after passes got culled
+		std::erase_if(physical_, [](const Physical& p) { return p.busyUntilPass == kUnused; });
+
+		stats_.numPasses = (uint32_t)passes_.size();
+		stats_.numPhysicalTextures = (uint32_t)physical_.size();
+	}
+
+	void execute(lvk::ICommandBuffer& buf)
+	{
+		for (const Pass& pass : passes_)
+		{
+			if (!pass.alive)
+				continue;
+
+			const RenderGraphPassDesc& desc = pass.desc;
+
+			lvk::RenderPass renderPass = {};
+			lvk::Framebuffer framebuffer = { .debugName = desc.name };
+			lvk::Dependencies deps = {};
+
+			for (size_t i = 0; i != desc.color.size(); i++)
+			{
+				const RenderGraphAttachment& a = desc.color[i];
+				renderPass.color[i] = { .loadOp = a.loadOp, .storeOp = a.storeOp };
+				std::copy(a.clearColor, a.clearColor + 4, renderPass.color[i].clearColor);
+				framebuffer.color[i].texture = getTexture(a.resource);
+			}
+
+			if (desc.depth.resource != kInvalidRenderGraphResource)
+			{
+				renderPass.depth = { .loadOp = desc.depth.loadOp, .storeOp = desc.depth.storeOp, .clearDepth = desc.depth.clearDepth };
+				framebuffer.depthStencil.texture = getTexture(desc.depth.resource);
+			}
+
+			assert(desc.reads.size() <= lvk::Dependencies::LVK_MAX_SUBMIT_DEPENDENCIES);
+			assert(desc.readBuffers.size() <= lvk::Dependencies::LVK_MAX_SUBMIT_DEPENDENCIES);
+
+			for (size_t i = 0; i != desc.reads.size(); i++)
+				deps.textures[i] = getTexture(desc.reads[i]);
+			for (size_t i = 0; i != desc.readBuffers.size(); i++)
+				deps.buffers[i] = desc.readBuffers[i];
+
+			buf.cmdBeginRendering(renderPass, framebuffer, deps);
+			if (desc.execute)
+				desc.execute(buf, framebuffer);
+			buf.cmdEndRendering();
+		}
+	}
+
+	/// Valid after compile()
+	lvk::TextureHandle getTexture(RenderGraphResource resource) const
+	{
+		return resources_[resource].texture;
+	}
+
+	lvk::Format getFormat(RenderGraphResource resource) const
+	{
+		const Resource& r = resources_[resource];
+		return r.imported ? ctx_.getFormat(r.texture) : r.desc.format;
+	}
+
+	const RenderGraphStats& getStats() const { return stats_; }
+
+private:
+	static constexpr uint32_t kUnused = ~0u;
+
+	struct Resource
+	{
+		std::string name;
+		bool imported = false;
+		bool isOutput = false;
+		lvk::TextureHandle texture;
+		RenderGraphTextureDesc desc;
+		uint32_t firstPass = ~0u;
+		uint32_t lastPass = 0;
+	};
+
+	struct Pass
+	{
+		RenderGraphPassDesc desc;
+		bool alive = true;
+	};
+
+	struct Physical
+	{
+		lvk::Holder<lvk::TextureHandle> texture;
+		lvk::Format format = lvk::Format_Invalid;
+		uint8_t usage = 0;
+		lvk::Dimensions dimensions;
+		uint32_t busyUntilPass = kUnused;
+	};
+
+	/// `written` is true for attachments; attachments with LoadOp_Load also read the previous contents
+	template <typename F> static void forEachResource(const RenderGraphPassDesc& desc, F&& f)
+	{
+		for (const RenderGraphAttachment& a : desc.color)
+			f(a.resource, true);
+		if (desc.depth.resource != kInvalidRenderGraphResource)
+			f(desc.depth.resource, true);
+		for (RenderGraphResource r : desc.reads)
+			f(r, false);
+	}
+
+	void cullPasses()
+	{
+		std::vector<bool> needed(resources_.size());
+
+		for (size_t i = 0; i != resources_.size(); i++)
+			needed[i] = resources_[i].isOutput;
+
+		for (auto it = passes_.rbegin(); it != passes_.rend(); ++it)
+		{
+			const RenderGraphPassDesc& desc = it->desc;
+
+			bool alive = false;
+			forEachResource(desc, [&](RenderGraphResource r, bool written) { alive |= written && needed[r]; });
+
+			it->alive = alive;
+
+			if (!alive)
+			{
+				stats_.numCulledPasses++;
+				continue;
+			}
+
+			for (const RenderGraphAttachment& a : desc.color)
+				needed[a.resource] = a.loadOp == lvk::LoadOp_Load;
+			if (desc.depth.resource != kInvalidRenderGraphResource)
+				needed[desc.depth.resource] = desc.depth.loadOp == lvk::LoadOp_Load;
+			for (RenderGraphResource r : desc.reads)
+				needed[r] = true;
+		}
+	}
+
+	lvk::TextureHandle acquirePhysical(const Resource& r)
+	{
+		const lvk::Dimensions dimensions = {
+			std::max(1u, uint32_t(float(width_) * r.desc.scale)),
+			std::max(1u, uint32_t(float(height_) * r.desc.scale)),
+			1,
+		};
+
+		for (Physical& p : physical_)
+		{
+			const bool available = p.busyUntilPass == kUnused || p.busyUntilPass < r.firstPass;
+			if (available && p.format == r.desc.format && p.usage == r.desc.usage && p.dimensions.width == dimensions.width &&
+				p.dimensions.height == dimensions.height)
+			{
+				p.busyUntilPass = r.lastPass;
+				return p.texture;
+			}
+		}
+
+		LLOGL("RenderGraph: creating %ux%u texture for '%s'\n", dimensions.width, dimensions.height, r.name.c_str());
+
+		physical_.push_back({
+			.texture = ctx_.createTexture({
+				.type = lvk::TextureType_2D,
+				.format = r.desc.format,
+				.dimensions = dimensions,
+				.usage = r.desc.usage,
+				.debugName = r.name.c_str(),
+				}),
+			.format = r.desc.format,
+			.usage = r.desc.usage,
+			.dimensions = dimensions,
+			.busyUntilPass = r.lastPass,
+			});
+
+		return physical_.back().texture;
+	}
+
+	lvk::IContext& ctx_;
+
+	uint32_t width_ = 0;
+	uint32_t height_ = 0;
+
+	std::vector<Resource> resources_;
+	std::vector<Pass> passes_;
+	std::vector<Physical> physical_;
+
+	RenderGraphStats stats_;
+};
@@ -16,6 +16,8 @@
 #include <span>
 #include <iostream>
 
+#include "mapped_file.h"
+
 namespace fs = std::filesystem;
 
 inline std::string readTextFile(const fs::path& file, std::unordered_set<fs::path>& includeGuard)
@@ -26,44 +28,41 @@ inline std::string readTextFile(const fs::path& file, std::unordered_set<fs::pat
 		return {};
 	}
 
-	std::ifstream in(file, std::ios::binary);
-	if (!in)
+	const MappedFile mapped(file, eAssetClass_Shader);
+	if (!mapped.isValid())
 	{
 		LLOGW("Failed to open shader file %s\n", file.string().c_str());
 		return {};
 	}
 
-	std::string code;
-	in.seekg(0, std::ios::end);
-	code.reserve(in.tellg());
-	in.seekg(0, std::ios::beg);
-	code.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	std::string_view text = mapped.text();
 
 	// Remove UTF-8 BOM
-	if (code.size() >= 3 &&
-		static_cast<unsigned char>(code[0]) == 0xEF &&
-		static_cast<unsigned char>(code[1]) == 0xBB &&
-		static_cast<unsigned char>(code[2]) == 0xBF)
-	{
-		code.erase(0, 3);
-	}
+	if (text.starts_with("\xEF\xBB\xBF"))
+		text.remove_prefix(3);
+
+	// Handle #include <file>: the code is assembled from the mapped file around the includes, so it is copied only once
+	std::string code;
+	code.reserve(text.size());
 
-	// Handle #include <file>
+	size_t copied = 0;
 	size_t pos = 0;
-	while ((pos = code.find("#include", pos)) != std::string::npos)
+	while ((pos = text.find("#include", pos)) != std::string_view::npos)
 	{
-		const auto start = code.find('<', pos);
-		const auto end = code.find('>', start);
+		const auto start = text.find('<', pos);
+		const auto end = text.find('>', start);
 
-		if (start == std::string::npos || end == std::string::npos)
+		if (start == std::string_view::npos || end == std::string_view::npos)
 			break;
 
-		const fs::path includePath = file.parent_path() / code.substr(start + 1, end - start - 1);
+		const fs::path includePath = file.parent_path() / text.substr(start + 1, end - start - 1);
 
-		const std::string includeCode = readTextFile(includePath, includeGuard);
+		code.append(text.substr(copied, pos - copied));
+		code.append(readTextFile(includePath, includeGuard));
 
-		code.replace(pos, end - pos + 1, includeCode);
+		copied = pos = end + 1;
 	}
+	code.append(text.substr(copied));
 
 	return code;
 }
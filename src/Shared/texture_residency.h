@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/// Byte sizes of a full 2D mip chain, level 0 first
+inline std::vector<uint64_t> getMipSizes(uint32_t width, uint32_t height, uint32_t bytesPerTexel)
+{
+	std::vector<uint64_t> sizes;
+
+	for (;;)
+	{
+		sizes.push_back(uint64_t(width) * height * bytesPerTexel);
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+
+	return sizes;
+}
+
+struct TextureResidencyStats
+{
+	uint64_t budgetBytes = 0;
+	/// What the textures take once every issued request has completed
+	uint64_t residentBytes = 0;
+	/// What the textures would take with every mip resident
+	uint64_t fullBytes = 0;
+	uint32_t numTextures = 0;
+	/// Textures with at least one of their top mips dropped
+	uint32_t numDegraded = 0;
+	uint32_t numPending = 0;
+	/// Totals since creation; one eviction drops one mip level
+	uint32_t numEvictions = 0;
+	uint32_t numReloads = 0;
+	uint32_t numLoadFailures = 0;
+};
+
+/// Make mips [firstMip, numMips) of texture `id` resident, and nothing else
+struct TextureResidencyRequest
+{
+	uint32_t id = 0;
+	uint32_t firstMip = 0;
+};
+
+/// The bookkeeping half of the texture residency: which mips of which texture should be resident under a memory budget.
+/// It never touches the GPU; the caller performs the requests returned by update() and reports back with onLoaded(),
+/// or with onLoadFailed() when the texture kept its previous mips.
+///   - textures are evicted by dropping their top mips one level at a time, least recently used first;
+///   - the smallest mip of a texture is never evicted, so every texture always has something to sample;
+///   - a degraded texture which is used again is reloaded as far as the budget allows, evicting textures unused
+///     in the current frame to make room, but never textures used in the current frame, so two textures cannot thrash.
+class TextureResidencyPolicy
+{
+public:
+	explicit TextureResidencyPolicy(uint64_t budgetBytes)
+		: budgetBytes_(budgetBytes)
+	{
+	}
+
+	/// The texture starts fully resident; the next update() evicts it right away if it does not fit
+	uint32_t addTexture(std::vector<uint64_t> mipSizes)
+	{
+		Entry e = { .mipSizes = std::move(mipSizes) };
+		e.lastUsedFrame = frame_;
+		residentBytes_ += e.getBytes(0);
+		entries_.push_back(std::move(e));
+		return uint32_t(entries_.size() - 1);
+	}
+
+	void touch(uint32_t id)
+	{
+		entries_[id].lastUsedFrame = frame_;
+	}
+
+	void setBudget(uint64_t budgetBytes)
+	{
+		budgetBytes_ = budgetBytes;
+	}
+
+	uint64_t getBudget() const { return budgetBytes_; }
+
+	/// Call once per frame, after the frame's touch() calls. Requests for textures with a pending request are never issued.
+	std::vector<TextureResidencyRequest> update()
+	{
+		std::unordered_map<uint32_t, uint32_t> requests;
+
+		// reload what was used this frame, most expensive first
+		std::vector<uint32_t> reloads;
+		for (uint32_t id = 0; id != entries_.size(); id++)
+		{
+			const Entry& e = entries_[id];
+			if (e.firstMip > 0 && !e.pending && e.lastUsedFrame == frame_)
+				reloads.push_back(id);
+		}
+		std::sort(reloads.begin(), reloads.end(), [this](uint32_t a, uint32_t b) { return entries_[a].getBytes(0) > entries_[b].getBytes(0); });
+
+		for (uint32_t id : reloads)
+		{
+			Entry& e = entries_[id];
+
+			const uint64_t need = e.getBytes(0) - e.getBytes(e.firstMip);
+			while (residentBytes_ + need > budgetBytes_ && evictOne(frame_, requests))
+			{
+			}
+
+			uint32_t firstMip = e.firstMip;
+			while (firstMip > 0 && residentBytes_ - e.getBytes(e.firstMip) + e.getBytes(firstMip - 1) <= budgetBytes_)
+				firstMip--;
+
+			if (firstMip != e.firstMip)
+			{
+				residentBytes_ = residentBytes_ - e.getBytes(e.firstMip) + e.getBytes(firstMip);
+				e.firstMip = firstMip;
+				requests[id] = firstMip;
+				stats_.numReloads++;
+			}
+		}
+
+		// over budget even without the reloads, e.g. a new texture or a smaller budget: textures used this frame go as well
+		while (residentBytes_ > budgetBytes_ && (evictOne(frame_, requests) || evictOne(frame_ + 1, requests)))
+		{
+		}
+
+		std::vector<TextureResidencyRequest> result;
+		result.reserve(requests.size());
+		for (const auto& [id, firstMip] : requests)
+		{
+			entries_[id].pending = true;
+			result.push_back({ .id = id, .firstMip = firstMip });
+		}
+		std::sort(result.begin(), result.end(), [](const TextureResidencyRequest& a, const TextureResidencyRequest& b) { return a.id < b.id; });
+
+		frame_++;
+
+		return result;
+	}
+
+	/// The request for `id` has been performed
+	void onLoaded(uint32_t id)
+	{
+		Entry& e = entries_[id];
+		e.pending = false;
+		e.loadedFirstMip = e.firstMip;
+	}
+
+	/// The request for `id` could not be performed and the texture still has the mips it had before. The accounting goes
+	/// back to them, and the next update() issues a new request if the texture still needs one.
+	void onLoadFailed(uint32_t id)
+	{
+		Entry& e = entries_[id];
+		residentBytes_ = residentBytes_ - e.getBytes(e.firstMip) + e.getBytes(e.loadedFirstMip);
+		e.firstMip = e.loadedFirstMip;
+		e.pending = false;
+		stats_.numLoadFailures++;
+	}
+
+	uint32_t getFirstMip(uint32_t id) const { return entries_[id].firstMip; }
+	uint32_t getNumMips(uint32_t id) const { return (uint32_t)entries_[id].mipSizes.size(); }
+	bool isPending(uint32_t id) const { return entries_[id].pending; }
+	uint64_t getResidentBytes() const { return residentBytes_; }
+
+	TextureResidencyStats getStats() const
+	{
+		TextureResidencyStats s = stats_;
+		s.budgetBytes = budgetBytes_;
+		s.residentBytes = residentBytes_;
+		s.numTextures = (uint32_t)entries_.size();
+		for (const Entry& e : entries_)
+		{
+			s.fullBytes += e.getBytes(0);
+			s.numDegraded += e.firstMip > 0;
+			s.numPending += e.pending;
+		}
+		return s;
+	}
+
+private:
+	struct Entry
+	{
+		std::vector<uint64_t> mipSizes;
+		/// What the texture should have once the pending request is done
+		uint32_t firstMip = 0;
+		/// What the texture has now
+		uint32_t loadedFirstMip = 0;
+		uint64_t lastUsedFrame = 0;
+		bool pending = false;
+
+		uint64_t getBytes(uint32_t fromMip) const
+		{
+			uint64_t bytes = 0;
+			for (size_t i = fromMip; i < mipSizes.size(); i++)
+				bytes += mipSizes[i];
+			return bytes;
+		}
+	};
+
+	/// Drops the top mip of the least recently used texture which was last used before `frame`; larger textures break ties
+	bool evictOne(uint64_t frame, std::unordered_map<uint32_t, uint32_t>& requests)
+	{
+		uint32_t victim = ~0u;
+
+		for (uint32_t id = 0; id != entries_.size(); id++)
+		{
+			const Entry& e = entries_[id];
+			if (e.pending || e.lastUsedFrame >= frame || e.firstMip + 1 >= e.mipSizes.size())
+				continue;
+			if (victim == ~0u)
+			{
+				victim = id;
+				continue;
+			}
+			const Entry& v = entries_[victim];
+			if (e.lastUsedFrame < v.lastUsedFrame || (e.lastUsedFrame == v.lastUsedFrame && e.mipSizes[e.firstMip] > v.mipSizes[v.firstMip]))
+				victim = id;
+		}
+
+		if (victim == ~0u)
+			return false;
+
+		Entry& e = entries_[victim];
+		residentBytes_ -= e.mipSizes[e.firstMip];
+		e.firstMip++;
+		requests[victim] = e.firstMip;
+		stats_.numEvictions++;
+
+		return true;
+	}
+
+	std::vector<Entry> entries_;
+
+	uint64_t budgetBytes_ = 0;
+	uint64_t residentBytes_ = 0;
+	uint64_t frame_ = 0;
+
+	TextureResidencyStats stats_;
+};
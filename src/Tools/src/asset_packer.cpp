@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "asset_archive.h"
+
+// Packs the runtime data of the chapters into one archive, which 03-ImGui mounts with --archive=FILE:
+//   asset_packer assets.pak [--root=DIR] [--align=N] [--zstd[=LEVEL]] [DIR|FILE ...]
+// Inputs are relative to the root, the repository by default; without inputs the shaders, models, HDRs and fonts are packed.
+// SPIR-V caches can be packed as well when they live under the root, e.g. build/src/03-Imgui/.cache/spirv.
+
+static void printUsage()
+{
+	printf("Usage: asset_packer OUTPUT [--root=DIR] [--align=N] [--zstd[=LEVEL]] [DIR|FILE ...]\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || argv[1][0] == '-')
+	{
+		printUsage();
+		return 1;
+	}
+
+	const std::filesystem::path output = argv[1];
+	std::filesystem::path root = ".";
+	ArchiveBuildSettings settings;
+	std::vector<std::filesystem::path> inputs;
+
+	for (int i = 2; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--root=", 7))
+			root = argv[i] + 7;
+		else if (!strncmp(argv[i], "--align=", 8))
+			settings.alignment = (uint32_t)std::max(1, atoi(argv[i] + 8));
+		else if (!strcmp(argv[i], "--zstd"))
+			settings.compression = eArchiveCompression_Zstd;
+		else if (!strncmp(argv[i], "--zstd=", 7))
+		{
+			settings.compression = eArchiveCompression_Zstd;
+			settings.compressionLevel = atoi(argv[i] + 7);
+		}
+		else if (argv[i][0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+			inputs.push_back(argv[i]);
+	}
+
+	if (inputs.empty())
+		inputs = { "shaders", "models", "HDR", "fonts" };
+
+	const std::vector<ArchiveBuildEntry> entries = collectArchiveEntries(root, inputs);
+	if (entries.empty())
+	{
+		printf("No files found under %s\n", std::filesystem::absolute(root).string().c_str());
+		return 1;
+	}
+
+	ArchiveBuildStats stats;
+	if (!buildAssetArchive(output, entries, settings, &stats))
+		return 1;
+
+	printf("%-8s %8s %12s %12s %7s\n", "Class", "Entries", "Input KB", "Stored KB", "Ratio");
+	for (uint32_t i = 0; i != eAssetClass_Count; i++)
+	{
+		if (!stats.numEntriesPerClass[i])
+			continue;
+		printf("%-8s %8u %12.1f %12.1f %6.1f%%\n", getAssetClassName(i), stats.numEntriesPerClass[i], stats.inputBytesPerClass[i] / 1024.0,
+			stats.storedBytesPerClass[i] / 1024.0, 100.0 * stats.storedBytesPerClass[i] / std::max<uint64_t>(1, stats.inputBytesPerClass[i]));
+	}
+	printf("%s: %u entries (%u compressed with %s), %.1f KB of files in %.1f KB, built in %.1f ms\n", output.string().c_str(),
+		stats.numEntries, stats.numCompressed, getArchiveCompressionName(settings.compression), stats.inputBytes / 1024.0,
+		stats.archiveBytes / 1024.0, stats.ms);
+
+	// read every entry back through the archive and compare it with its file
+	const std::shared_ptr<AssetArchive> archive = AssetArchive::load(output, root);
+	if (!archive)
+		return 1;
+
+	for (const ArchiveBuildEntry& e : entries)
+	{
+		MappedFile packed;
+		const MappedFile loose(e.file, eAssetClass_Cache);
+		if (!archive->open(e.file, getAssetClassFromPath(e.file), packed) || packed.size() != loose.size() ||
+			(loose.size() && memcmp(packed.data(), loose.data(), loose.size())))
+		{
+			printf("Verification failed: %s\n", e.name.c_str());
+			return 1;
+		}
+	}
+	printf("Verified %zu entries\n", entries.size());
+
+	return 0;
+}
@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <stb/stb_image_write.h>
+
+#include "UtilsCubemap.h"
+#include "brdf_lut.h"
+#include "job_system.h"
+#include "mapped_file.h"
+
+// Bakes the image based lighting of many environments, as cubemap() does for one:
+//   env_baker [--out=DIR] [--irradiance=W] [--specular=W] [--samples=N] [--uniform] [--jobs=N] [--files=N] [--force] [DIR|FILE ...]
+// Every .hdr file (directories are searched recursively) gets a directory of its own under the output directory with:
+//   cross.hdr        the vertical cross
+//   cube_mipN.hdr    the cube map mip chain, the six faces of a level stacked vertically
+//   irradiance.hdr   the Lambertian convolution, equirectangular, W x W/2, importance sampled unless --uniform
+//   specular.hdr     the GGX convolution, equirectangular, W x W/2
+//   bake.stamp       what the outputs were baked from
+// The output directory also gets brdf_lut.ktx2, the split-sum BRDF table (RG16F), which is the same for every environment
+// and is generated only when it is missing or was generated with other settings.
+// An environment is baked again only when the hash of its file or the settings differ from its stamp, or an output is
+// missing; a file whose size and modification time match the stamp is not even hashed. Without DIR|FILE, HDR is baked.
+// Up to --files environments (2 by default) are baked at the same time, which bounds the memory, and the steps of one
+// environment run in parallel.
+
+namespace fs = std::filesystem;
+
+using Clock = std::chrono::steady_clock;
+
+/// Bump when the outputs change for the same input and settings
+constexpr uint32_t kBakeVersion = 1;
+
+/// Environments in memory at the same time; every one of them holds its source twice, as RGBA and RGB floats
+constexpr uint32_t kDefaultFilesInFlight = 2;
+
+struct BakeSettings
+{
+	fs::path outputDir = ".cache/env";
+	int irradianceWidth = 256;
+	int specularWidth = 512;
+	int numSamples = 1024;
+	/// Luminance importance sampling for the irradiance, see convolveLambertianImportance()
+	bool importance = true;
+	bool force = false;
+};
+
+enum eBakeResult
+{
+	eBakeResult_Baked,
+	eBakeResult_UpToDate,
+	eBakeResult_Failed,
+	eBakeResult_Count
+};
+
+inline const char* getBakeResultName(uint32_t result)
+{
+	static const char* kNames[] = { "baked", "up to date", "FAILED" };
+	static_assert(sizeof(kNames) / sizeof(kNames[0]) == eBakeResult_Count);
+	return result < eBakeResult_Count ? kNames[result] : "Unknown";
+}
+
+struct BakeJob
+{
+	fs::path input;
+	fs::path outputDir;
+	eBakeResult result = eBakeResult_Failed;
+	/// Texels read from the environment and texels written to the outputs
+	uint64_t inputTexels = 0;
+	uint64_t outputTexels = 0;
+	double ms = 0.0;
+};
+
+/// What bake.stamp holds; the size and the modification time only save hashing files which were not touched
+struct BakeStamp
+{
+	uint64_t fileSize = 0;
+	int64_t fileTime = 0;
+	uint64_t fileHash = 0;
+	uint64_t settingsHash = 0;
+	/// Depends on the size of the environment, so the outputs can be checked without reading it
+	uint32_t numCubeMips = 0;
+
+	bool operator==(const BakeStamp&) const = default;
+};
+
+// FNV-1a
+static uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	for (size_t i = 0; i != size; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+template <typename T> static uint64_t hashValue(const T& value, uint64_t hash)
+{
+	return hashBytes(reinterpret_cast<const uint8_t*>(&value), sizeof(T), hash);
+}
+
+static uint64_t hashSettings(const BakeSettings& s)
+{
+	uint64_t hash = hashValue(kBakeVersion, 0xcbf29ce484222325ull);
+	hash = hashValue(s.irradianceWidth, hash);
+	hash = hashValue(s.specularWidth, hash);
+	hash = hashValue(s.numSamples, hash);
+	return hashValue(s.importance, hash);
+}
+
+static bool readStamp(const fs::path& file, BakeStamp& stamp)
+{
+	FILE* f = fopen(file.string().c_str(), "r");
+	if (!f)
+		return false;
+
+	unsigned long long size = 0;
+	long long time = 0;
+	unsigned long long fileHash = 0;
+	unsigned long long settingsHash = 0;
+	unsigned int numCubeMips = 0;
+	const bool ok = fscanf(f, "%llu %lld %llx %llx %u", &size, &time, &fileHash, &settingsHash, &numCubeMips) == 5;
+	fclose(f);
+
+	stamp = { .fileSize = size, .fileTime = time, .fileHash = fileHash, .settingsHash = settingsHash, .numCubeMips = numCubeMips };
+	return ok;
+}
+
+static bool writeStamp(const fs::path& file, const BakeStamp& stamp)
+{
+	FILE* f = fopen(file.string().c_str(), "w");
+	if (!f)
+		return false;
+
+	fprintf(f, "%llu %lld %016llx %016llx %u\n", (unsigned long long)stamp.fileSize, (long long)stamp.fileTime,
+		(unsigned long long)stamp.fileHash, (unsigned long long)stamp.settingsHash, stamp.numCubeMips);
+	return fclose(f) == 0;
+}
+
+static std::string getCubeMipName(size_t level)
+{
+	return "cube_mip" + std::to_string(level) + ".hdr";
+}
+
+/// Every output of the stamp is still there; deleting one of them bakes the environment again
+static bool hasOutputs(const fs::path& dir, const BakeStamp& stamp)
+{
+	std::error_code ec;
+
+	if (!stamp.numCubeMips)
+		return false;
+
+	for (const char* name : { "cross.hdr", "irradiance.hdr", "specular.hdr" })
+	{
+		if (!fs::is_regular_file(dir / name, ec))
+			return false;
+	}
+
+	for (uint32_t i = 0; i != stamp.numCubeMips; i++)
+	{
+		if (!fs::is_regular_file(dir / getCubeMipName(i), ec))
+			return false;
+	}
+
+	return true;
+}
+
+static bool writeHdr(const fs::path& file, int w, int h, int comp, const void* data)
+{
+	return stbi_write_hdr(file.string().c_str(), w, h, comp, static_cast<const float*>(data)) != 0;
+}
+
+static void bakeOrSkipEnvironment(BakeJob& job, const BakeSettings& settings)
+{
+	std::error_code ec;
+	const fs::path stampFile = job.outputDir / "bake.stamp";
+
+	BakeStamp stamp = {
+		.fileSize = (uint64_t)fs::file_size(job.input, ec),
+		.fileTime = (int64_t)fs::last_write_time(job.input, ec).time_since_epoch().count(),
+		.settingsHash = hashSettings(settings),
+	};
+
+	BakeStamp previous;
+	const bool hasStamp = !settings.force && readStamp(stampFile, previous) && previous.settingsHash == stamp.settingsHash &&
+		hasOutputs(job.outputDir, previous);
+
+	if (hasStamp && previous.fileSize == stamp.fileSize && previous.fileTime == stamp.fileTime)
+	{
+		job.result = eBakeResult_UpToDate;
+		return;
+	}
+
+	const MappedFile file(job.input, eAssetClass_Image, eFileAccess_Sequential);
+	if (!file.size() || file.size() > INT_MAX)
+	{
+		printf("Unable to read %s\n", job.input.string().c_str());
+		return;
+	}
+
+	stamp.fileHash = hashBytes(file.bytes().data(), file.size());
+
+	if (hasStamp && previous.fileHash == stamp.fileHash)
+	{
+		// touched but not changed; remember the new time, so the next run does not hash it again
+		stamp.numCubeMips = previous.numCubeMips;
+		writeStamp(stampFile, stamp);
+		job.result = eBakeResult_UpToDate;
+		return;
+	}
+
+	int w = 0;
+	int h = 0;
+	float* img = stbi_loadf_from_memory(file.data(), (int)file.size(), &w, &h, nullptr, 4);
+	if (!img || w != 2 * h)
+	{
+		printf("%s: %s\n", job.input.string().c_str(), img ? "not an equirectangular (2:1) image" : stbi_failure_reason());
+		stbi_image_free(img);
+		return;
+	}
+
+	const Bitmap equirect = Bitmap::wrap(w, h, 4, eBitmapFormat_Float, img, std::shared_ptr<void>(img, stbi_image_free));
+	job.inputTexels = uint64_t(w) * h;
+
+	fs::create_directories(job.outputDir, ec);
+	// a bake which does not finish must not look up to date
+	fs::remove(stampFile, ec);
+
+	std::atomic<uint64_t> outputTexels = 0;
+	std::atomic<bool> ok = true;
+
+	auto write = [&](const char* name, int width, int height, int comp, const void* data) {
+		if (!writeHdr(job.outputDir / name, width, height, comp, data))
+		{
+			printf("Unable to write %s\n", (job.outputDir / name).string().c_str());
+			ok = false;
+			return;
+		}
+		outputTexels += uint64_t(width) * height;
+	};
+
+	JobSystem& js = getJobSystem();
+	JobCounter counter;
+
+	// the cube map and the two convolutions only share the source, so they run side by side
+	js.run(counter, [&]() {
+		const Bitmap cross = convertEquirectangularMapToVerticalCross(equirect);
+		write("cross.hdr", cross.w_, cross.h_, cross.comp_, cross.data_.data());
+
+		const std::vector<Bitmap> levels = generateCubeMipChain(convertVerticalCrossToCubeMapFaces(cross));
+		for (size_t i = 0; i != levels.size(); i++)
+		{
+			const Bitmap& level = levels[i];
+			write(getCubeMipName(i).c_str(), level.w_, level.h_ * level.d_, level.comp_, level.data_.data());
+		}
+		stamp.numCubeMips = (uint32_t)levels.size();
+	});
+
+	Bitmap source(w, h, 3, eBitmapFormat_Float);
+	{
+		const float* src = img;
+		float* dst = reinterpret_cast<float*>(source.data_.data());
+		for (size_t i = 0; i != size_t(w) * h; i++, src += 4, dst += 3)
+			memcpy(dst, src, 3 * sizeof(float));
+	}
+
+	const glm::vec3* src = reinterpret_cast<const glm::vec3*>(source.data_.data());
+
+	js.run(counter, [&]() {
+		Bitmap out(settings.irradianceWidth, settings.irradianceWidth / 2, 3, eBitmapFormat_Float);
+		glm::vec3* dst = reinterpret_cast<glm::vec3*>(out.data_.data());
+		// a bright sun needs importance sampling; uniform samples miss it or hit it far too hard
+		if (settings.importance)
+			convolveLambertianImportance(src, buildEnvironmentCdf(src, w, h), out.w_, out.h_, dst, settings.numSamples);
+		else
+			convolveLambertian(src, w, h, out.w_, out.h_, dst, settings.numSamples);
+		write("irradiance.hdr", out.w_, out.h_, out.comp_, out.data_.data());
+	});
+
+	js.run(counter, [&]() {
+		Bitmap out(settings.specularWidth, settings.specularWidth / 2, 3, eBitmapFormat_Float);
+		convolveGGX(src, w, h, out.w_, out.h_, reinterpret_cast<glm::vec3*>(out.data_.data()), settings.numSamples);
+		write("specular.hdr", out.w_, out.h_, out.comp_, out.data_.data());
+	});
+
+	js.wait(counter);
+
+	job.outputTexels = outputTexels;
+
+	if (ok && writeStamp(stampFile, stamp))
+		job.result = eBakeResult_Baked;
+}
+
+/// Every result gets its time, including the skipped and the failed ones
+static void bakeEnvironment(BakeJob& job, const BakeSettings& settings)
+{
+	const Clock::time_point start = Clock::now();
+	bakeOrSkipEnvironment(job, settings);
+	job.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void collectInputs(const fs::path& path, std::vector<fs::path>& inputs)
+{
+	std::error_code ec;
+
+	if (!fs::is_directory(path, ec))
+	{
+		inputs.push_back(path);
+		return;
+	}
+
+	for (const fs::directory_entry& e : fs::recursive_directory_iterator(path, ec))
+	{
+		std::string ext = e.path().extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower(c); });
+		if (e.is_regular_file() && ext == ".hdr")
+			inputs.push_back(e.path());
+	}
+}
+
+static void printUsage()
+{
+	printf("Usage: env_baker [--out=DIR] [--irradiance=W] [--specular=W] [--samples=N] [--uniform] [--jobs=N] [--files=N] [--force] [DIR|FILE ...]\n");
+}
+
+int main(int argc, char** argv)
+{
+	BakeSettings settings;
+	uint32_t numThreads = 0;
+	uint32_t numFilesInFlight = kDefaultFilesInFlight;
+	std::vector<fs::path> inputs;
+	bool hasPaths = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--out=", 6))
+			settings.outputDir = argv[i] + 6;
+		else if (!strncmp(argv[i], "--irradiance=", 13))
+			settings.irradianceWidth = std::max(2, atoi(argv[i] + 13)) & ~1;
+		else if (!strncmp(argv[i], "--specular=", 11))
+			settings.specularWidth = std::max(2, atoi(argv[i] + 11)) & ~1;
+		else if (!strncmp(argv[i], "--samples=", 10))
+			settings.numSamples = std::max(1, atoi(argv[i] + 10));
+		else if (!strncmp(argv[i], "--jobs=", 7))
+			numThreads = (uint32_t)std::max(1, atoi(argv[i] + 7));
+		else if (!strncmp(argv[i], "--files=", 8))
+			numFilesInFlight = (uint32_t)std::max(1, atoi(argv[i] + 8));
+		else if (!strcmp(argv[i], "--uniform"))
+			settings.importance = false;
+		else if (!strcmp(argv[i], "--force"))
+			settings.force = true;
+		else if (argv[i][0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			collectInputs(argv[i], inputs);
+			hasPaths = true;
+		}
+	}
+
+	// options alone bake the default directory as well
+	if (!hasPaths)
+		collectInputs("HDR", inputs);
+
+	std::sort(inputs.begin(), inputs.end());
+	inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+
+	if (inputs.empty())
+	{
+		printf("No .hdr files found\n");
+		return 1;
+	}
+
+	if (numThreads)
+		resetJobSystem(numThreads);
+
+	// one output directory per input, named after it; inputs with the same name get a suffix
+	std::vector<BakeJob> jobs(inputs.size());
+	std::vector<std::string> names;
+	for (size_t i = 0; i != inputs.size(); i++)
+	{
+		std::string name = inputs[i].stem().string();
+		for (int n = 2; std::find(names.begin(), names.end(), name) != names.end(); n++)
+			name = inputs[i].stem().string() + "_" + std::to_string(n);
+		names.push_back(name);
+		jobs[i] = { .input = inputs[i], .outputDir = settings.outputDir / name };
+	}
+
+	const Clock::time_point start = Clock::now();
+
+	JobSystem& js = getJobSystem();
+	JobCounter counter;
+	BrdfLutStats brdfStats;
+	js.run(counter, [&]() { getBrdfLut(settings.outputDir / "brdf_lut.ktx2", &brdfStats); });
+	// a fixed number of file workers take the files one by one, so a worker which helps while it waits for the steps of its
+	// file can at most pick up another worker, never more files than that
+	std::atomic<size_t> nextJob = 0;
+	const uint32_t numFileWorkers = (uint32_t)std::min<size_t>(numFilesInFlight, jobs.size());
+	for (uint32_t i = 0; i != numFileWorkers; i++)
+	{
+		js.run(counter, [&jobs, &nextJob, &settings]() {
+			for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+				bakeEnvironment(jobs[j], settings);
+		});
+	}
+	js.wait(counter);
+
+	const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	uint32_t numResults[eBakeResult_Count] = {};
+	uint64_t inputTexels = 0;
+	uint64_t outputTexels = 0;
+
+	for (const BakeJob& job : jobs)
+	{
+		numResults[job.result]++;
+		inputTexels += job.inputTexels;
+		outputTexels += job.outputTexels;
+
+		if (job.result == eBakeResult_Baked)
+			printf("[env_baker] %s: %.1f MP in %.1f ms\n", job.input.string().c_str(), job.inputTexels / 1e6, job.ms);
+		else
+			printf("[env_baker] %s: %s in %.1f ms\n", job.input.string().c_str(), getBakeResultName(job.result), job.ms);
+	}
+
+	const double seconds = std::max(ms, 1e-3) / 1000.0;
+	printf("[env_baker] %u baked, %u up to date, %u failed in %.1f ms on %u threads: %.1f MP read at %.2f MP/s, %.1f MP written at %.2f MP/s\n",
+		numResults[eBakeResult_Baked], numResults[eBakeResult_UpToDate], numResults[eBakeResult_Failed], ms, js.getNumThreads(),
+		inputTexels / 1e6, inputTexels / 1e6 / seconds, outputTexels / 1e6, outputTexels / 1e6 / seconds);
+	printBrdfLutStats("env_baker", brdfStats);
+	printFileIoStats("env_baker");
+	printImageMemoryStats("env_baker");
+
+	return numResults[eBakeResult_Failed] || !brdfStats.passed ? 1 : 0;
+}